@@ -5,10 +5,86 @@
  */
 
 #include "hlw811x.h"
-#include "hlw811x_overrides.h"
 
+#include <stdbool.h>
 #include <string.h>
 
+#if !defined(HLW811X_MAX_INSTANCES)
+#define HLW811X_MAX_INSTANCES	1
+#endif
+
+#if !defined(HLW811X_CONFIG_TXN_MAX)
+#define HLW811X_CONFIG_TXN_MAX	16 /* max registers staged in a transaction */
+#endif
+
+#if !defined(HLW811X_ASYNC_QUEUE_LEN)
+#define HLW811X_ASYNC_QUEUE_LEN		4 /* max queued asynchronous reads */
+#endif
+
+#if !defined(HLW811X_ASYNC_PIPELINE_DEPTH)
+/* max read headers sent ahead of their responses on UART */
+#define HLW811X_ASYNC_PIPELINE_DEPTH	2
+#endif
+
+#if !defined(HLW811X_ZC_FILTER_SHIFT)
+/* weight of a new line period in the tracker as 1/2^n */
+#define HLW811X_ZC_FILTER_SHIFT		3
+#endif
+
+#if !defined(HLW811X_EVENT_LOG_LEN)
+#define HLW811X_EVENT_LOG_LEN		8 /* power-quality events kept, < 256 */
+#endif
+
+#if !defined(HLW811X_CALIB_SAMPLES_MAX)
+#define HLW811X_CALIB_SAMPLES_MAX	64 /* updates averaged per step */
+#endif
+
+/* Linear fit of RMS_IB in the temperature mode, characterized on the board:
+ * HLW811X_TEMP_REF_RAW read at HLW811X_TEMP_REF_CENTIDEGREE, and
+ * HLW811X_TEMP_COUNTS_PER_DEGREE per degree Celsius. The datasheet gives no
+ * such figures, so there is no default and the temperature is not
+ * implemented unless all three are defined. */
+#if defined(HLW811X_TEMP_REF_RAW) && defined(HLW811X_TEMP_REF_CENTIDEGREE) \
+		&& defined(HLW811X_TEMP_COUNTS_PER_DEGREE)
+#define TEMP_FIT_DEFINED		1
+#else
+#define TEMP_FIT_DEFINED		0
+#endif
+
+#if !defined(HLW811X_TEMP_SETTLE_PERIODS)
+/* update periods for channel B to settle after a mode switch */
+#define HLW811X_TEMP_SETTLE_PERIODS	2
+#endif
+
+#if !defined(HLW811X_POWER_SAVE_SETTLE_PERIODS)
+/* update periods for the ADCs and the averaging to settle after power-on.
+ * The first update is averaged over the power-on, so two at least. */
+#define HLW811X_POWER_SAVE_SETTLE_PERIODS	2
+#endif
+
+#if !defined(HLW811X_AGG_OFFLINE_ROUNDS)
+/* Failed rounds in a row after which a chip is reported offline */
+#define HLW811X_AGG_OFFLINE_ROUNDS	3
+#endif
+
+#if !defined(HLW811X_AGG_TIMEOUT_MS)
+/* time for a chip to answer its snapshot in hlw811x_agg_step() */
+#define HLW811X_AGG_TIMEOUT_MS		250
+#endif
+
+#if !defined(HLW811X_STATS)
+/* 1 to count the bus transfers for hlw811x_get_stats() */
+#define HLW811X_STATS			0
+#endif
+
+#if !defined(HLW811X_MEMORY_BARRIER)
+#if defined(__GNUC__)
+#define HLW811X_MEMORY_BARRIER()	__sync_synchronize()
+#else
+#define HLW811X_MEMORY_BARRIER()
+#endif
+#endif
+
 #if !defined(HLW811X_MCLK)
 #define HLW811X_MCLK		(3579545UL) /* Hz (= 3.579545MHz) */
 #endif
@@ -22,6 +98,11 @@
 #if !defined(HLW811X_ERROR)
 #define HLW811X_ERROR(...)
 #endif
+/* Called after each bus transfer with the hlw811x_op_t, the register, the
+ * bytes on the wire, the result and the latency in microseconds. */
+#if !defined(HLW811X_TRACE)
+#define HLW811X_TRACE(op, addr, bytes, err, us)
+#endif
 
 enum {
 	CMD_ENABLE_WRITE	= 0xE5u,
@@ -49,18 +130,275 @@ struct calc_param {
 	uint16_t ratio; /* resistor ratio */
 	hlw811x_pga_gain_t pga; /* PGA gain */
 	uint8_t mult; /* multiplier */
-	int64_t resol; /* resolution */
+	int8_t resol; /* resolution in bits */
+};
+
+/* Conversion of a raw register value as (raw * mult) >> shift, precomputed
+ * from the coefficients, the resistor ratio and the PGA gains by
+ * update_factors() whenever any of them changes. */
+struct factor {
+	uint32_t mult;
+	uint8_t shift;
+};
+
+struct factors {
+	struct factor rms[3]; /* A, B and U */
+	struct factor power[4]; /* A, B, and S when channel A or B selected */
+	struct factor energy[2]; /* A and B */
+};
+
+/* Control registers to be cached in the shadow. The order of the array
+ * defines the index in struct shadow. */
+static const hlw811x_reg_addr_t shadowed_regs[] = {
+	HLW811X_REG_SYS_CTRL,
+	HLW811X_REG_METER_CTRL,
+	HLW811X_REG_METER_CTRL_2,
+	HLW811X_REG_INT,
+	HLW811X_REG_IE,
+};
+
+#define SHADOW_MAX	(sizeof(shadowed_regs) / sizeof(shadowed_regs[0]))
+
+struct shadow {
+	uint16_t regs[SHADOW_MAX];
+	bool enabled;
+};
+
+struct staged_write {
+	hlw811x_reg_addr_t addr;
+	uint8_t data[2];
+	uint8_t len;
+};
+
+struct txn {
+	struct staged_write writes[HLW811X_CONFIG_TXN_MAX];
+	uint8_t count;
+	bool active;
+};
+
+/* Frames are bounded so that the stack usage stays static. The writable
+ * registers are 16 bits at most while a response carries up to the widest
+ * register. */
+#define FRAME_WRITE_DATA_MAX	2
+#define FRAME_WRITE_MAX		(1/*header*/ + 1/*addr*/ \
+				+ FRAME_WRITE_DATA_MAX + 1/*chksum*/)
+#define FRAME_READ_REQ_MAX	(1/*header*/ + 1/*addr*/ + 1/*chksum*/)
+#define FRAME_READ_RESP_MAX	(HLW811X_REG_WIDTH_MAX + 1/*chksum*/)
+
+struct async_read {
+	hlw811x_read_cb_t cb;
+	void *cb_ctx;
+	hlw811x_reg_addr_t addr;
+	uint8_t tx[FRAME_READ_REQ_MAX];
+	uint8_t tx_len; /* encoded length, including the chksum on UART */
+	uint8_t rx[FRAME_READ_RESP_MAX];
+	uint8_t rx_len; /* expected length of the response */
+	uint8_t received;
+	uint8_t len; /* requested register width */
+};
+
+/* Reads are kept in submission order. The first `inflight` entries from
+ * `head` have their header sent already and the chip answers them in that
+ * order. */
+struct async_queue {
+	struct async_read reads[HLW811X_ASYNC_QUEUE_LEN];
+	uint8_t head;
+	uint8_t count;
+	uint8_t inflight;
+	struct hlw811x_queue_stats stats;
+};
+
+/* Measurement registers of a snapshot plus METER_STATUS for the channel */
+#define SNAPSHOT_REGS		11
+#define SNAPSHOT_READS_MAX	(SNAPSHOT_REGS + 1)
+
+/* A snapshot read through the asynchronous queue, one register after another
+ * as the queue makes room. The responses come in submission order. */
+struct snapshot_job {
+	hlw811x_snapshot_cb_t cb;
+	void *cb_ctx;
+	uint32_t raw[SNAPSHOT_READS_MAX];
+	uint8_t total; /* reads to be made */
+	uint8_t submitted;
+	uint8_t completed;
+	hlw811x_error_t err; /* of the first read failed */
+	bool active;
+};
+
+#define RESYNC_READS_MAX	8 /* ll_read() calls to drain the receiver */
+#define BACKOFF_SHIFT_MAX	8
+
+struct transport {
+	struct hlw811x_transport_policy policy;
+	struct hlw811x_transport_stats stats;
+};
+
+struct trace {
+	hlw811x_clock_t clock;
+	void *clock_ctx;
+#if HLW811X_STATS
+	struct hlw811x_stats stats;
+#endif
+};
+
+#define ZC_PERIOD_MIN_US	14285 /* 70Hz */
+#define ZC_PERIOD_MAX_US	25000 /* 40Hz */
+#define ZC_PERIOD_FRAC_BITS	4
+
+struct zc_tracker {
+	hlw811x_clock_t clock;
+	void *clock_ctx;
+	uint32_t last_u; /* last voltage crossing in us */
+	uint32_t period; /* filtered line period in 1/16 us */
+	int32_t phase; /* current A behind voltage in centidegree */
+	uint8_t edges; /* crossings per line cycle */
+	bool u_seen;
+	bool locked; /* period is valid */
+	bool phased; /* phase is valid */
+	bool enabled;
+};
+
+#define IRQ_FLAGS_MAX		16 /* bits of the IF register */
+#define IRQ_FLAGS_MASK		((1u << IRQ_FLAGS_MAX) - 1)
+
+struct irq_handler {
+	hlw811x_irq_handler_t fn;
+	void *ctx;
+};
+
+#define ENERGY_REG_RANGE	(1ull << 24)
+
+/* Energy counted in raw register units, so that nothing is lost to the
+ * conversion between polls. */
+struct energy_acc {
+	uint64_t total; /* raw counts accumulated */
+	uint64_t billed; /* Wh handed out by hlw811x_energy_delta() */
+	uint32_t last; /* register value at the last poll */
+	bool primed; /* last is valid */
+	bool overflow_held; /* overflow flag given at the last poll */
+	/* the last poll saw the register wrap with no flag given yet */
+	bool wrap_unflagged;
+};
+
+/* Samples of a calibration step, with the results solved so far */
+struct calib {
+	struct hlw811x_calib_regs regs;
+	int64_t sum; /* raw active power */
+	hlw811x_calib_step_t step;
+	uint8_t count;
+	uint8_t samples;
+	bool active;
+};
+
+/* The level thresholds are compared against the upper 16 bits of the peak
+ * registers, and the overload one against those of the active power. */
+#define THRESHOLD_PEAK_SHIFT	8
+#define THRESHOLD_POWER_SHIFT	16
+
+#define EVENT_INTR_MASK		(HLW811X_INTR_OVER_CURRENT_A \
+				| HLW811X_INTR_OVER_CURRENT_B \
+				| HLW811X_INTR_OVER_VOLTAGE \
+				| HLW811X_INTR_UNDER_VOLTAGE \
+				| HLW811X_INTR_OVERLOAD)
+
+/* Oldest event at `head`. New events are dropped while it is full. */
+struct event_log {
+	struct hlw811x_event events[HLW811X_EVENT_LOG_LEN];
+	hlw811x_clock_t clock;
+	void *clock_ctx;
+	hlw811x_intr_t ints; /* flags captured */
+	uint32_t dropped;
+	uint8_t head;
+	uint8_t count;
+};
+
+/* Channel selection kept in memory, so that neither reading it nor selecting
+ * the same one again goes to the bus. */
+struct chan_mux {
+	hlw811x_clock_t clock;
+	void *clock_ctx;
+	uint32_t settle_us;
+	uint32_t switched_at;
+	hlw811x_channel_t selected; /* 0 if not known yet */
+	bool settling;
+	bool enabled;
+	struct hlw811x_channel_mux_stats stats;
+};
+
+/* A quantity polled every `periods` chip update periods, once due. */
+struct poll_entry {
+	uint16_t interval_ms; /* 0 if not registered */
+	uint8_t priority;
+	uint8_t periods;
+	uint8_t countdown; /* periods left until due */
+};
+
+struct poll_sched {
+	struct poll_entry entries[HLW811X_QTY_MAX];
+	hlw811x_clock_t clock;
+	void *clock_ctx;
+	hlw811x_poll_cb_t cb;
+	void *cb_ctx;
+	uint32_t period_us; /* chip update period */
+	uint32_t next; /* start of the next period to be served */
+	int32_t centihertz; /* last line frequency read, for the angle */
+	uint8_t budget; /* register reads per period. 0 for no limit */
+	/* Channel B is switched to the temperature for an interleaved read,
+	 * then back. The channel is held for the periods it settles. */
+	uint8_t temp_settle;
+	bool temp_switched;
+	bool running;
+	struct hlw811x_poll_stats stats;
+};
+
+/* Duty cycling of the ADCs and the pulse outputs between sampling windows */
+struct power_save {
+	hlw811x_clock_t clock;
+	void *clock_ctx;
+	uint32_t opened; /* time the window opened at */
+	uint32_t settle_us;
+	hlw811x_channel_t channels; /* ADCs gated */
+	hlw811x_channel_t pulse; /* pulse outputs gated */
+	hlw811x_channel_t channels_on; /* gated ADCs on before the start */
+	hlw811x_channel_t pulse_on; /* gated pulses on before the start */
+	bool open;
+	bool enabled;
 };
 
 struct hlw811x {
 	hlw811x_interface_t iface;
+	struct hlw811x_io io;
+	bool allocated;
 
 	struct hlw811x_resistor_ratio ratio;
 	struct hlw811x_coeff coeff;
 	struct hlw811x_pga pga;
+	struct factors factors;
+	hlw811x_channel_b_mode_t b_mode; /* valid if b_mode_known */
+	bool b_mode_known;
+
+	struct shadow shadow;
+	struct txn txn;
+	struct async_queue async;
+	struct snapshot_job snapshot;
+	struct transport transport;
+	struct trace trace;
+
+	struct energy_acc energy[2]; /* A and B */
+	struct irq_handler irq_handlers[IRQ_FLAGS_MAX]; /* by bit position */
+	struct zc_tracker zc;
+
+	struct hlw811x_wave_ring *wave_ring;
+	hlw811x_channel_t wave_channels;
+
+	struct poll_sched poll;
+	struct chan_mux mux;
+	struct event_log events;
+	struct calib calib;
+	struct power_save power_save;
 };
 
-static struct hlw811x m;
+static struct hlw811x instances[HLW811X_MAX_INSTANCES];
 
 static int16_t convert_16bits_to_int16(const uint8_t buf[2])
 {
@@ -106,44 +444,153 @@ static uint16_t convert_float_to_uint16_centi(float val)
 	return (uint16_t)(val * 100);
 }
 
+static uint8_t count_trailing_zeros(uint32_t x)
+{
+#if defined(__GNUC__)
+	return (uint8_t)__builtin_ctz(x);
+#else
+	uint8_t n = 0;
+
+	while (!(x & 1u)) {
+		x >>= 1;
+		n++;
+	}
+
+	return n;
+#endif
+}
+
+#define INTR_PIN_SEL_NONE	0xFFu
+
+/* INT1/INT2 selector by the bit position of hlw811x_intr_t. The last one is
+ * for HLW811X_INTR_IRQ. */
+static const uint8_t intr_pin_sel[IRQ_FLAGS_MAX + 1] = {
+	8,	/* AVERAGE_UPDATED */
+	0,	/* PULSE_OUT_A */
+	1,	/* PULSE_OUT_B */
+	5,	/* ACTIVE_POWER_OVERFLOW_A */
+	6,	/* ACTIVE_POWER_OVERFLOW_B */
+	INTR_PIN_SEL_NONE, /* RESERVED */
+	7,	/* INSTANTAENOUS_UPDATED */
+	14,	/* OVER_CURRENT_A */
+	15,	/* OVER_CURRENT_B */
+	12,	/* OVER_VOLTAGE */
+	4,	/* OVERLOAD */
+	13,	/* UNDER_VOLTAGE */
+	10,	/* ZERO_CROSSING_CURRENT_A */
+	11,	/* ZERO_CROSSING_CURRENT_B */
+	9,	/* ZERO_CROSSING_VOLTAGE */
+	2,	/* B_LEAKAGE */
+	3,	/* IRQ */
+};
+
+typedef char intr_irq_is_last_sel[
+	(HLW811X_INTR_IRQ == 1u << IRQ_FLAGS_MAX) ? 1 : -1];
+
+/* ints must be a single flag or 0 for the default of the chip. */
 static uint8_t get_regval_from_intr(hlw811x_intr_t ints)
 {
-	switch (ints) {
-	case HLW811X_INTR_PULSE_OUT_A:
-		return 0;
-	case HLW811X_INTR_PULSE_OUT_B:
-		return 1;
-	case HLW811X_INTR_B_LEAKAGE:
-		return 2;
-	case HLW811X_INTR_IRQ:
-		return 3;
-	case HLW811X_INTR_OVERLOAD:
-		return 4;
-	case HLW811X_INTR_ACTIVE_POWER_OVERFLOW_A:
-		return 5;
-	case HLW811X_INTR_ACTIVE_POWER_OVERFLOW_B:
-		return 6;
-	case HLW811X_INTR_INSTANTAENOUS_UPDATED:
-		return 7;
-	case HLW811X_INTR_AVERAGE_UPDATED:
-		return 8;
-	case HLW811X_INTR_ZERO_CROSSING_VOLTAGE:
-		return 9;
-	case HLW811X_INTR_ZERO_CROSSING_CURRENT_A:
-		return 10;
-	case HLW811X_INTR_ZERO_CROSSING_CURRENT_B:
-		return 11;
-	case HLW811X_INTR_OVER_VOLTAGE:
-		return 12;
-	case HLW811X_INTR_UNDER_VOLTAGE:
-		return 13;
-	case HLW811X_INTR_OVER_CURRENT_A:
-		return 14;
-	case HLW811X_INTR_OVER_CURRENT_B:
-		return 15;
-	default:
+	if (ints == 0) {
+		return intr_pin_sel[1]; /* PULSE_OUT_A */
+	} else if ((uint32_t)ints > HLW811X_INTR_IRQ) {
+		return INTR_PIN_SEL_NONE;
+	}
+
+	return intr_pin_sel[count_trailing_zeros((uint32_t)ints)];
+}
+
+/* Each pin takes one flag at most, and one that the pin can be routed to */
+static bool is_intr_pin_valid(hlw811x_intr_t ints)
+{
+	return !((ints - 1) & ints) &&
+		get_regval_from_intr(ints) != INTR_PIN_SEL_NONE;
+}
+
+#define REG_WIDTH_ENTRY(name, bytes)	[HLW811X_REG_##name] = (bytes),
+#define FIELD_FITS(reg, name, lsb, len)	\
+	typedef char reg##_##name##_fits[ \
+		((lsb) + (len) <= HLW811X_REG_##reg##_WIDTH * 8) ? 1 : -1];
+
+/* Register width in bytes by address. 0 for the addresses not defined. */
+static const uint8_t reg_width[] = {
+	HLW811X_REG_WIDTHS(REG_WIDTH_ENTRY)
+};
+
+/* a field running past the width of its register fails to build */
+HLW811X_FIELDS(FIELD_FITS)
+
+static uint8_t get_reg_width(uint32_t addr)
+{
+	if (addr >= sizeof(reg_width)) {
 		return 0;
 	}
+	return reg_width[addr];
+}
+
+static uint16_t *get_shadow(struct hlw811x *self, hlw811x_reg_addr_t addr)
+{
+	if (!self->shadow.enabled) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i < SHADOW_MAX; i++) {
+		if (shadowed_regs[i] == addr) {
+			return &self->shadow.regs[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void update_shadow(struct hlw811x *self, hlw811x_reg_addr_t addr,
+		const uint8_t *data, size_t datalen)
+{
+	uint16_t *shadow = get_shadow(self, addr);
+
+	if (shadow && datalen == sizeof(*shadow)) {
+		*shadow = (uint16_t)convert_16bits_to_int16(data);
+	}
+}
+
+static struct staged_write *get_staged(struct hlw811x *self,
+		hlw811x_reg_addr_t addr)
+{
+	if (!self->txn.active) {
+		return NULL;
+	}
+
+	for (uint8_t i = 0; i < self->txn.count; i++) {
+		if (self->txn.writes[i].addr == addr) {
+			return &self->txn.writes[i];
+		}
+	}
+
+	return NULL;
+}
+
+static hlw811x_error_t stage_write(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, const uint8_t *data, size_t datalen)
+{
+	struct staged_write *staged = get_staged(self, addr);
+
+	if (data == NULL || datalen == 0 || datalen > sizeof(staged->data)) {
+		HLW811X_ERROR("Invalid parameter: %d, %x", datalen, data);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if (staged == NULL) { /* coalesce writes to the same register */
+		if (self->txn.count >= HLW811X_CONFIG_TXN_MAX) {
+			HLW811X_ERROR("Too many staged writes");
+			return HLW811X_BUFFER_TOO_SMALL;
+		}
+		staged = &self->txn.writes[self->txn.count++];
+		staged->addr = addr;
+	}
+
+	memcpy(staged->data, data, datalen);
+	staged->len = (uint8_t)datalen;
+
+	return HLW811X_ERROR_NONE;
 }
 
 static hlw811x_error_t encode_uart(uint8_t *buf, size_t bufsize,
@@ -199,29 +646,72 @@ static hlw811x_error_t decode_uart(uint8_t *buf, size_t bufsize,
 	return HLW811X_ERROR_NONE;
 }
 
-static hlw811x_error_t encode(uint8_t *buf, size_t bufsize,
+/* SPI frames carry the address and data as they are, without the header and
+ * the checksum. */
+static hlw811x_error_t encode_spi(uint8_t *buf, size_t bufsize,
+		const uint8_t *data, size_t datalen, size_t *encoded_len)
+{
+	if (bufsize < datalen) {
+		HLW811X_ERROR("Buffer size is too small");
+		return HLW811X_BUFFER_TOO_SMALL;
+	}
+
+	memcpy(buf, data, datalen);
+	*encoded_len = datalen;
+
+	return HLW811X_ERROR_NONE;
+}
+
+static hlw811x_error_t decode_spi(uint8_t *buf, size_t bufsize,
+		const uint8_t *tx, size_t tx_len,
+		const uint8_t *rx, size_t rx_len, size_t *decoded_len)
+{
+	(void)tx;
+
+	if (tx_len < 1) {
+		HLW811X_ERROR("Invalid tx_len");
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if (rx_len < 1 || bufsize < rx_len) {
+		HLW811X_ERROR("Invalid rx_len");
+		return HLW811X_INVALID_PARAM;
+	}
+
+	memcpy(buf, rx, rx_len);
+	*decoded_len = rx_len;
+
+	return HLW811X_ERROR_NONE;
+}
+
+static hlw811x_error_t encode(struct hlw811x *self,
+		uint8_t *buf, size_t bufsize,
 		const uint8_t *data, size_t datalen, size_t *len)
 {
-	encoder_t encoder = encode_uart;
+	encoder_t encoder;
 
-	if (m.iface == HLW811X_UART) {
+	if (self->iface == HLW811X_UART) {
+		encoder = encode_uart;
+	} else if (self->iface == HLW811X_SPI) {
+		encoder = encode_spi;
 	} else {
 		HLW811X_ERROR("Not implemented");
 		return HLW811X_NOT_IMPLEMENTED;
 	}
 
 	return (*encoder)(buf, bufsize, data, datalen, len);
-
-	return HLW811X_ERROR_NONE;
 }
 
-static hlw811x_error_t decode(uint8_t *buf, size_t bufsize,
-		const uint8_t *tx, size_t tx_len,
+static hlw811x_error_t decode(struct hlw811x *self,
+		uint8_t *buf, size_t bufsize, const uint8_t *tx, size_t tx_len,
 		const uint8_t *rx, size_t rx_len, size_t *len)
 {
-	decoder_t decoder = decode_uart;
+	decoder_t decoder;
 
-	if (m.iface == HLW811X_UART) {
+	if (self->iface == HLW811X_UART) {
+		decoder = decode_uart;
+	} else if (self->iface == HLW811X_SPI) {
+		decoder = decode_spi;
 	} else {
 		HLW811X_ERROR("Not implemented");
 		return HLW811X_NOT_IMPLEMENTED;
@@ -230,14 +720,14 @@ static hlw811x_error_t decode(uint8_t *buf, size_t bufsize,
 	return (*decoder)(buf, bufsize, tx, tx_len, rx, rx_len, len);
 }
 
-static hlw811x_error_t encode_frame(hlw811x_reg_addr_t addr,
-		uint8_t *txbuf, size_t txbuf_len,
+static hlw811x_error_t encode_frame(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, uint8_t *txbuf, size_t txbuf_len,
 		const uint8_t *data, size_t datalen,
 		size_t *frame_len)
 {
-	uint8_t payload[datalen + 1];
+	uint8_t payload[1/*addr*/ + FRAME_WRITE_DATA_MAX];
 
-	if (datalen > 2 || (data == NULL && datalen != 0)) {
+	if (datalen > FRAME_WRITE_DATA_MAX || (data == NULL && datalen != 0)) {
 		HLW811X_ERROR("Invalid parameter: %d, %x", datalen, data);
 		return HLW811X_INVALID_PARAM;
 	}
@@ -247,17 +737,17 @@ static hlw811x_error_t encode_frame(hlw811x_reg_addr_t addr,
 		payload[i + 1] = data[i];
 	}
 
-	return encode(txbuf, txbuf_len, payload, datalen+1, frame_len);
+	return encode(self, txbuf, txbuf_len, payload, datalen+1, frame_len);
 }
 
-static hlw811x_error_t decode_frame(uint8_t *buf, size_t bufsize,
-		const uint8_t *tx, size_t tx_len,
+static hlw811x_error_t decode_frame(struct hlw811x *self,
+		uint8_t *buf, size_t bufsize, const uint8_t *tx, size_t tx_len,
 		const uint8_t *rx, size_t rx_len)
 {
 	size_t len;
 	hlw811x_error_t err;
 
-	if ((err = decode(buf, bufsize, tx, tx_len, rx, rx_len, &len))
+	if ((err = decode(self, buf, bufsize, tx, tx_len, rx, rx_len, &len))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	} else if (len != bufsize) {
@@ -268,32 +758,34 @@ static hlw811x_error_t decode_frame(uint8_t *buf, size_t bufsize,
 	return HLW811X_ERROR_NONE;
 }
 
-static void get_calc_param_rms(hlw811x_channel_t channel,
+static void get_calc_param_rms(struct hlw811x *self, hlw811x_channel_t channel,
 		struct calc_param *param)
 {
 	if (channel == HLW811X_CHANNEL_A) {
 		*param = (struct calc_param) {
 			.addr = HLW811X_REG_RMS_IA,
-			.coeff = m.coeff.rms.A,
-			.ratio = convert_float_to_uint16_centi(m.ratio.K1_A),
-			.pga = m.pga.A,
-			.resol = 1ll << 23,
+			.coeff = self->coeff.rms.A,
+			.ratio = convert_float_to_uint16_centi(
+					self->ratio.K1_A),
+			.pga = self->pga.A,
+			.resol = 23,
 		};
 	} else if (channel == HLW811X_CHANNEL_B) {
 		*param = (struct calc_param) {
 			.addr = HLW811X_REG_RMS_IB,
-			.coeff = m.coeff.rms.B,
-			.ratio = convert_float_to_uint16_centi(m.ratio.K1_B),
-			.pga = m.pga.B,
-			.resol = 1ll << 23,
+			.coeff = self->coeff.rms.B,
+			.ratio = convert_float_to_uint16_centi(
+					self->ratio.K1_B),
+			.pga = self->pga.B,
+			.resol = 23,
 		};
 	} else if (channel == HLW811X_CHANNEL_U) {
 		*param = (struct calc_param) {
 			.addr = HLW811X_REG_RMS_U,
-			.coeff = m.coeff.rms.U,
-			.ratio = convert_float_to_uint16_centi(m.ratio.K2),
-			.pga = m.pga.U,
-			.resol = 1ll << 22,
+			.coeff = self->coeff.rms.U,
+			.ratio = convert_float_to_uint16_centi(self->ratio.K2),
+			.pga = self->pga.U,
+			.resol = 22,
 			.mult = 10,
 		};
 	} else {
@@ -301,83 +793,176 @@ static void get_calc_param_rms(hlw811x_channel_t channel,
 	}
 }
 
-static void get_calc_param_power(hlw811x_channel_t channel,
-		struct calc_param *param)
+static void get_calc_param_power(struct hlw811x *self,
+		hlw811x_channel_t channel, struct calc_param *param)
 {
 	if (channel == HLW811X_CHANNEL_A) {
 		*param = (struct calc_param) {
 			.addr = HLW811X_REG_POWER_PA,
-			.coeff = m.coeff.power.A,
-			.ratio = convert_float_to_uint16_centi(m.ratio.K1_A),
-			.pga = m.pga.A,
+			.coeff = self->coeff.power.A,
+			.ratio = convert_float_to_uint16_centi(
+					self->ratio.K1_A),
+			.pga = self->pga.A,
 		};
 	} else if (channel == HLW811X_CHANNEL_B) {
 		*param = (struct calc_param) {
 			.addr = HLW811X_REG_POWER_PB,
-			.coeff = m.coeff.power.B,
-			.ratio = convert_float_to_uint16_centi(m.ratio.K1_B),
-			.pga = m.pga.B,
+			.coeff = self->coeff.power.B,
+			.ratio = convert_float_to_uint16_centi(
+					self->ratio.K1_B),
+			.pga = self->pga.B,
 		};
 	} else if (channel == HLW811X_CHANNEL_U) {
 		*param = (struct calc_param) {
 			.addr = HLW811X_REG_POWER_S,
-			.coeff = m.coeff.power.S,
-			.ratio = convert_float_to_uint16_centi(m.ratio.K2),
-			.pga = m.pga.U,
+			.coeff = self->coeff.power.S,
+			.ratio = convert_float_to_uint16_centi(self->ratio.K2),
+			.pga = self->pga.U,
 		};
 	} else {
 		HLW811X_ERROR("Invalid channel: %d", channel);
 	}
 
-	param->resol = 1ll << 31;
+	param->resol = 31;
 }
 
-static void get_calc_param_energy(hlw811x_channel_t channel,
-		struct calc_param *param)
+static void get_calc_param_energy(struct hlw811x *self,
+		hlw811x_channel_t channel, struct calc_param *param)
 {
 	if (channel == HLW811X_CHANNEL_A) {
 		*param = (struct calc_param) {
 			.addr = HLW811X_REG_ENERGY_PA,
-			.coeff = m.coeff.energy.A,
-			.ratio = convert_float_to_uint16_centi(m.ratio.K1_A),
-			.pga = m.pga.A,
+			.coeff = self->coeff.energy.A,
+			.ratio = convert_float_to_uint16_centi(
+					self->ratio.K1_A),
+			.pga = self->pga.A,
 		};
 	} else if (channel == HLW811X_CHANNEL_B) {
 		*param = (struct calc_param) {
 			.addr = HLW811X_REG_ENERGY_PB,
-			.coeff = m.coeff.energy.B,
-			.ratio = convert_float_to_uint16_centi(m.ratio.K1_B),
-			.pga = m.pga.B,
+			.coeff = self->coeff.energy.B,
+			.ratio = convert_float_to_uint16_centi(
+					self->ratio.K1_B),
+			.pga = self->pga.B,
 		};
 	} else {
 		HLW811X_ERROR("Invalid channel: %d", channel);
 	}
 
-	param->resol = 1ll << 29;
+	param->resol = 29;
 }
 
-static void get_calc_param(hlw811x_channel_t channel,
+static void get_calc_param(struct hlw811x *self, hlw811x_channel_t channel,
 		calc_type_t type, struct calc_param *param)
 {
 	memset(param, 0, sizeof(*param));
 
 	if (type == CALC_TYPE_RMS) {
-		get_calc_param_rms(channel, param);
+		get_calc_param_rms(self, channel, param);
 	} else if (type == CALC_TYPE_POWER) {
-		get_calc_param_power(channel, param);
+		get_calc_param_power(self, channel, param);
 	} else if (type == CALC_TYPE_ENERGY) {
-		get_calc_param_energy(channel, param);
+		get_calc_param_energy(self, channel, param);
 	} else {
 		HLW811X_ERROR("Invalid type: %d", type);
 	}
 }
 
-static hlw811x_error_t send_frame(const uint8_t *data, size_t datalen)
+static void select_chip(struct hlw811x *self, bool selected)
+{
+	if (self->io.ll_select != NULL) {
+		(*self->io.ll_select)(selected, self->io.ctx);
+	}
+}
+
+static uint32_t trace_begin(const struct hlw811x *self)
+{
+	if (self->trace.clock == NULL) {
+		return 0;
+	}
+
+	return (*self->trace.clock)(self->trace.clock_ctx);
+}
+
+#if HLW811X_STATS
+static uint8_t get_latency_bucket(uint32_t us)
+{
+	uint32_t bound = HLW811X_STATS_BUCKET_US;
+	uint8_t i;
+
+	for (i = 0; i < HLW811X_STATS_BUCKETS - 1; i++) {
+		if (us < bound) {
+			break;
+		}
+		bound <<= 1;
+	}
+
+	return i;
+}
+
+static void count_op(struct hlw811x_op_stats *op,
+		size_t bytes, bool failed, uint32_t us)
+{
+	if (op->calls == 0 || us < op->min_us) {
+		op->min_us = us;
+	}
+	if (us > op->max_us) {
+		op->max_us = us;
+	}
+
+	op->calls++;
+	op->errors += failed;
+	op->bytes += (uint32_t)bytes;
+	op->total_us += us;
+	op->histogram[get_latency_bucket(us)]++;
+}
+
+static void count_reg(struct hlw811x_reg_stats *reg,
+		size_t bytes, bool failed, uint32_t us)
+{
+	if (us > reg->max_us) {
+		reg->max_us = us;
+	}
+
+	reg->calls++;
+	reg->errors += failed;
+	reg->bytes += (uint32_t)bytes;
+	reg->total_us += us;
+}
+#endif
+
+static void trace_end(struct hlw811x *self, hlw811x_op_t op,
+		hlw811x_reg_addr_t addr, size_t bytes, hlw811x_error_t err,
+		uint32_t t0)
+{
+	const uint32_t us = self->trace.clock == NULL ? 0 :
+		(*self->trace.clock)(self->trace.clock_ctx) - t0;
+
+#if HLW811X_STATS
+	const bool failed = err != HLW811X_ERROR_NONE;
+
+	count_op(&self->trace.stats.ops[op], bytes, failed, us);
+	if (addr < HLW811X_STATS_REG_MAX) {
+		count_reg(&self->trace.stats.regs[addr], bytes, failed, us);
+	}
+#else
+	(void)op;
+	(void)addr;
+	(void)bytes;
+	(void)err;
+	(void)us;
+#endif
+
+	HLW811X_TRACE(op, addr, bytes, err, us);
+}
+
+static hlw811x_error_t send_frame(struct hlw811x *self,
+		const uint8_t *data, size_t datalen)
 {
 	int err;
 
-	if ((err = hlw811x_ll_write(data, datalen)) < 0) {
-		HLW811X_ERROR("hlw811x_ll_write() failed: %x", err);
+	if ((err = (*self->io.ll_write)(data, datalen, self->io.ctx)) < 0) {
+		HLW811X_ERROR("ll_write() failed: %x", err);
 		return HLW811X_IO_ERROR;
 	}
 
@@ -389,1107 +974,4338 @@ static hlw811x_error_t send_frame(const uint8_t *data, size_t datalen)
 	return HLW811X_ERROR_NONE;
 }
 
-static hlw811x_error_t write_cmd(hlw811x_reg_addr_t addr,
+static hlw811x_error_t write_cmd(struct hlw811x *self, hlw811x_reg_addr_t addr,
 		const uint8_t *data, size_t datalen)
 {
-	uint8_t frame[datalen + 1/*addr*/ + 2/*header+chksum*/];
+	uint8_t frame[FRAME_WRITE_MAX];
 	size_t frame_len;
 	hlw811x_error_t err;
+	uint32_t t0;
 
-	if ((err = encode_frame(addr | 0x80u, frame, sizeof(frame),
+	if ((err = encode_frame(self, addr | 0x80u, frame, sizeof(frame),
 				data, datalen, &frame_len))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	return send_frame(frame, frame_len);
+	t0 = trace_begin(self);
+	select_chip(self, true);
+	err = send_frame(self, frame, frame_len);
+	select_chip(self, false);
+
+	trace_end(self, addr == HLW811X_REG_COMMAND ?
+			HLW811X_OP_COMMAND : HLW811X_OP_WRITE, addr,
+			err == HLW811X_ERROR_NONE ? frame_len : 0, err, t0);
+
+	return err;
 }
 
-static hlw811x_error_t reset_chip(void)
+static hlw811x_error_t reset_chip(struct hlw811x *self)
 {
 	const uint8_t cmd = CMD_RESET_CHIP;
-	return write_cmd(HLW811X_REG_COMMAND, &cmd, 1);
+	return write_cmd(self, HLW811X_REG_COMMAND, &cmd, 1);
 }
 
-static hlw811x_error_t enable_write(void)
+static hlw811x_error_t enable_write(struct hlw811x *self)
 {
 	const uint8_t cmd = CMD_ENABLE_WRITE;
-	return write_cmd(HLW811X_REG_COMMAND, &cmd, 1);
+	return write_cmd(self, HLW811X_REG_COMMAND, &cmd, 1);
 }
 
-static hlw811x_error_t disable_write(void)
+static hlw811x_error_t disable_write(struct hlw811x *self)
 {
 	const uint8_t cmd = CMD_DISABLE_WRITE;
-	return write_cmd(HLW811X_REG_COMMAND, &cmd, 1);
+	return write_cmd(self, HLW811X_REG_COMMAND, &cmd, 1);
 }
 
-static hlw811x_error_t write_reg(hlw811x_reg_addr_t addr,
+static hlw811x_error_t write_reg(struct hlw811x *self, hlw811x_reg_addr_t addr,
 		const uint8_t *data, size_t datalen)
 {
 	hlw811x_error_t err;
 
-	if ((err = enable_write()) != HLW811X_ERROR_NONE) {
+	if (self->txn.active) {
+		return stage_write(self, addr, data, datalen);
+	}
+
+	if ((err = enable_write(self)) != HLW811X_ERROR_NONE) {
 		HLW811X_ERROR("enable_write() failed");
 		return err;
 	}
 
-	if ((err = write_cmd(addr, data, datalen)) != HLW811X_ERROR_NONE) {
-		disable_write();
+	if ((err = write_cmd(self, addr, data, datalen))
+			!= HLW811X_ERROR_NONE) {
+		disable_write(self);
 		HLW811X_ERROR("write_cmd() failed");
 		return err;
 	}
 
-	if ((err = disable_write()) != HLW811X_ERROR_NONE) {
+	/* the chip has taken the write once the frame went out, regardless of
+	 * the result of disable_write(). */
+	update_shadow(self, addr, data, datalen);
+
+	if ((err = disable_write(self)) != HLW811X_ERROR_NONE) {
 		HLW811X_ERROR("disable_write() failed");
 	}
 
 	return err;
 }
 
-static hlw811x_error_t write_reg16(hlw811x_reg_addr_t addr, const uint16_t val)
+static hlw811x_error_t write_regval(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, const uint32_t val)
+{
+	uint8_t tmp[HLW811X_REG_WIDTH_MAX];
+	const uint8_t width = get_reg_width(addr);
+
+	if (width == 0) {
+		HLW811X_ERROR("Undefined register: %x", addr);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	for (uint8_t i = 0; i < width; i++) {
+		tmp[i] = (uint8_t)(val >> ((width - 1 - i) * 8));
+	}
+
+	return write_reg(self, addr, tmp, width);
+}
+
+static hlw811x_error_t receive_frame(struct hlw811x *self,
+		uint8_t *buf, size_t bufsize, size_t *received)
 {
-	uint8_t tmp[2] = { (uint8_t)(val >> 8), (uint8_t)val };
-	return write_reg(addr, tmp, sizeof(tmp));
+	int bytes_received;
+
+	if ((bytes_received = (*self->io.ll_read)(buf, bufsize,
+			self->io.ctx)) < 0) {
+		HLW811X_ERROR("ll_read() failed");
+		return HLW811X_IO_ERROR;
+	} else if (bytes_received == 0) {
+		return HLW811X_NO_RESPONSE;
+	}
+
+	*received = (size_t)bytes_received;
+
+	return HLW811X_ERROR_NONE;
 }
 
-static hlw811x_error_t read_reg(hlw811x_reg_addr_t addr,
-		uint8_t *buf, size_t bytes_to_read)
+static hlw811x_error_t read_reg_once(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, uint8_t *buf, size_t bytes_to_read)
 {
 	hlw811x_error_t err;
-	int bytes_received;
-	uint8_t rx[bytes_to_read + 1];
-	uint8_t tx[3];
+	uint8_t rx[FRAME_READ_RESP_MAX];
+	uint8_t tx[FRAME_READ_REQ_MAX];
 	size_t encoded_len;
 	size_t tx_len;
+	size_t rx_len = bytes_to_read;
+	size_t received = 0;
+	uint32_t t0;
+
+	if (bytes_to_read == 0 || bytes_to_read > HLW811X_REG_WIDTH_MAX) {
+		HLW811X_ERROR("Invalid length: %d", bytes_to_read);
+		return HLW811X_INVALID_PARAM;
+	}
 
-	if ((err = encode_frame(addr, tx, sizeof(tx), 0, 0, &encoded_len))
+	if ((err = encode_frame(self, addr, tx, sizeof(tx), 0, 0, &encoded_len))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
 	tx_len = encoded_len;
-	if (m.iface == HLW811X_UART) {
+	if (self->iface == HLW811X_UART) {
 		tx_len -= 1; /* do not send chksum */
+		rx_len += 1; /* chksum */
 	}
 
-	if ((err = send_frame(tx, tx_len)) != HLW811X_ERROR_NONE) {
-		return err;
+	/* The address and the data must be clocked within a single chip
+	 * select on SPI. */
+	t0 = trace_begin(self);
+	select_chip(self, true);
+	if ((err = send_frame(self, tx, tx_len)) == HLW811X_ERROR_NONE) {
+		err = receive_frame(self, rx, rx_len, &received);
+	} else {
+		tx_len = 0;
 	}
-
-	if ((bytes_received = hlw811x_ll_read(rx, sizeof(rx))) < 0) {
-		HLW811X_ERROR("hlw811x_ll_read() failed");
-		return HLW811X_IO_ERROR;
-	} else if (bytes_received == 0) {
-		return HLW811X_NO_RESPONSE;
+	select_chip(self, false);
+
+	if (err == HLW811X_ERROR_NONE && received < rx_len) {
+		/* e.g. the rest still on the wire when ll_read() timed out */
+		err = HLW811X_INCORRECT_RESPONSE;
+	} else if (err == HLW811X_ERROR_NONE) {
+		err = decode_frame(self, buf, bytes_to_read, tx, encoded_len,
+				rx, received);
 	}
 
-	err = decode_frame(buf, bytes_to_read, tx, encoded_len,
-			rx, (size_t)bytes_received);
+	trace_end(self, HLW811X_OP_READ, addr, tx_len + received, err, t0);
+
 	return err;
 }
 
-static hlw811x_error_t read_reg16(hlw811x_reg_addr_t addr, uint16_t *reg)
+static bool is_retryable(hlw811x_error_t err)
 {
-	uint8_t buf[2];
-	hlw811x_error_t err;
+	return err == HLW811X_CHECKSUM_MISMATCH ||
+		err == HLW811X_NO_RESPONSE ||
+		err == HLW811X_INCORRECT_RESPONSE;
+}
 
-	if ((err = read_reg(addr, buf, sizeof(buf))) != HLW811X_ERROR_NONE) {
-		return err;
+/* Drop whatever is left in the receive path, e.g. a late response of the
+ * failed attempt, so that it is not taken for the next response. SPI has
+ * nothing to drain as the chip select ends the frame. */
+static void resync(struct hlw811x *self)
+{
+	uint8_t scratch[FRAME_READ_RESP_MAX];
+
+	if (self->iface != HLW811X_UART) {
+		return;
 	}
 
-	*reg = (uint16_t)convert_16bits_to_int16(buf);
+	for (int i = 0; i < RESYNC_READS_MAX; i++) {
+		if ((*self->io.ll_read)(scratch, sizeof(scratch),
+				self->io.ctx) <= 0) {
+			break;
+		}
+	}
 
-	return err;
+	self->transport.stats.resyncs++;
 }
 
-static hlw811x_error_t select_channel(hlw811x_channel_t channel)
+static void backoff(struct hlw811x *self, uint8_t attempt)
 {
-	uint8_t cmd;
+	const struct hlw811x_transport_policy *policy =
+		&self->transport.policy;
+	const uint8_t shift = attempt < BACKOFF_SHIFT_MAX ?
+		attempt : BACKOFF_SHIFT_MAX;
 
-	switch (channel) {
-	case HLW811X_CHANNEL_A:
-		cmd = CMD_SET_CHANNEL_A;
-		break;
-	case HLW811X_CHANNEL_B:
-		cmd = CMD_SET_CHANNEL_B;
-		break;
-	default:
-		HLW811X_ERROR("Invalid channel: %d", channel);
-		return HLW811X_INVALID_PARAM;
+	if (policy->delay_ms == NULL || policy->backoff_ms == 0) {
+		return;
 	}
 
-	return write_cmd(HLW811X_REG_COMMAND, &cmd, 1);
+	(*policy->delay_ms)((uint32_t)policy->backoff_ms << shift,
+			self->io.ctx);
 }
 
-static hlw811x_error_t read_current_channel(hlw811x_channel_t *channel)
+static hlw811x_error_t read_reg(struct hlw811x *self, hlw811x_reg_addr_t addr,
+		uint8_t *buf, size_t bytes_to_read)
 {
+	struct hlw811x_transport_stats *stats = &self->transport.stats;
+	const uint8_t retries = self->transport.policy.retries;
 	hlw811x_error_t err;
-	uint16_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_STATUS, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
-	}
+	for (uint8_t attempt = 0; ; attempt++) {
+		err = read_reg_once(self, addr, buf, bytes_to_read);
 
-	*channel = (hlw811x_channel_t)(((reg >> 21) & 0x01) + 1);
+		if (err == HLW811X_CHECKSUM_MISMATCH) {
+			stats->checksum_errors++;
+		} else if (err == HLW811X_NO_RESPONSE) {
+			stats->timeouts++;
+		} else if (err == HLW811X_INCORRECT_RESPONSE) {
+			stats->short_reads++;
+		}
 
-	return HLW811X_ERROR_NONE;
-}
+		if (!is_retryable(err)) {
+			break;
+		} else if (attempt >= retries) {
+			if (retries > 0) {
+				stats->failures++;
+			}
+			break;
+		}
 
-hlw811x_error_t hlw811x_write_reg(hlw811x_reg_addr_t addr,
-		const uint8_t *data, size_t datalen)
-{
-	return write_reg(addr, data, datalen);
+		resync(self);
+		backoff(self, attempt);
+		stats->retries++;
+	}
+
+	return err;
 }
 
-hlw811x_error_t hlw811x_read_reg(hlw811x_reg_addr_t addr,
-		uint8_t *buf, size_t bufsize)
+static uint32_t decode_regval(const uint8_t *buf, uint8_t width)
 {
-	return read_reg(addr, buf, bufsize);
+	switch (width) {
+	case 1:
+		return buf[0];
+	case 2:
+		return (uint16_t)convert_16bits_to_int16(buf);
+	case 3:
+		return (uint32_t)convert_24bits_to_int32(buf);
+	default:
+		return (uint32_t)convert_32bits_to_int32(buf);
+	}
 }
 
-hlw811x_error_t hlw811x_set_active_power_calc_mode(hlw811x_active_power_mode_t
-		mode)
+/* Read a register in the width given by the register table. The staged
+ * writes and the shadow take precedence over the chip. */
+static hlw811x_error_t read_regval(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, uint32_t *val)
 {
+	uint8_t buf[HLW811X_REG_WIDTH_MAX];
 	hlw811x_error_t err;
-	uint16_t reg;
+	const uint8_t width = get_reg_width(addr);
+	const struct staged_write *staged = get_staged(self, addr);
+	const uint16_t *shadow = get_shadow(self, addr);
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	if (width == 0) {
+		HLW811X_ERROR("Undefined register: %x", addr);
+		return HLW811X_INVALID_PARAM;
 	}
 
-	reg &= ~(3 << 10); /* clear Pmode bit */
-	reg |= (mode << 10);
-
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
-}
-
-hlw811x_error_t hlw811x_get_active_power_calc_mode(hlw811x_active_power_mode_t
-		*mode)
-{
-	hlw811x_error_t err;
-	uint16_t reg;
+	if (staged && staged->len == width) {
+		*val = decode_regval(staged->data, width);
+		return HLW811X_ERROR_NONE;
+	} else if (shadow) {
+		*val = *shadow;
+		return HLW811X_ERROR_NONE;
+	}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
+	if ((err = read_reg(self, addr, buf, width)) != HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	*mode = (hlw811x_active_power_mode_t)((reg >> 10) & 0x03);
+	*val = decode_regval(buf, width);
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_set_rms_calc_mode(hlw811x_rms_mode_t mode)
+static hlw811x_error_t read_reg16(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, uint16_t *reg)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t val;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	if (get_reg_width(addr) != sizeof(*reg)) {
+		HLW811X_ERROR("Not a 16-bit register: %x", addr);
+		return HLW811X_INVALID_PARAM;
 	}
 
-	reg &= ~(3 << 9); /* clear DC_MODE bit */
-	reg |= (mode << 9);
+	if ((err = read_regval(self, addr, &val)) == HLW811X_ERROR_NONE) {
+		*reg = (uint16_t)val;
+	}
+
+	return err;
+}
+
+static uint32_t get_field(uint32_t reg, hlw811x_field_t field)
+{
+	return (reg & HLW811X_FIELD_MASK(field)) >> HLW811X_FIELD_LSB(field);
+}
 
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+static uint32_t set_field(uint32_t reg, hlw811x_field_t field, uint32_t val)
+{
+	const uint32_t mask = HLW811X_FIELD_MASK(field);
+	return (reg & ~mask) | ((val << HLW811X_FIELD_LSB(field)) & mask);
 }
 
-hlw811x_error_t hlw811x_get_rms_calc_mode(hlw811x_rms_mode_t *mode)
+static hlw811x_error_t read_field(struct hlw811x *self,
+		hlw811x_field_t field, uint32_t *val)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
+	if ((err = read_regval(self, (hlw811x_reg_addr_t)
+			HLW811X_FIELD_REG(field), &reg))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	*mode = (hlw811x_rms_mode_t)((reg >> 9) & 0x03);
+	*val = get_field(reg, field);
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_enable_pulse(hlw811x_channel_t channel)
+/* Read-modify-write of a single field. Use read_regval() and set_field()
+ * directly to change several fields of a register in one write. */
+static hlw811x_error_t update_field(struct hlw811x *self,
+		hlw811x_field_t field, uint32_t val)
 {
+	const hlw811x_reg_addr_t addr =
+		(hlw811x_reg_addr_t)HLW811X_FIELD_REG(field);
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
+	if ((err = read_regval(self, addr, &reg)) != HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	if (channel & HLW811X_CHANNEL_A) {
-		reg |= 1 << 0; /* PARUN */
-	}
-	if (channel & HLW811X_CHANNEL_B) {
-		reg |= 1 << 1; /* PBRUN */
-	}
-
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+	return write_regval(self, addr, set_field(reg, field, val));
 }
 
-hlw811x_error_t hlw811x_disable_pulse(hlw811x_channel_t channel)
+static hlw811x_error_t select_channel(struct hlw811x *self,
+		hlw811x_channel_t channel)
 {
+	struct chan_mux *mux = &self->mux;
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint8_t cmd;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	switch (channel) {
+	case HLW811X_CHANNEL_A:
+		cmd = CMD_SET_CHANNEL_A;
+		break;
+	case HLW811X_CHANNEL_B:
+		cmd = CMD_SET_CHANNEL_B;
+		break;
+	default:
+		HLW811X_ERROR("Invalid channel: %d", channel);
+		return HLW811X_INVALID_PARAM;
 	}
 
-	if (channel & HLW811X_CHANNEL_A) {
-		reg &= ~(1 << 0); /* PARUN */
+	if (mux->enabled && mux->selected == channel) {
+		mux->stats.skipped++;
+		return HLW811X_ERROR_NONE;
 	}
-	if (channel & HLW811X_CHANNEL_B) {
-		reg &= ~(1 << 1); /* PBRUN */
+
+	if ((err = write_cmd(self, HLW811X_REG_COMMAND, &cmd, 1))
+			!= HLW811X_ERROR_NONE || !mux->enabled) {
+		return err;
 	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+	mux->selected = channel;
+	mux->switched_at = (*mux->clock)(mux->clock_ctx);
+	mux->settling = mux->settle_us != 0;
+	mux->stats.switches++;
+
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_set_data_update_frequency(hlw811x_data_update_freq_t
-		freq)
+static hlw811x_error_t read_current_channel(struct hlw811x *self,
+		hlw811x_channel_t *channel)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t sel;
+
+	if (self->mux.enabled && self->mux.selected != 0) {
+		*channel = self->mux.selected;
+		return HLW811X_ERROR_NONE;
+	}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
+	if ((err = read_field(self, HLW811X_METER_STATUS_CHA_SEL, &sel))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg &= ~(3 << 8); /* clear DUP bit */
-	reg |= (freq << 8);
+	*channel = (hlw811x_channel_t)(sel + 1);
+
+	if (self->mux.enabled) {
+		self->mux.selected = *channel;
+	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_get_data_update_frequency(hlw811x_data_update_freq_t
-		*freq)
+static bool is_channel_settling(struct chan_mux *mux)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
-
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	if (mux->settling && (*mux->clock)(mux->clock_ctx) - mux->switched_at
+			>= mux->settle_us) {
+		mux->settling = false;
 	}
 
-	*freq = (hlw811x_data_update_freq_t)((reg >> 8) & 0x03);
+	return mux->settling;
+}
+
+hlw811x_error_t hlw811x_dev_write_reg(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, const uint8_t *data, size_t datalen)
+{
+	return write_reg(self, addr, data, datalen);
+}
 
-	return HLW811X_ERROR_NONE;
+hlw811x_error_t hlw811x_dev_read_reg(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, uint8_t *buf, size_t bufsize)
+{
+	return read_reg(self, addr, buf, bufsize);
 }
 
-hlw811x_error_t hlw811x_set_channel_b_mode(hlw811x_channel_b_mode_t mode)
+hlw811x_error_t hlw811x_dev_read_regs(struct hlw811x *self,
+		hlw811x_reg_addr_t start, hlw811x_reg_addr_t end,
+		uint8_t *buf, size_t bufsize, size_t *len)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	size_t n = 0;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	if (start > end) {
+		HLW811X_ERROR("Invalid range: %x-%x", start, end);
+		return HLW811X_INVALID_PARAM;
 	}
 
-	reg &= ~(1 << 7); /* clear CHS_IB bit */
-	reg |= (mode << 7);
+	/* size it up first so that nothing is read into a short buffer */
+	for (uint32_t addr = start; addr <= end; addr++) {
+		n += get_reg_width(addr);
+	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
-}
+	if (n > bufsize) {
+		HLW811X_ERROR("Buffer size is too small: %d < %d", bufsize, n);
+		return HLW811X_BUFFER_TOO_SMALL;
+	}
 
-hlw811x_error_t hlw811x_get_channel_b_mode(hlw811x_channel_b_mode_t *mode)
-{
-	hlw811x_error_t err;
-	uint16_t reg;
+	n = 0;
+	for (uint32_t addr = start; addr <= end; addr++) {
+		const uint8_t width = get_reg_width(addr);
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+		if (width == 0) {
+			continue;
+		}
+
+		if ((err = read_reg(self, (hlw811x_reg_addr_t)addr,
+				&buf[n], width)) != HLW811X_ERROR_NONE) {
+			return err;
+		}
+
+		n += width;
 	}
 
-	*mode = (hlw811x_channel_b_mode_t)((reg >> 7) & 0x01);
+	if (len != NULL) {
+		*len = n;
+	}
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_set_zerocrossing_mode(hlw811x_zerocrossing_mode_t mode)
+static struct async_read *get_async(struct hlw811x *self, uint8_t nth)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	return &self->async.reads[(self->async.head + nth)
+		% HLW811X_ASYNC_QUEUE_LEN];
+}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+static uint8_t get_pipeline_depth(const struct hlw811x *self)
+{
+	/* an SPI read keeps the chip selected until the response is clocked
+	 * out, so another header cannot go ahead of it. */
+	if (self->iface == HLW811X_SPI) {
+		return 1;
 	}
 
-	reg &= ~(3 << 7); /* clear ZXDx bits */
-	reg |= (mode << 7);
-
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return HLW811X_ASYNC_PIPELINE_DEPTH;
 }
 
-hlw811x_error_t hlw811x_get_zerocrossing_mode(hlw811x_zerocrossing_mode_t
-		*mode)
+static hlw811x_error_t send_async(struct hlw811x *self,
+		const struct async_read *req)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	size_t tx_len = req->tx_len;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	if (self->iface == HLW811X_UART) {
+		tx_len -= 1; /* do not send chksum */
 	}
 
-	*mode = (hlw811x_zerocrossing_mode_t)((reg >> 7) & 0x03);
+	select_chip(self, true);
 
-	return HLW811X_ERROR_NONE;
+	if ((err = send_frame(self, req->tx, tx_len)) != HLW811X_ERROR_NONE) {
+		select_chip(self, false);
+	}
+
+	return err;
 }
 
-hlw811x_error_t hlw811x_enable_waveform(void)
+static void pop_async(struct hlw811x *self)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	self->async.head = (uint8_t)((self->async.head + 1)
+			% HLW811X_ASYNC_QUEUE_LEN);
+	self->async.count--;
+	self->async.stats.depth = self->async.count;
+}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
-	}
+/* Sends the headers of the queued reads as long as the pipeline has room.
+ * A read whose header fails to go out is completed with the error. */
+static void issue_async(struct hlw811x *self)
+{
+	struct async_queue *q = &self->async;
+
+	while (q->inflight < q->count &&
+			q->inflight < get_pipeline_depth(self)) {
+		struct async_read *req = get_async(self, q->inflight);
+		hlw811x_error_t err;
 
-	reg |= 1 << 5; /* WaveEN */
+		if ((err = send_async(self, req)) == HLW811X_ERROR_NONE) {
+			q->inflight++;
+			continue;
+		}
+
+		/* only reads never sent are left behind the in-flight ones, so
+		 * dropping the failed one keeps the response order intact. */
+		const uint8_t zero[HLW811X_REG_WIDTH_MAX] = { 0, };
+		const struct async_read failed = *req;
+		for (uint8_t i = q->inflight; i + 1 < q->count; i++) {
+			*get_async(self, i) =
+				*get_async(self, (uint8_t)(i + 1));
+		}
+		q->count--;
+		q->stats.depth = q->count;
+		q->stats.completed++;
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+		(*failed.cb)(err, failed.addr, zero, failed.len,
+				failed.cb_ctx);
+	}
 }
 
-hlw811x_error_t hlw811x_disable_waveform(void)
+hlw811x_error_t hlw811x_dev_submit_read(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, size_t len,
+		hlw811x_read_cb_t cb, void *cb_ctx)
 {
+	struct async_queue *q = &self->async;
+	struct async_read *req;
 	hlw811x_error_t err;
-	uint16_t reg;
+	size_t encoded_len;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
+	if (cb == NULL || len < 1 || len > HLW811X_REG_WIDTH_MAX) {
+		HLW811X_ERROR("Invalid parameter: %d", len);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if (q->count >= HLW811X_ASYNC_QUEUE_LEN) {
+		q->stats.stalls++;
+		return HLW811X_BUSY;
+	}
+
+	req = get_async(self, q->count);
+
+	if ((err = encode_frame(self, addr, req->tx, sizeof(req->tx), 0, 0,
+				&encoded_len)) != HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg &= ~(1 << 5); /* WaveEN */
+	req->cb = cb;
+	req->cb_ctx = cb_ctx;
+	req->addr = addr;
+	req->tx_len = (uint8_t)encoded_len;
+	req->len = (uint8_t)len;
+	req->rx_len = (uint8_t)len;
+	req->received = 0;
+	if (self->iface == HLW811X_UART) {
+		req->rx_len += 1; /* chksum */
+	}
+
+	if (q->inflight == q->count && q->inflight < get_pipeline_depth(self)) {
+		/* queue it only after the header went out, so that on_rx()
+		 * never completes a read the chip has not seen. */
+		if ((err = send_async(self, req)) != HLW811X_ERROR_NONE) {
+			return err;
+		}
+		q->inflight++;
+	} else {
+		q->stats.deferred++;
+	}
+
+	q->count++;
+	q->stats.submitted++;
+	q->stats.depth = q->count;
+	if (q->count > q->stats.max_depth) {
+		q->stats.max_depth = q->count;
+	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_enable_zerocrossing(void)
+hlw811x_error_t hlw811x_dev_on_rx(struct hlw811x *self,
+		const uint8_t *data, size_t datalen)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	struct async_queue *q = &self->async;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
-	}
+	while (datalen > 0) {
+		struct async_read *req;
+		uint8_t buf[HLW811X_REG_WIDTH_MAX] = { 0, };
+		hlw811x_error_t err;
+		size_t n;
+
+		if (q->inflight == 0) {
+			HLW811X_ERROR("Unexpected rx: %d bytes", datalen);
+			return HLW811X_INCORRECT_RESPONSE;
+		}
+
+		req = get_async(self, 0);
+		n = req->rx_len - req->received;
+		n = datalen < n? datalen : n;
+
+		memcpy(&req->rx[req->received], data, n);
+		req->received = (uint8_t)(req->received + n);
+		data += n;
+		datalen -= n;
+
+		if (req->received < req->rx_len) {
+			break;
+		}
+
+		select_chip(self, false);
+
+		err = decode_frame(self, buf, req->len, req->tx, req->tx_len,
+				req->rx, req->rx_len);
+		if (err == HLW811X_CHECKSUM_MISMATCH) {
+			self->transport.stats.checksum_errors++;
+		}
+
+		/* release the entry before the callback, so that the callback
+		 * may submit the next read. */
+		const struct async_read done = *req;
+		pop_async(self);
+		q->inflight--;
+		q->stats.completed++;
 
-	reg |= 1 << 2; /* ZxEN */
+		issue_async(self);
+
+		(*done.cb)(err, done.addr, buf, done.len, done.cb_ctx);
+	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_disable_zerocrossing(void)
+hlw811x_error_t hlw811x_dev_cancel_reads(struct hlw811x *self)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	struct async_queue *q = &self->async;
+	struct async_read reads[HLW811X_ASYNC_QUEUE_LEN];
+	const uint8_t zero[HLW811X_REG_WIDTH_MAX] = { 0, };
+	const uint8_t count = q->count;
+
+	if (q->inflight > 0) {
+		select_chip(self, false);
+		self->transport.stats.timeouts += q->inflight;
+	}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	/* empty the queue before the callbacks, so that the reads they submit
+	 * go out right away instead of behind the dropped ones. */
+	for (uint8_t i = 0; i < count; i++) {
+		reads[i] = *get_async(self, i);
+	}
+	q->head = 0;
+	q->count = 0;
+	q->inflight = 0;
+	q->stats.depth = 0;
+	q->stats.completed += count;
+
+	for (uint8_t i = 0; i < count; i++) {
+		(*reads[i].cb)(HLW811X_NO_RESPONSE, reads[i].addr, zero,
+				reads[i].len, reads[i].cb_ctx);
 	}
 
-	reg &= ~(1 << 2); /* ZxEN */
+	return HLW811X_ERROR_NONE;
+}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+hlw811x_error_t hlw811x_dev_get_queue_stats(struct hlw811x *self,
+		struct hlw811x_queue_stats *stats)
+{
+	*stats = self->async.stats;
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_enable_power_factor(void)
+void hlw811x_dev_set_transport_policy(struct hlw811x *self,
+		const struct hlw811x_transport_policy *policy)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	self->transport.policy = *policy;
+}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
-	}
+hlw811x_error_t hlw811x_dev_get_transport_stats(struct hlw811x *self,
+		struct hlw811x_transport_stats *stats)
+{
+	*stats = self->transport.stats;
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_set_stats_clock(struct hlw811x *self,
+		hlw811x_clock_t clock, void *ctx)
+{
+	self->trace.clock = clock;
+	self->trace.clock_ctx = ctx;
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_stats(struct hlw811x *self,
+		struct hlw811x_stats *stats)
+{
+#if HLW811X_STATS
+	*stats = self->trace.stats;
+	return HLW811X_ERROR_NONE;
+#else
+	(void)self;
+	(void)stats;
+	return HLW811X_NOT_IMPLEMENTED;
+#endif
+}
 
-	reg |= 1 << 6; /* PfactorEN */
+hlw811x_error_t hlw811x_dev_clear_stats(struct hlw811x *self)
+{
+#if HLW811X_STATS
+	memset(&self->trace.stats, 0, sizeof(self->trace.stats));
+	return HLW811X_ERROR_NONE;
+#else
+	(void)self;
+	return HLW811X_NOT_IMPLEMENTED;
+#endif
+}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+hlw811x_error_t hlw811x_dev_set_active_power_calc_mode(struct hlw811x *self,
+		hlw811x_active_power_mode_t mode)
+{
+	return update_field(self, HLW811X_METER_CTRL_PMODE, (uint32_t)mode);
 }
 
-hlw811x_error_t hlw811x_disable_power_factor(void)
+hlw811x_error_t hlw811x_dev_get_active_power_calc_mode(struct hlw811x *self,
+		hlw811x_active_power_mode_t *mode)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t val;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
+	if ((err = read_field(self, HLW811X_METER_CTRL_PMODE, &val))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg &= ~(1 << 6); /* PfactorEN */
+	*mode = (hlw811x_active_power_mode_t)val;
+
+	return HLW811X_ERROR_NONE;
+}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+hlw811x_error_t hlw811x_dev_set_rms_calc_mode(struct hlw811x *self,
+		hlw811x_rms_mode_t mode)
+{
+	return update_field(self, HLW811X_METER_CTRL_DC_MODE, (uint32_t)mode);
 }
 
-hlw811x_error_t hlw811x_enable_energy_clearance(hlw811x_channel_t channel)
+hlw811x_error_t hlw811x_dev_get_rms_calc_mode(struct hlw811x *self,
+		hlw811x_rms_mode_t *mode)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t val;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
+	if ((err = read_field(self, HLW811X_METER_CTRL_DC_MODE, &val))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	if (channel & HLW811X_CHANNEL_A) {
-		reg &= ~(1 << 10); /* EPA_CA */
-	}
-	if (channel & HLW811X_CHANNEL_B) {
-		reg &= ~(1 << 11); /* EPA_CB */
-	}
+	*mode = (hlw811x_rms_mode_t)val;
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_disable_energy_clearance(hlw811x_channel_t channel)
+hlw811x_error_t hlw811x_dev_enable_pulse(struct hlw811x *self,
+		hlw811x_channel_t channel)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL, &reg))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
 	if (channel & HLW811X_CHANNEL_A) {
-		reg |= 1 << 10; /* EPA_CA */
+		reg = set_field(reg, HLW811X_METER_CTRL_PARUN, 1);
 	}
 	if (channel & HLW811X_CHANNEL_B) {
-		reg |= 1 << 11; /* EPA_CB */
+		reg = set_field(reg, HLW811X_METER_CTRL_PBRUN, 1);
 	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return write_regval(self, HLW811X_REG_METER_CTRL, reg);
 }
 
-hlw811x_error_t hlw811x_enable_hpf(hlw811x_channel_t channel)
+hlw811x_error_t hlw811x_dev_disable_pulse(struct hlw811x *self,
+		hlw811x_channel_t channel)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL, &reg))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	if (channel & HLW811X_CHANNEL_U) {
-		reg &= ~(1 << 4); /* HPFUOFF */
-	}
 	if (channel & HLW811X_CHANNEL_A) {
-		reg &= ~(1 << 5); /* HPFAOFF */
+		reg = set_field(reg, HLW811X_METER_CTRL_PARUN, 0);
 	}
 	if (channel & HLW811X_CHANNEL_B) {
-		reg &= ~(1 << 6); /* HPFBOFF */
+		reg = set_field(reg, HLW811X_METER_CTRL_PBRUN, 0);
 	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+	return write_regval(self, HLW811X_REG_METER_CTRL, reg);
+}
+
+hlw811x_error_t hlw811x_dev_set_data_update_frequency(struct hlw811x *self,
+		hlw811x_data_update_freq_t freq)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_DUP, (uint32_t)freq);
 }
 
-hlw811x_error_t hlw811x_disable_hpf(hlw811x_channel_t channel)
+hlw811x_error_t hlw811x_dev_get_data_update_frequency(struct hlw811x *self,
+		hlw811x_data_update_freq_t *freq)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t val;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
+	if ((err = read_field(self, HLW811X_METER_CTRL_2_DUP, &val))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	if (channel & HLW811X_CHANNEL_U) {
-		reg |= 1 << 4; /* HPFUOFF */
-	}
-	if (channel & HLW811X_CHANNEL_A) {
-		reg |= 1 << 5; /* HPFAOFF */
-	}
-	if (channel & HLW811X_CHANNEL_B) {
-		reg |= 1 << 6; /* HPFBOFF */
-	}
+	*freq = (hlw811x_data_update_freq_t)val;
 
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_enable_b_channel_comparator(void)
+static hlw811x_error_t set_b_mode(struct hlw811x *self,
+		hlw811x_channel_b_mode_t mode)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
+	if ((err = update_field(self, HLW811X_METER_CTRL_2_CHS_IB,
+			(uint32_t)mode)) != HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg &= ~(1 << 12); /* comp_off */
+	self->b_mode = mode;
+	self->b_mode_known = true;
 
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_set_channel_b_mode(struct hlw811x *self,
+		hlw811x_channel_b_mode_t mode)
+{
+	return set_b_mode(self, mode);
 }
 
-hlw811x_error_t hlw811x_disable_b_channel_comparator(void)
+hlw811x_error_t hlw811x_dev_get_channel_b_mode(struct hlw811x *self,
+		hlw811x_channel_b_mode_t *mode)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t val;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
+	if ((err = read_field(self, HLW811X_METER_CTRL_2_CHS_IB, &val))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg |= 1 << 12; /* comp_off */
+	*mode = (hlw811x_channel_b_mode_t)val;
+	self->b_mode = *mode;
+	self->b_mode_known = true;
+
+	return HLW811X_ERROR_NONE;
+}
 
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+hlw811x_error_t hlw811x_dev_set_zerocrossing_mode(struct hlw811x *self,
+		hlw811x_zerocrossing_mode_t mode)
+{
+	return update_field(self, HLW811X_METER_CTRL_ZXD, (uint32_t)mode);
 }
 
-hlw811x_error_t hlw811x_enable_temperature_sensor(void)
+hlw811x_error_t hlw811x_dev_get_zerocrossing_mode(struct hlw811x *self,
+		hlw811x_zerocrossing_mode_t *mode)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t val;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
+	if ((err = read_field(self, HLW811X_METER_CTRL_ZXD, &val))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg |= 1 << 13; /* tensor_en */
+	*mode = (hlw811x_zerocrossing_mode_t)val;
 
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_disable_temperature_sensor(void)
+hlw811x_error_t hlw811x_dev_enable_waveform(struct hlw811x *self)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	return update_field(self, HLW811X_METER_CTRL_2_WAVE_EN, 1);
+}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
-	}
+hlw811x_error_t hlw811x_dev_disable_waveform(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_WAVE_EN, 0);
+}
+
+hlw811x_error_t hlw811x_dev_enable_zerocrossing(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_ZX_EN, 1);
+}
+
+hlw811x_error_t hlw811x_dev_disable_zerocrossing(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_ZX_EN, 0);
+}
 
-	reg &= ~(1 << 13); /* tensor_en */
+hlw811x_error_t hlw811x_dev_enable_power_factor(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_PFACTOR_EN, 1);
+}
 
-	return write_reg16(HLW811X_REG_METER_CTRL, reg);
+hlw811x_error_t hlw811x_dev_disable_power_factor(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_PFACTOR_EN, 0);
 }
 
-hlw811x_error_t hlw811x_enable_peak_detection(void)
+hlw811x_error_t hlw811x_dev_enable_energy_clearance(struct hlw811x *self,
+		hlw811x_channel_t channel)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL_2, &reg))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg |= 1 << 1; /* PeakEN */
+	if (channel & HLW811X_CHANNEL_A) {
+		reg = set_field(reg, HLW811X_METER_CTRL_2_EPA_CA, 0);
+	}
+	if (channel & HLW811X_CHANNEL_B) {
+		reg = set_field(reg, HLW811X_METER_CTRL_2_EPA_CB, 0);
+	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return write_regval(self, HLW811X_REG_METER_CTRL_2, reg);
 }
 
-hlw811x_error_t hlw811x_disable_peak_detection(void)
+hlw811x_error_t hlw811x_dev_disable_energy_clearance(struct hlw811x *self,
+		hlw811x_channel_t channel)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL_2, &reg))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg &= ~(1 << 1); /* PeakEN */
+	if (channel & HLW811X_CHANNEL_A) {
+		reg = set_field(reg, HLW811X_METER_CTRL_2_EPA_CA, 1);
+	}
+	if (channel & HLW811X_CHANNEL_B) {
+		reg = set_field(reg, HLW811X_METER_CTRL_2_EPA_CB, 1);
+	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return write_regval(self, HLW811X_REG_METER_CTRL_2, reg);
 }
 
-hlw811x_error_t hlw811x_enable_overload_detection(void)
+hlw811x_error_t hlw811x_dev_enable_hpf(struct hlw811x *self,
+		hlw811x_channel_t channel)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL, &reg))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg |= 1 << 3; /* OverEN */
+	if (channel & HLW811X_CHANNEL_U) {
+		reg = set_field(reg, HLW811X_METER_CTRL_HPFUOFF, 0);
+	}
+	if (channel & HLW811X_CHANNEL_A) {
+		reg = set_field(reg, HLW811X_METER_CTRL_HPFAOFF, 0);
+	}
+	if (channel & HLW811X_CHANNEL_B) {
+		reg = set_field(reg, HLW811X_METER_CTRL_HPFBOFF, 0);
+	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return write_regval(self, HLW811X_REG_METER_CTRL, reg);
 }
 
-hlw811x_error_t hlw811x_disable_overload_detection(void)
+hlw811x_error_t hlw811x_dev_disable_hpf(struct hlw811x *self,
+		hlw811x_channel_t channel)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL, &reg))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg &= ~(1 << 3); /* OverEN */
+	if (channel & HLW811X_CHANNEL_U) {
+		reg = set_field(reg, HLW811X_METER_CTRL_HPFUOFF, 1);
+	}
+	if (channel & HLW811X_CHANNEL_A) {
+		reg = set_field(reg, HLW811X_METER_CTRL_HPFAOFF, 1);
+	}
+	if (channel & HLW811X_CHANNEL_B) {
+		reg = set_field(reg, HLW811X_METER_CTRL_HPFBOFF, 1);
+	}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+	return write_regval(self, HLW811X_REG_METER_CTRL, reg);
 }
 
-hlw811x_error_t hlw811x_enable_voltage_drop_detection(void)
+hlw811x_error_t hlw811x_dev_enable_b_channel_comparator(struct hlw811x *self)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	return update_field(self, HLW811X_METER_CTRL_COMP_OFF, 0);
+}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
-	}
+hlw811x_error_t hlw811x_dev_disable_b_channel_comparator(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_COMP_OFF, 1);
+}
 
-	reg |= 1 << 4; /* SAGEN */
+hlw811x_error_t hlw811x_dev_enable_temperature_sensor(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_TENSOR_EN, 1);
+}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+hlw811x_error_t hlw811x_dev_disable_temperature_sensor(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_TENSOR_EN, 0);
 }
 
-hlw811x_error_t hlw811x_disable_voltage_drop_detection(void)
+hlw811x_error_t hlw811x_dev_enable_peak_detection(struct hlw811x *self)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	return update_field(self, HLW811X_METER_CTRL_2_PEAK_EN, 1);
+}
 
-	if ((err = read_reg16(HLW811X_REG_METER_CTRL_2, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
-	}
+hlw811x_error_t hlw811x_dev_disable_peak_detection(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_PEAK_EN, 0);
+}
+
+hlw811x_error_t hlw811x_dev_enable_overload_detection(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_OVER_EN, 1);
+}
+
+hlw811x_error_t hlw811x_dev_disable_overload_detection(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_OVER_EN, 0);
+}
 
-	reg &= ~(1 << 4); /* SAGEN */
+hlw811x_error_t hlw811x_dev_enable_voltage_drop_detection(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_SAG_EN, 1);
+}
 
-	return write_reg16(HLW811X_REG_METER_CTRL_2, reg);
+hlw811x_error_t hlw811x_dev_disable_voltage_drop_detection(struct hlw811x *self)
+{
+	return update_field(self, HLW811X_METER_CTRL_2_SAG_EN, 0);
 }
 
-hlw811x_error_t hlw811x_enable_interrupt(hlw811x_intr_t ints)
+hlw811x_error_t hlw811x_dev_enable_interrupt(struct hlw811x *self,
+		hlw811x_intr_t ints)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_IE, &reg)) != HLW811X_ERROR_NONE) {
+	if ((err = read_regval(self, HLW811X_REG_IE, &reg))
+			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg |= ints;
+	reg |= (uint32_t)ints & IRQ_FLAGS_MASK;
 
-	return write_reg16(HLW811X_REG_IE, reg);
+	return write_regval(self, HLW811X_REG_IE, reg);
 }
 
-hlw811x_error_t hlw811x_disable_interrupt(hlw811x_intr_t ints)
+hlw811x_error_t hlw811x_dev_disable_interrupt(struct hlw811x *self,
+		hlw811x_intr_t ints)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
 
-	if ((err = read_reg16(HLW811X_REG_IE, &reg)) != HLW811X_ERROR_NONE) {
+	if ((err = read_regval(self, HLW811X_REG_IE, &reg))
+			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
 	reg &= ~ints;
 
-	return write_reg16(HLW811X_REG_IE, reg);
+	return write_regval(self, HLW811X_REG_IE, reg);
 }
 
-hlw811x_error_t hlw811x_set_interrupt_mode(hlw811x_intr_t int1,
-		hlw811x_intr_t int2)
+hlw811x_error_t hlw811x_dev_set_interrupt_mode(struct hlw811x *self,
+		hlw811x_intr_t int1, hlw811x_intr_t int2)
 {
 	hlw811x_error_t err;
-	uint16_t reg;
+	uint32_t reg;
+	uint8_t sel1;
+	uint8_t sel2;
 
-	if (((int1 - 1) & int1) || ((int2 - 1) & int2)) {
+	if (!is_intr_pin_valid(int1) || !is_intr_pin_valid(int2)) {
 		return HLW811X_INVALID_PARAM;
 	}
 
-	if ((err = read_reg16(HLW811X_REG_INT, &reg)) != HLW811X_ERROR_NONE) {
+	sel1 = get_regval_from_intr(int1);
+	sel2 = get_regval_from_intr(int2);
+
+	if ((err = read_regval(self, HLW811X_REG_INT, &reg))
+			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	reg &= ~(0xf << 0); /* clear P1sel bits */
-	reg &= ~(0xf << 4); /* clear P2sel bits */
-
-	reg |= (get_regval_from_intr(int1) << 0)
-		| (get_regval_from_intr(int2) << 4);
+	reg = set_field(reg, HLW811X_INT_P1SEL, sel1);
+	reg = set_field(reg, HLW811X_INT_P2SEL, sel2);
 
-	return write_reg16(HLW811X_REG_INT, reg);
+	return write_regval(self, HLW811X_REG_INT, reg);
 }
 
-hlw811x_error_t hlw811x_get_interrupt(hlw811x_intr_t *ints)
+hlw811x_error_t hlw811x_dev_get_interrupt(struct hlw811x *self,
+		hlw811x_intr_t *ints)
 {
 	hlw811x_error_t err;
-	uint8_t reg[2];
+	uint32_t reg;
 
-	if ((err = read_reg(HLW811X_REG_IF, reg, 2)) != HLW811X_ERROR_NONE) {
+	if ((err = read_regval(self, HLW811X_REG_IF, &reg))
+			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	*ints = (hlw811x_intr_t)(((uint16_t)reg[0] << 8) | reg[1]);
+	*ints = (hlw811x_intr_t)reg;
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_get_interrupt_ext(hlw811x_intr_t *ints)
+hlw811x_error_t hlw811x_dev_get_interrupt_ext(struct hlw811x *self,
+		hlw811x_intr_t *ints)
 {
 	hlw811x_error_t err;
-	uint8_t reg[2];
+	uint32_t reg;
 
-	if ((err = read_reg(HLW811X_REG_RIF, reg, 2)) != HLW811X_ERROR_NONE) {
+	if ((err = read_regval(self, HLW811X_REG_RIF, &reg))
+			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	*ints = (hlw811x_intr_t)(((uint16_t)reg[0] << 8) | reg[1]);
+	*ints = (hlw811x_intr_t)reg;
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_get_rms(hlw811x_channel_t channel, int32_t *milliunit)
+hlw811x_error_t hlw811x_dev_start_zc_tracker(struct hlw811x *self,
+		hlw811x_clock_t clock, void *ctx)
 {
+	hlw811x_zerocrossing_mode_t mode;
 	hlw811x_error_t err;
-	uint8_t buf[3];
-	struct calc_param param;
-
-	get_calc_param(channel, CALC_TYPE_RMS, &param);
 
-	if ((err = read_reg(param.addr, buf, sizeof(buf)))
+	/* read once here, so that feeding never touches the bus */
+	if ((err = hlw811x_dev_get_zerocrossing_mode(self, &mode))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	const int32_t raw = convert_24bits_to_int32(buf);
-	if (raw & (1 << 23)) {
-		return HLW811X_INVALID_DATA;
-	}
-
-	/* Multiplied by 1000 first and then divide by 10 to avoid losing
-	 * significant digits during the calculation. */
-	int64_t val = ((int64_t)raw * param.coeff * 1000)
-		/ (param.ratio * param.resol);
-
-	if (channel == HLW811X_CHANNEL_U) {
-		val = val * param.mult / (1 << param.pga) / 10;
-	} else {
-		val = val * (16 >> param.pga) / 10;
-	}
+	self->zc = (struct zc_tracker) {
+		.clock = clock,
+		.clock_ctx = ctx,
+		.edges = mode == HLW811x_ZERO_CROSSING_MODE_BOTH? 2 : 1,
+		.enabled = true,
+	};
 
-	*milliunit = (int32_t)val;
+	return HLW811X_ERROR_NONE;
+}
 
+hlw811x_error_t hlw811x_dev_stop_zc_tracker(struct hlw811x *self)
+{
+	self->zc.enabled = false;
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_get_power(hlw811x_channel_t channel, int32_t *milliwatt)
+static void track_voltage_crossing(struct zc_tracker *zc, uint32_t ts)
 {
-	hlw811x_error_t err;
-	uint8_t buf[4];
-	struct calc_param param;
+	const uint32_t period = (ts - zc->last_u) * zc->edges;
+	const bool first = !zc->u_seen;
 
-	get_calc_param(channel, CALC_TYPE_POWER, &param);
+	zc->last_u = ts;
+	zc->u_seen = true;
 
-	if ((err = read_reg(param.addr, buf, sizeof(buf)))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	/* a missed crossing or a glitch is not a line period */
+	if (first || period < ZC_PERIOD_MIN_US || period > ZC_PERIOD_MAX_US) {
+		return;
 	}
 
-	const int32_t raw = convert_32bits_to_int32(buf);
-	uint16_t K2 = convert_float_to_uint16_centi(m.ratio.K2);
-	hlw811x_pga_gain_t k2_pga = m.pga.U;
+	const int32_t sample = (int32_t)(period << ZC_PERIOD_FRAC_BITS);
 
-	if (channel == HLW811X_CHANNEL_U) {
-		hlw811x_channel_t ch;
-		if ((err = read_current_channel(&ch)) != HLW811X_ERROR_NONE) {
-			return err;
-		}
+	if (!zc->locked) {
+		zc->period = (uint32_t)sample;
+		zc->locked = true;
+		return;
+	}
 
-		if (ch == HLW811X_CHANNEL_A) {
-			K2 = convert_float_to_uint16_centi(m.ratio.K1_A);
-			k2_pga = m.pga.A;
-		} else if (ch == HLW811X_CHANNEL_B) {
-			K2 = convert_float_to_uint16_centi(m.ratio.K1_B);
-			k2_pga = m.pga.B;
-		}
+	zc->period = (uint32_t)((int32_t)zc->period +
+			((sample - (int32_t)zc->period)
+			 / (1 << HLW811X_ZC_FILTER_SHIFT)));
+}
+
+static void track_current_crossing(struct zc_tracker *zc, uint32_t ts)
+{
+	if (!zc->locked) {
+		return;
 	}
 
-	const int64_t div = param.ratio * K2;
-	int32_t pga = 16l >> (param.pga + k2_pga);
-	int64_t val = (int64_t)raw * param.coeff * pga;
-	val = val * 1000/*milli*/ / param.resol * 10000/*K1,K2 scale*/;
-	val = val / div;
+	const uint64_t period = zc->period;
+	const uint64_t dt = (uint64_t)(ts - zc->last_u) << ZC_PERIOD_FRAC_BITS;
 
-	*milliwatt = (int32_t)val;
+	/* only the crossing that follows the voltage one within the same
+	 * half or full cycle tells the phase */
+	if (dt * zc->edges >= period) {
+		return;
+	}
 
-	return HLW811X_ERROR_NONE;
+	zc->phase = (int32_t)(dt * 36000 / period);
+	zc->phased = true;
 }
 
-hlw811x_error_t hlw811x_get_energy(hlw811x_channel_t channel, int32_t *Wh)
+hlw811x_error_t hlw811x_dev_feed_zerocrossing(struct hlw811x *self,
+		hlw811x_intr_t flag, uint32_t timestamp_us)
 {
-	hlw811x_error_t err;
-	uint8_t buf[3];
-	struct calc_param param;
-
-	get_calc_param(channel, CALC_TYPE_ENERGY, &param);
+	if (!self->zc.enabled) {
+		return HLW811X_INVALID_PARAM;
+	}
 
-	if ((err = read_reg(param.addr, buf, sizeof(buf)))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	if (flag == HLW811X_INTR_ZERO_CROSSING_VOLTAGE) {
+		track_voltage_crossing(&self->zc, timestamp_us);
+	} else if (flag == HLW811X_INTR_ZERO_CROSSING_CURRENT_A) {
+		track_current_crossing(&self->zc, timestamp_us);
+	} else {
+		return HLW811X_INVALID_PARAM;
 	}
 
-	const int32_t raw = convert_24bits_to_int32(buf);
-	const int32_t pga = (1 << m.pga.U) * (1 << param.pga);
-	const uint16_t K2 = convert_float_to_uint16_centi(m.ratio.K2);
-	const int64_t div = param.ratio * K2 * 4096;
-	int64_t val = (int64_t)raw * param.coeff * m.coeff.hfconst;
-	val = val * 100/*watt unit*/
-		/ param.resol * 10000/*K1,K2 scaling*/ * 10/*watt unit*/ * pga;
-	val = val / div;
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_tracked_frequency(struct hlw811x *self,
+		int32_t *centihertz)
+{
+	if (!self->zc.enabled || !self->zc.locked) {
+		return HLW811X_INVALID_DATA;
+	}
 
-	*Wh = (int32_t)val;
+	*centihertz = (int32_t)((100000000ull << ZC_PERIOD_FRAC_BITS)
+			/ self->zc.period);
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_get_frequency(int32_t *centihertz)
+hlw811x_error_t hlw811x_dev_get_tracked_phase(struct hlw811x *self,
+		int32_t *centidegree)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
-
-	if ((err = read_reg16(HLW811X_REG_FREQUENCY_L_LINE, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	if (!self->zc.enabled || !self->zc.phased) {
+		return HLW811X_INVALID_DATA;
 	}
 
-	*centihertz = 0;
-	if (reg) {
-		*centihertz = HLW811X_MCLK * 100 / 8 / reg;
-	}
+	*centidegree = self->zc.phase;
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_get_power_factor(int32_t *centiunit)
+hlw811x_error_t hlw811x_dev_get_line_freq(struct hlw811x *self,
+		hlw811x_line_freq_t *freq)
 {
 	hlw811x_error_t err;
-	uint8_t buf[3];
+	int32_t centihertz;
 
-	if ((err = read_reg(HLW811X_REG_POWER_FACTOR, buf, sizeof(buf)))
+	if ((err = hlw811x_dev_get_tracked_frequency(self, &centihertz))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	int32_t val = fix_bit24_sign(convert_24bits_to_int32(buf));
-	*centiunit = val * 100 / ((1 << 23) - 1);
+	*freq = centihertz > 5500?
+		HLW811X_LINE_FREQ_60HZ : HLW811X_LINE_FREQ_50HZ;
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_get_phase_angle(int32_t *centidegree,
-		hlw811x_line_freq_t freq)
+hlw811x_error_t hlw811x_dev_get_next_zerocrossing(struct hlw811x *self,
+		uint32_t *timestamp_us)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
-
-	if ((err = read_reg16(HLW811X_REG_ANGLE, &reg)) != HLW811X_ERROR_NONE) {
-		return err;
+	if (!self->zc.enabled || !self->zc.locked) {
+		return HLW811X_INVALID_DATA;
 	}
 
-	if (freq == HLW811X_LINE_FREQ_50HZ) {
-		*centidegree = (int32_t)reg * 805 / 100;
-	} else if (freq == HLW811X_LINE_FREQ_60HZ) {
-		*centidegree = (int32_t)reg * 965 / 100;
-	} else {
-		return HLW811X_INVALID_PARAM;
-	}
+	*timestamp_us = self->zc.last_u + ((self->zc.period / self->zc.edges)
+			>> ZC_PERIOD_FRAC_BITS);
 
 	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_select_channel(hlw811x_channel_t channel)
+hlw811x_error_t hlw811x_dev_register_irq_handler(struct hlw811x *self,
+		hlw811x_intr_t ints, hlw811x_irq_handler_t handler, void *ctx)
 {
-	return select_channel(channel);
-}
+	if (ints == 0) {
+		return HLW811X_INVALID_PARAM;
+	}
 
-hlw811x_error_t hlw811x_read_current_channel(hlw811x_channel_t *channel)
-{
-	return read_current_channel(channel);
+	for (uint8_t i = 0; i < IRQ_FLAGS_MAX; i++) {
+		if (ints & (1u << i)) {
+			self->irq_handlers[i] = (struct irq_handler) {
+				.fn = handler,
+				.ctx = ctx,
+			};
+		}
+	}
+
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_read_coeff(struct hlw811x_coeff *coeff)
+hlw811x_error_t hlw811x_dev_handle_irq(struct hlw811x *self)
 {
 	hlw811x_error_t err;
-	uint16_t chksum;
-
-	err = read_reg16(HLW811X_REG_PULSE_FREQ, &coeff->hfconst);
-	err |= read_reg16(HLW811X_REG_RMS_IA_COEFF, &coeff->rms.A);
-	err |= read_reg16(HLW811X_REG_RMS_IB_COEFF, &coeff->rms.B);
-	err |= read_reg16(HLW811X_REG_RMS_U_COEFF, &coeff->rms.U);
-	err |= read_reg16(HLW811X_REG_POWER_A_COEFF, &coeff->power.A);
-	err |= read_reg16(HLW811X_REG_POWER_B_COEFF, &coeff->power.B);
-	err |= read_reg16(HLW811X_REG_POWER_S_COEFF, &coeff->power.S);
-	err |= read_reg16(HLW811X_REG_ENERGY_A_COEFF, &coeff->energy.A);
-	err |= read_reg16(HLW811X_REG_ENERGY_B_COEFF, &coeff->energy.B);
-
-	if (err != HLW811X_ERROR_NONE) {
-		return err;
-	}
+	hlw811x_intr_t ints;
 
-	if ((err = read_reg16(HLW811X_REG_COEFF_CHKSUM, &chksum))
+	/* RIF reads the same flags as IF and clears them at once, so the
+	 * interrupt line is released without another read. */
+	if ((err = hlw811x_dev_get_interrupt_ext(self, &ints))
 			!= HLW811X_ERROR_NONE) {
 		return err;
 	}
 
-	const uint16_t chksum_calc = (uint16_t)~(0xFFFFu
-			+ coeff->rms.A + coeff->rms.B + coeff->rms.U
-			+ coeff->power.A + coeff->power.B + coeff->power.S
-			+ coeff->energy.A + coeff->energy.B);
+	if (self->zc.enabled && self->zc.clock != NULL) {
+		/* voltage first so that the current is measured against the
+		 * crossing of the same cycle */
+		const hlw811x_intr_t zc[] = {
+			HLW811X_INTR_ZERO_CROSSING_VOLTAGE,
+			HLW811X_INTR_ZERO_CROSSING_CURRENT_A,
+		};
+		uint32_t crossed = (uint32_t)ints & (zc[0] | zc[1]);
+		uint32_t now = 0;
 
-	if (chksum != chksum_calc) {
-		return HLW811X_CHECKSUM_MISMATCH;
+		if (crossed) {
+			now = (*self->zc.clock)(self->zc.clock_ctx);
+		}
+
+		/* both latched in one read tell the period but not how far
+		 * apart they came, as the RIF read alone takes a few ms */
+		if (crossed == (uint32_t)(zc[0] | zc[1])) {
+			crossed = zc[0];
+		}
+
+		for (size_t i = 0; i < sizeof(zc) / sizeof(zc[0]); i++) {
+			if (crossed & zc[i]) {
+				hlw811x_dev_feed_zerocrossing(self, zc[i], now);
+			}
+		}
 	}
 
-	memcpy(&m.coeff, coeff, sizeof(m.coeff));
+	/* the flags are cleared already, so the handlers get them even when
+	 * a peak could not be read, and the error is returned after. */
+	if (ints & self->events.ints) {
+		err = hlw811x_dev_capture_events(self, ints);
+	}
 
-	HLW811X_DEBUG("Coefficients: HFConst=%d, "
-			"RMS_A=%d, RMS_B=%d, RMS_U=%d, "
-			"Power_A=%d, Power_B=%d, Power_S=%d, "
-			"Energy_A=%d, Energy_B=%d",
-			coeff->hfconst,
-			coeff->rms.A, coeff->rms.B, coeff->rms.U,
-			coeff->power.A, coeff->power.B, coeff->power.S,
-			coeff->energy.A, coeff->energy.B);
+	for (uint32_t pending = (uint32_t)ints & IRQ_FLAGS_MASK;
+			pending; pending &= pending - 1) {
+		const uint8_t i = count_trailing_zeros(pending);
+		const struct irq_handler *handler = &self->irq_handlers[i];
+
+		if (handler->fn != NULL) {
+			(*handler->fn)((hlw811x_intr_t)(1u << i), handler->ctx);
+		}
+	}
 
 	return err;
 }
 
-void hlw811x_set_resistor_ratio(const struct hlw811x_resistor_ratio *ratio)
+void hlw811x_for_each_pending(hlw811x_intr_t ints,
+		hlw811x_irq_handler_t fn, void *ctx)
 {
-	memcpy(&m.ratio, ratio, sizeof(m.ratio));
-	HLW811X_INFO("Resistor ratio set: K1_A=%d, K1_B=%d, K2=%d",
-			ratio->K1_A, ratio->K1_B, ratio->K2);
+	for (uint32_t pending = (uint32_t)ints & IRQ_FLAGS_MASK;
+			pending; pending &= pending - 1) {
+		(*fn)((hlw811x_intr_t)(1u << count_trailing_zeros(pending)),
+				ctx);
+	}
 }
 
-void hlw811x_get_resistor_ratio(struct hlw811x_resistor_ratio *ratio)
+/* Sets f to floor(num * 2^exp2 / den) in Q format, keeping as many fraction
+ * bits as the multiplier fits in 31 bits. The division is done bit by bit to
+ * stay in 64 bits, which is fine as it runs only on configuration changes. */
+static void make_factor(struct factor *f, uint64_t num, uint64_t den,
+		int exp2)
 {
-	memcpy(ratio, &m.ratio, sizeof(m.ratio));
-}
+	uint64_t q;
+	uint64_t r;
+	int t = 0; /* q = floor(num * 2^t / den) */
 
-hlw811x_error_t hlw811x_set_pga(const struct hlw811x_pga *pga)
-{
-	hlw811x_error_t err;
-	uint16_t reg;
+	if (num == 0 || den == 0) {
+		*f = (struct factor) { .mult = 0, .shift = 0 };
+		return;
+	}
 
-	if ((err = read_reg16(HLW811X_REG_SYS_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	q = num / den;
+	r = num % den;
+
+	while (q >= (1ull << 31)) {
+		q >>= 1;
+		t--;
 	}
 
-	reg &= ~(0x1FF << 0); /* clear PGA bits */
-	reg |= (pga->A << 0) | (pga->U << 3) | (pga->B << 6);
+	while (q < (1ull << 30) && t - exp2 < 62) {
+		r <<= 1;
+		q <<= 1;
+		if (r >= den) {
+			r -= den;
+			q |= 1;
+		}
+		t++;
+	}
 
-	if ((err = write_reg16(HLW811X_REG_SYS_CTRL, reg))
-			== HLW811X_ERROR_NONE) {
-		memcpy(&m.pga, pga, sizeof(m.pga));
-		HLW811X_INFO("PGA set: A=%d, U=%d, B=%d",
-				pga->A, pga->U, pga->B);
+	if (t - exp2 < 0) {
+		HLW811X_ERROR("Factor out of range: %d", t - exp2);
+		*f = (struct factor) { .mult = INT32_MAX, .shift = 0 };
+		return;
 	}
 
-	return err;
+	*f = (struct factor) {
+		.mult = (uint32_t)q,
+		.shift = (uint8_t)(t - exp2),
+	};
 }
 
-hlw811x_error_t hlw811x_get_pga(struct hlw811x_pga *pga)
+/* Kept branch-free with the factor hoisted out of the loop, so that the
+ * compiler can vectorize it on hosts converting large batches. */
+static void scale(const struct factor *f, const int32_t *restrict raw,
+		int32_t *restrict out, size_t n)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	const uint64_t mult = f->mult;
+	const uint8_t shift = f->shift;
 
-	if ((err = read_reg16(HLW811X_REG_SYS_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+	for (size_t i = 0; i < n; i++) {
+		const int32_t r = raw[i];
+		const uint64_t mag = r < 0? (uint64_t)-(int64_t)r : (uint64_t)r;
+		const int64_t val = (int64_t)((mag * mult) >> shift);
+
+		out[i] = (int32_t)(r < 0? -val : val);
 	}
+}
 
-	pga->A = (reg >> 0) & 0x07; /* PGAIA */
-	pga->U = (reg >> 3) & 0x07; /* PGAU */
-	pga->B = (reg >> 6) & 0x07; /* PGAIB */
+static void update_rms_factor(struct hlw811x *self,
+		hlw811x_channel_t channel, struct factor *f)
+{
+	struct calc_param p;
 
-	memcpy(&m.pga, pga, sizeof(m.pga));
+	get_calc_param(self, channel, CALC_TYPE_RMS, &p);
 
-	return HLW811X_ERROR_NONE;
+	/* raw * coeff * 1000 / (ratio * 2^resol) scaled down by the PGA gain
+	 * and by 10 of the ratio in centi. */
+	if (channel == HLW811X_CHANNEL_U) {
+		make_factor(f, (uint64_t)p.coeff * 1000 * p.mult,
+				(uint64_t)p.ratio * 10,
+				-(p.resol + (int)p.pga));
+	} else {
+		make_factor(f, (uint64_t)p.coeff * 1000 * (16u >> p.pga),
+				(uint64_t)p.ratio * 10, -p.resol);
+	}
 }
 
-hlw811x_error_t hlw811x_enable_channel(hlw811x_channel_t channel)
+static void update_power_factor(struct hlw811x *self,
+		hlw811x_channel_t channel, float K2f, hlw811x_pga_gain_t k2_pga,
+		struct factor *f)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	struct calc_param p;
 
-	if ((err = read_reg16(HLW811X_REG_SYS_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
-	}
+	get_calc_param(self, channel, CALC_TYPE_POWER, &p);
 
-	if (channel & HLW811X_CHANNEL_A) {
-		reg |= 1 << 9; /* ADC1ON */
-	}
-	if (channel & HLW811X_CHANNEL_B) {
-		reg |= 1 << 10; /* ADC2ON */
-	}
-	if (channel & HLW811X_CHANNEL_U) {
-		reg |= 1 << 11; /* ADC3ON */
-	}
+	const uint16_t K2 = convert_float_to_uint16_centi(K2f);
+	const uint32_t pga = 16u >> (p.pga + k2_pga);
 
-	if ((err = write_reg16(HLW811X_REG_SYS_CTRL, reg))
-			== HLW811X_ERROR_NONE) {
-		HLW811X_INFO("Channel enabled: %d", channel);
-	}
+	/* raw * coeff * pga * 1000 * 10000 / (2^resol * ratio * K2), where
+	 * 1000 is for milliwatt and 10000 for K1 and K2 in centi. */
+	make_factor(f, (uint64_t)p.coeff * pga * 1000 * 10000,
+			(uint64_t)p.ratio * K2, -p.resol);
+}
 
-	return err;
+static void update_energy_factor(struct hlw811x *self,
+		hlw811x_channel_t channel, struct factor *f)
+{
+	struct calc_param p;
+
+	get_calc_param(self, channel, CALC_TYPE_ENERGY, &p);
+
+	const uint16_t K2 = convert_float_to_uint16_centi(self->ratio.K2);
+
+	/* raw * coeff * hfconst * 100 * 10000 * 10 * pga, divided by
+	 * 2^resol * ratio * K2 * 4096 */
+	make_factor(f, (uint64_t)p.coeff * self->coeff.hfconst * 10000000,
+			(uint64_t)p.ratio * K2,
+			(int)self->pga.U + (int)p.pga - p.resol - 12/*4096*/);
 }
 
-hlw811x_error_t hlw811x_disable_channel(hlw811x_channel_t channel)
+static void update_factors(struct hlw811x *self)
 {
-	hlw811x_error_t err;
-	uint16_t reg;
+	struct factors *f = &self->factors;
+
+	update_rms_factor(self, HLW811X_CHANNEL_A, &f->rms[0]);
+	update_rms_factor(self, HLW811X_CHANNEL_B, &f->rms[1]);
+	update_rms_factor(self, HLW811X_CHANNEL_U, &f->rms[2]);
+
+	update_power_factor(self, HLW811X_CHANNEL_A,
+			self->ratio.K2, self->pga.U, &f->power[0]);
+	update_power_factor(self, HLW811X_CHANNEL_B,
+			self->ratio.K2, self->pga.U, &f->power[1]);
+	update_power_factor(self, HLW811X_CHANNEL_U,
+			self->ratio.K1_A, self->pga.A, &f->power[2]);
+	update_power_factor(self, HLW811X_CHANNEL_U,
+			self->ratio.K1_B, self->pga.B, &f->power[3]);
+
+	update_energy_factor(self, HLW811X_CHANNEL_A, &f->energy[0]);
+	update_energy_factor(self, HLW811X_CHANNEL_B, &f->energy[1]);
+}
 
-	if ((err = read_reg16(HLW811X_REG_SYS_CTRL, &reg))
-			!= HLW811X_ERROR_NONE) {
-		return err;
+static uint8_t get_channel_index(hlw811x_channel_t channel)
+{
+	if (channel == HLW811X_CHANNEL_B) {
+		return 1;
+	} else if (channel == HLW811X_CHANNEL_U) {
+		return 2;
 	}
+	return 0;
+}
 
-	if (channel & HLW811X_CHANNEL_A) {
-		reg &= ~(1 << 9); /* ADC1ON */
+hlw811x_error_t hlw811x_dev_convert_rms_batch(const struct hlw811x *self,
+		hlw811x_channel_t channel, const int32_t *raw,
+		int32_t *milliunit, size_t n)
+{
+	int32_t flags = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		flags |= raw[i];
 	}
-	if (channel & HLW811X_CHANNEL_B) {
-		reg &= ~(1 << 10); /* ADC2ON */
+
+	scale(&self->factors.rms[get_channel_index(channel)],
+			raw, milliunit, n);
+
+	if (!(flags & (1 << 23))) {
+		return HLW811X_ERROR_NONE;
 	}
-	if (channel & HLW811X_CHANNEL_U) {
-		reg &= ~(1 << 11); /* ADC3ON */
+
+	for (size_t i = 0; i < n; i++) {
+		milliunit[i] = (raw[i] & (1 << 23))? 0 : milliunit[i];
 	}
 
-	if ((err = write_reg16(HLW811X_REG_SYS_CTRL, reg))
-			== HLW811X_ERROR_NONE) {
-		HLW811X_INFO("Channel disabled: %d", channel);
+	return HLW811X_INVALID_DATA;
+}
+
+hlw811x_error_t hlw811x_dev_convert_power_batch(const struct hlw811x *self,
+		hlw811x_channel_t channel, hlw811x_channel_t current_channel,
+		const int32_t *raw, int32_t *milliwatt, size_t n)
+{
+	uint8_t i = get_channel_index(channel);
+
+	if (channel == HLW811X_CHANNEL_U &&
+			current_channel == HLW811X_CHANNEL_B) {
+		i = 3;
 	}
 
-	return err;
+	scale(&self->factors.power[i], raw, milliwatt, n);
+
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_reset(void)
+hlw811x_error_t hlw811x_dev_convert_energy_batch(const struct hlw811x *self,
+		hlw811x_channel_t channel, const int32_t *raw, int32_t *Wh,
+		size_t n)
 {
-	HLW811X_INFO("Resetting HLW811X chip");
-	return reset_chip();
+	scale(&self->factors.energy[get_channel_index(channel)], raw, Wh, n);
+
+	return HLW811X_ERROR_NONE;
 }
 
-hlw811x_error_t hlw811x_init(hlw811x_interface_t interface)
+static hlw811x_error_t calc_rms(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t raw, int32_t *milliunit)
 {
-	memset(&m, 0, sizeof(m));
+	return hlw811x_dev_convert_rms_batch(self, channel,
+			&raw, milliunit, 1);
+}
+
+/* current_channel is the channel selected for the apparent power, which is
+ * only used when channel is HLW811X_CHANNEL_U. */
+static int32_t calc_power(struct hlw811x *self, hlw811x_channel_t channel,
+		int32_t raw, hlw811x_channel_t current_channel)
+{
+	int32_t milliwatt;
 
-	m.iface = interface;
+	hlw811x_dev_convert_power_batch(self, channel, current_channel,
+			&raw, &milliwatt, 1);
 
-	return HLW811X_ERROR_NONE;
+	return milliwatt;
+}
+
+static int32_t calc_energy(struct hlw811x *self, hlw811x_channel_t channel,
+		int32_t raw)
+{
+	int32_t Wh;
+
+	hlw811x_dev_convert_energy_batch(self, channel, &raw, &Wh, 1);
+
+	return Wh;
+}
+
+static int32_t calc_frequency(uint16_t reg)
+{
+	if (reg == 0) {
+		return 0;
+	}
+
+	return (int32_t)(HLW811X_MCLK * 100 / 8 / reg);
+}
+
+/* HLW811X_TEMPERATURE_NONE without the fit */
+static int32_t calc_temperature(int32_t raw)
+{
+#if TEMP_FIT_DEFINED
+	return (int32_t)(((int64_t)raw - HLW811X_TEMP_REF_RAW) * 100
+			/ HLW811X_TEMP_COUNTS_PER_DEGREE)
+		+ HLW811X_TEMP_REF_CENTIDEGREE;
+#else
+	(void)raw;
+	return HLW811X_TEMPERATURE_NONE;
+#endif
+}
+
+static int32_t calc_power_factor(int32_t raw)
+{
+	return fix_bit24_sign(raw) * 100 / ((1 << 23) - 1);
+}
+
+static hlw811x_error_t calc_phase_angle(uint16_t reg,
+		hlw811x_line_freq_t freq, int32_t *centidegree)
+{
+	if (freq == HLW811X_LINE_FREQ_50HZ) {
+		*centidegree = (int32_t)reg * 805 / 100;
+	} else if (freq == HLW811X_LINE_FREQ_60HZ) {
+		*centidegree = (int32_t)reg * 965 / 100;
+	} else {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+static hlw811x_error_t read_reg24(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, int32_t *reg)
+{
+	hlw811x_error_t err;
+	uint32_t val;
+
+	if (get_reg_width(addr) != 3) {
+		HLW811X_ERROR("Not a 24-bit register: %x", addr);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if ((err = read_regval(self, addr, &val)) == HLW811X_ERROR_NONE) {
+		*reg = (int32_t)val;
+	}
+
+	return err;
+}
+
+static hlw811x_error_t read_reg32(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, int32_t *reg)
+{
+	hlw811x_error_t err;
+	uint32_t val;
+
+	if (get_reg_width(addr) != 4) {
+		HLW811X_ERROR("Not a 32-bit register: %x", addr);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if ((err = read_regval(self, addr, &val)) == HLW811X_ERROR_NONE) {
+		*reg = (int32_t)val;
+	}
+
+	return err;
+}
+
+hlw811x_error_t hlw811x_dev_get_rms(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t *milliunit)
+{
+	hlw811x_error_t err;
+	struct calc_param param;
+	int32_t raw;
+
+	get_calc_param(self, channel, CALC_TYPE_RMS, &param);
+
+	if ((err = read_reg24(self, param.addr, &raw)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	return calc_rms(self, channel, raw, milliunit);
+}
+
+hlw811x_error_t hlw811x_dev_get_power(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t *milliwatt)
+{
+	hlw811x_error_t err;
+	struct calc_param param;
+	hlw811x_channel_t ch = 0;
+	int32_t raw;
+
+	get_calc_param(self, channel, CALC_TYPE_POWER, &param);
+
+	if ((err = read_reg32(self, param.addr, &raw)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if (channel == HLW811X_CHANNEL_U &&
+			(err = read_current_channel(self, &ch))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	*milliwatt = calc_power(self, channel, raw, ch);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_energy(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t *Wh)
+{
+	hlw811x_error_t err;
+	struct calc_param param;
+	int32_t raw;
+
+	get_calc_param(self, channel, CALC_TYPE_ENERGY, &param);
+
+	if ((err = read_reg24(self, param.addr, &raw)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	*Wh = calc_energy(self, channel, raw);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_frequency(struct hlw811x *self,
+		int32_t *centihertz)
+{
+	hlw811x_error_t err;
+	uint16_t reg;
+
+	if ((err = read_reg16(self, HLW811X_REG_FREQUENCY_L_LINE, &reg))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	*centihertz = calc_frequency(reg);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_power_factor(struct hlw811x *self,
+		int32_t *centiunit)
+{
+	hlw811x_error_t err;
+	int32_t raw;
+
+	if ((err = read_reg24(self, HLW811X_REG_POWER_FACTOR, &raw))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	*centiunit = calc_power_factor(raw);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_phase_angle(struct hlw811x *self,
+		int32_t *centidegree, hlw811x_line_freq_t freq)
+{
+	hlw811x_error_t err;
+	uint16_t reg;
+
+	if ((err = read_reg16(self, HLW811X_REG_ANGLE, &reg))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	return calc_phase_angle(reg, freq, centidegree);
+}
+
+hlw811x_error_t hlw811x_dev_get_temperature(struct hlw811x *self,
+		int32_t *centidegree)
+{
+	hlw811x_channel_b_mode_t mode = self->b_mode;
+	hlw811x_error_t err;
+	int32_t raw;
+
+	if (!TEMP_FIT_DEFINED) {
+		return HLW811X_NOT_IMPLEMENTED;
+	}
+
+	if (!self->b_mode_known && (err = hlw811x_dev_get_channel_b_mode(self,
+			&mode)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if (mode != HLW811X_B_MODE_TEMPERATURE) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if ((err = read_reg24(self, HLW811X_REG_RMS_IB, &raw))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	*centidegree = calc_temperature(raw);
+
+	return HLW811X_ERROR_NONE;
+}
+
+/* In address order, so that the reads are packed as close together as
+ * possible within one update period. */
+static const hlw811x_reg_addr_t snapshot_regs[SNAPSHOT_REGS] = {
+	HLW811X_REG_ANGLE,
+	HLW811X_REG_FREQUENCY_L_LINE,
+	HLW811X_REG_RMS_IA,
+	HLW811X_REG_RMS_IB,
+	HLW811X_REG_RMS_U,
+	HLW811X_REG_POWER_FACTOR,
+	HLW811X_REG_ENERGY_PA,
+	HLW811X_REG_ENERGY_PB,
+	HLW811X_REG_POWER_PA,
+	HLW811X_REG_POWER_PB,
+	HLW811X_REG_POWER_S,
+};
+
+/* raw holds the registers in the order of snapshot_regs */
+static hlw811x_error_t convert_snapshot(struct hlw811x *self,
+		const uint32_t *raw, hlw811x_channel_t ch,
+		struct hlw811x_snapshot *snapshot)
+{
+	hlw811x_error_t err;
+
+	if ((err = calc_rms(self, HLW811X_CHANNEL_A, (int32_t)raw[2],
+					&snapshot->rms.A))
+			!= HLW811X_ERROR_NONE ||
+			(err = calc_rms(self, HLW811X_CHANNEL_B,
+					(int32_t)raw[3], &snapshot->rms.B))
+			!= HLW811X_ERROR_NONE ||
+			(err = calc_rms(self, HLW811X_CHANNEL_U,
+					(int32_t)raw[4], &snapshot->rms.U))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	snapshot->power.A = calc_power(self, HLW811X_CHANNEL_A,
+			(int32_t)raw[8], ch);
+	snapshot->power.B = calc_power(self, HLW811X_CHANNEL_B,
+			(int32_t)raw[9], ch);
+	snapshot->power.S = calc_power(self, HLW811X_CHANNEL_U,
+			(int32_t)raw[10], ch);
+	snapshot->energy.A = calc_energy(self, HLW811X_CHANNEL_A,
+			(int32_t)raw[6]);
+	snapshot->energy.B = calc_energy(self, HLW811X_CHANNEL_B,
+			(int32_t)raw[7]);
+	snapshot->power_factor = calc_power_factor((int32_t)raw[5]);
+	snapshot->frequency = calc_frequency((uint16_t)raw[1]);
+	snapshot->channel = ch;
+	/* channel B reads the temperature instead, with no extra read */
+	snapshot->temperature = self->b_mode_known &&
+		self->b_mode == HLW811X_B_MODE_TEMPERATURE?
+		calc_temperature((int32_t)raw[3]) : HLW811X_TEMPERATURE_NONE;
+
+	/* pick the angle scale of the nearest nominal line frequency */
+	calc_phase_angle((uint16_t)raw[0], snapshot->frequency > 5500?
+			HLW811X_LINE_FREQ_60HZ : HLW811X_LINE_FREQ_50HZ,
+			&snapshot->phase_angle);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_read_snapshot(struct hlw811x *self,
+		struct hlw811x_snapshot *snapshot)
+{
+	uint32_t raw[SNAPSHOT_REGS];
+	hlw811x_channel_t ch;
+	hlw811x_error_t err;
+
+	/* Read the raw values first and convert them afterward, so that all
+	 * the bus transactions are packed together. */
+	for (uint8_t i = 0; i < SNAPSHOT_REGS; i++) {
+		if ((err = read_regval(self, snapshot_regs[i], &raw[i]))
+				!= HLW811X_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	if ((err = read_current_channel(self, &ch)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	return convert_snapshot(self, raw, ch, snapshot);
+}
+
+static void on_snapshot_read(hlw811x_error_t err, hlw811x_reg_addr_t addr,
+		const uint8_t *data, size_t datalen, void *ctx);
+
+/* Submits the reads left as long as the queue has room */
+static hlw811x_error_t fill_snapshot(struct hlw811x *self)
+{
+	struct snapshot_job *job = &self->snapshot;
+	hlw811x_error_t err;
+
+	while (job->submitted < job->total) {
+		const hlw811x_reg_addr_t addr = job->submitted < SNAPSHOT_REGS?
+			snapshot_regs[job->submitted] :
+			HLW811X_REG_METER_STATUS;
+
+		if ((err = hlw811x_dev_submit_read(self, addr,
+				get_reg_width(addr), on_snapshot_read, self))
+				!= HLW811X_ERROR_NONE) {
+			/* the completion of a read in flight makes room */
+			return err == HLW811X_BUSY? HLW811X_ERROR_NONE : err;
+		}
+
+		job->submitted++;
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+static void finish_snapshot(struct hlw811x *self)
+{
+	struct snapshot_job *job = &self->snapshot;
+	struct hlw811x_snapshot snapshot = { 0, };
+	hlw811x_channel_t ch = self->mux.selected;
+	hlw811x_error_t err = job->err;
+
+	if (err == HLW811X_ERROR_NONE && job->total > SNAPSHOT_REGS) {
+		ch = (hlw811x_channel_t)(get_field(job->raw[SNAPSHOT_REGS],
+				HLW811X_METER_STATUS_CHA_SEL) + 1);
+		if (self->mux.enabled) {
+			self->mux.selected = ch;
+		}
+	}
+
+	if (err == HLW811X_ERROR_NONE) {
+		err = convert_snapshot(self, job->raw, ch, &snapshot);
+	}
+
+	/* before the callback, so that the callback may submit the next */
+	job->active = false;
+
+	(*job->cb)(err, &snapshot, job->cb_ctx);
+}
+
+static void on_snapshot_read(hlw811x_error_t err, hlw811x_reg_addr_t addr,
+		const uint8_t *data, size_t datalen, void *ctx)
+{
+	struct hlw811x *self = (struct hlw811x *)ctx;
+	struct snapshot_job *job = &self->snapshot;
+
+	(void)addr;
+
+	if (err == HLW811X_ERROR_NONE) {
+		job->raw[job->completed] =
+			decode_regval(data, (uint8_t)datalen);
+	} else if (job->err == HLW811X_ERROR_NONE) {
+		job->err = err;
+	}
+	job->completed++;
+
+	if (job->err == HLW811X_ERROR_NONE &&
+			(err = fill_snapshot(self)) != HLW811X_ERROR_NONE) {
+		job->err = err;
+	}
+
+	if (job->err != HLW811X_ERROR_NONE) {
+		/* wait only for the reads already submitted */
+		job->total = job->submitted;
+	}
+
+	if (job->completed == job->total) {
+		finish_snapshot(self);
+	}
+}
+
+hlw811x_error_t hlw811x_dev_submit_snapshot(struct hlw811x *self,
+		hlw811x_snapshot_cb_t cb, void *ctx)
+{
+	struct snapshot_job *job = &self->snapshot;
+	hlw811x_error_t err;
+
+	if (cb == NULL) {
+		HLW811X_ERROR("Invalid parameter: no callback");
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if (job->active) {
+		return HLW811X_BUSY;
+	}
+
+	*job = (struct snapshot_job) {
+		.cb = cb,
+		.cb_ctx = ctx,
+		.total = self->mux.enabled && self->mux.selected != 0?
+			SNAPSHOT_REGS : SNAPSHOT_READS_MAX,
+		.active = true,
+	};
+
+	err = fill_snapshot(self);
+
+	if (job->submitted == 0) {
+		job->active = false;
+		return err == HLW811X_ERROR_NONE? HLW811X_BUSY : err;
+	} else if (err != HLW811X_ERROR_NONE) {
+		/* reported through cb once the submitted ones complete */
+		job->err = err;
+		job->total = job->submitted;
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+static void diff_transport_stats(struct hlw811x_transport_stats *diff,
+		const struct hlw811x_transport_stats *before,
+		const struct hlw811x_transport_stats *after)
+{
+	*diff = (struct hlw811x_transport_stats) {
+		.retries = after->retries - before->retries,
+		.checksum_errors = after->checksum_errors
+			- before->checksum_errors,
+		.timeouts = after->timeouts - before->timeouts,
+		.resyncs = after->resyncs - before->resyncs,
+		.short_reads = after->short_reads - before->short_reads,
+		.failures = after->failures - before->failures,
+	};
+}
+
+static bool has_transport_errors(const struct hlw811x_transport_stats *stats)
+{
+	return stats->retries || stats->checksum_errors || stats->timeouts ||
+		stats->resyncs || stats->short_reads || stats->failures;
+}
+
+hlw811x_error_t hlw811x_agg_init(struct hlw811x_agg *agg,
+		struct hlw811x_agg_chip *chips, struct hlw811x *const *devs,
+		uint8_t n, hlw811x_clock_t clock, void *clock_ctx)
+{
+	if (agg == NULL || chips == NULL || devs == NULL || n == 0 ||
+			clock == NULL) {
+		HLW811X_ERROR("Invalid parameter: %u", n);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	for (uint8_t i = 0; i < n; i++) {
+		if (devs[i] == NULL) {
+			HLW811X_ERROR("No instance: %u", i);
+			return HLW811X_INVALID_PARAM;
+		}
+
+		chips[i] = (struct hlw811x_agg_chip) {
+			.dev = devs[i],
+			.agg = agg,
+		};
+	}
+
+	*agg = (struct hlw811x_agg) {
+		.chips = chips,
+		.n = n,
+		.clock = clock,
+		.clock_ctx = clock_ctx,
+		.round = 1,
+	};
+
+	return HLW811X_ERROR_NONE;
+}
+
+static void start_chip_read(struct hlw811x_agg_chip *chip, uint32_t now)
+{
+	chip->before = chip->dev->transport.stats;
+	chip->work.timestamp = now;
+}
+
+static void finish_chip_read(struct hlw811x_agg_chip *chip,
+		hlw811x_error_t err, const struct hlw811x_snapshot *snapshot)
+{
+	struct hlw811x_agg_sample *sample = &chip->work;
+
+	sample->err = err;
+	diff_transport_stats(&sample->errors, &chip->before,
+			&chip->dev->transport.stats);
+
+	if (err == HLW811X_ERROR_NONE) {
+		sample->snapshot = *snapshot;
+		sample->failures = 0;
+		sample->health = has_transport_errors(&sample->errors)?
+			HLW811X_CHIP_DEGRADED : HLW811X_CHIP_OK;
+	} else {
+		if (sample->failures < UINT16_MAX) {
+			sample->failures++;
+		}
+		sample->health = sample->failures >= HLW811X_AGG_OFFLINE_ROUNDS?
+			HLW811X_CHIP_OFFLINE : HLW811X_CHIP_FAILED;
+	}
+
+	chip->pending = false;
+	HLW811X_MEMORY_BARRIER(); /* complete the sample before marking it */
+	chip->round = chip->agg->round;
+}
+
+static void on_agg_snapshot(hlw811x_error_t err,
+		const struct hlw811x_snapshot *snapshot, void *ctx)
+{
+	finish_chip_read((struct hlw811x_agg_chip *)ctx, err, snapshot);
+}
+
+hlw811x_error_t hlw811x_agg_read_chip(struct hlw811x_agg *agg, uint8_t index)
+{
+	struct hlw811x_snapshot snapshot;
+	struct hlw811x_agg_chip *chip;
+	hlw811x_error_t err;
+
+	if (index >= agg->n) {
+		HLW811X_ERROR("Invalid index: %u", index);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	chip = &agg->chips[index];
+
+	if (chip->round == agg->round || chip->pending) {
+		return HLW811X_BUSY;
+	}
+
+	start_chip_read(chip, (*agg->clock)(agg->clock_ctx));
+	err = hlw811x_dev_read_snapshot(chip->dev, &snapshot);
+	finish_chip_read(chip, err, &snapshot);
+
+	return err;
+}
+
+hlw811x_error_t hlw811x_agg_publish(struct hlw811x_agg *agg)
+{
+	const uint32_t round = agg->round;
+	const struct hlw811x_agg_chip *ref = NULL;
+	uint32_t first;
+	int32_t earliest = 0;
+	int32_t latest = 0;
+
+	for (uint8_t i = 0; i < agg->n; i++) {
+		if (agg->chips[i].round != round) {
+			return HLW811X_BUSY;
+		}
+	}
+
+	HLW811X_MEMORY_BARRIER(); /* read the samples only after the marks */
+
+	/* A failed chip keeps the snapshot of a past round, so its read time
+	 * says nothing of the published. Align on the chips read only, or on
+	 * all the attempts if none is. */
+	for (uint8_t i = 0; i < agg->n && ref == NULL; i++) {
+		if (agg->chips[i].work.err == HLW811X_ERROR_NONE) {
+			ref = &agg->chips[i];
+		}
+	}
+	first = (ref? ref : &agg->chips[0])->work.timestamp;
+
+	for (uint8_t i = 0; i < agg->n; i++) {
+		struct hlw811x_agg_chip *chip = &agg->chips[i];
+		/* relative to the first chip, to survive the clock wrap */
+		const int32_t t = (int32_t)(chip->work.timestamp - first);
+
+		chip->published = chip->work;
+
+		if (ref && chip->work.err != HLW811X_ERROR_NONE) {
+			continue;
+		}
+
+		if (t < earliest) {
+			earliest = t;
+		}
+		if (t > latest) {
+			latest = t;
+		}
+	}
+
+	agg->timestamp = first + (uint32_t)earliest;
+	agg->skew = (uint32_t)(latest - earliest);
+
+	HLW811X_MEMORY_BARRIER(); /* publish the round before the next starts */
+	agg->round = round + 1;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_agg_step(struct hlw811x_agg *agg)
+{
+	const uint32_t now = (*agg->clock)(agg->clock_ctx);
+
+	for (uint8_t i = 0; i < agg->n; i++) {
+		struct hlw811x_agg_chip *chip = &agg->chips[i];
+		hlw811x_error_t err;
+
+		if (chip->round == agg->round) {
+			continue;
+		}
+
+		if (chip->pending) {
+			if (now - chip->work.timestamp
+					>= HLW811X_AGG_TIMEOUT_MS * 1000u) {
+				/* completes the snapshot with the error */
+				(void)hlw811x_dev_cancel_reads(chip->dev);
+			}
+			continue;
+		}
+
+		start_chip_read(chip, now);
+		chip->pending = true;
+
+		if ((err = hlw811x_dev_submit_snapshot(chip->dev,
+				on_agg_snapshot, chip)) == HLW811X_BUSY) {
+			/* the queue is taken by other reads, next step */
+			chip->pending = false;
+		} else if (err != HLW811X_ERROR_NONE) {
+			finish_chip_read(chip, err, NULL);
+		}
+	}
+
+	return hlw811x_agg_publish(agg);
+}
+
+hlw811x_error_t hlw811x_agg_get(const struct hlw811x_agg *agg, uint8_t index,
+		struct hlw811x_agg_sample *sample)
+{
+	if (index >= agg->n) {
+		HLW811X_ERROR("Invalid index: %u", index);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if (agg->round <= 1) {
+		return HLW811X_BUSY;
+	}
+
+	*sample = agg->chips[index].published;
+
+	return HLW811X_ERROR_NONE;
+}
+
+/* Inverse of scale() for a non-negative value. UINT64_MAX if the factor is
+ * not set or when the result does not fit. */
+static uint64_t unscale(const struct factor *f, uint32_t val)
+{
+	uint64_t q;
+	uint8_t shift;
+
+	if (f->mult == 0) {
+		return UINT64_MAX;
+	}
+
+	q = ((uint64_t)val << 31) / f->mult;
+
+	if (f->shift < 31) {
+		return q >> (31 - f->shift);
+	}
+
+	shift = (uint8_t)(f->shift - 31);
+
+	if (shift >= 32 || q > (UINT64_MAX >> shift)) {
+		return UINT64_MAX;
+	}
+
+	return q << shift;
+}
+
+hlw811x_error_t hlw811x_dev_set_threshold(struct hlw811x *self,
+		hlw811x_threshold_t type, int32_t milliunit)
+{
+	const struct factor *f;
+	hlw811x_reg_addr_t addr;
+	uint8_t shift = THRESHOLD_PEAK_SHIFT;
+	uint64_t count;
+
+	switch (type) {
+	case HLW811X_THRESHOLD_OVER_CURRENT_A:
+		addr = HLW811X_REG_THRESHOLD_IA;
+		f = &self->factors.rms[0];
+		break;
+	case HLW811X_THRESHOLD_OVER_CURRENT_B:
+		addr = HLW811X_REG_THRESHOLD_IB;
+		f = &self->factors.rms[1];
+		break;
+	case HLW811X_THRESHOLD_OVER_VOLTAGE:
+		addr = HLW811X_REG_THRESHOLD_VOL;
+		f = &self->factors.rms[2];
+		break;
+	case HLW811X_THRESHOLD_UNDER_VOLTAGE:
+		addr = HLW811X_REG_THRESHOLD_VOL_SAG;
+		f = &self->factors.rms[2];
+		break;
+	case HLW811X_THRESHOLD_OVERLOAD:
+		addr = HLW811X_REG_THRESHOLD_ACTIVE_POWER_OVERLOAD;
+		f = &self->factors.power[0];
+		shift = THRESHOLD_POWER_SHIFT;
+		break;
+	default:
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if (milliunit < 0) {
+		return HLW811X_INVALID_PARAM;
+	} else if (f->mult == 0) {
+		HLW811X_ERROR("No calibration to convert the threshold");
+		return HLW811X_INVALID_DATA;
+	}
+
+	count = unscale(f, (uint32_t)milliunit) >> shift;
+
+	if (count > UINT16_MAX) {
+		HLW811X_INFO("Threshold saturated: %d", milliunit);
+		count = UINT16_MAX;
+	}
+
+	return write_regval(self, addr, (uint32_t)count);
+}
+
+hlw811x_error_t hlw811x_dev_set_sag_period(struct hlw811x *self,
+		uint16_t half_cycles)
+{
+	return write_regval(self, HLW811X_REG_PERIOD_VOL_SAG, half_cycles);
+}
+
+hlw811x_error_t hlw811x_dev_start_event_capture(struct hlw811x *self,
+		hlw811x_intr_t ints, hlw811x_clock_t clock, void *ctx)
+{
+	if (clock == NULL || ints == 0 ||
+			((uint32_t)ints & ~(uint32_t)EVENT_INTR_MASK)) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	self->events = (struct event_log) {
+		.clock = clock,
+		.clock_ctx = ctx,
+		.ints = ints,
+	};
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_stop_event_capture(struct hlw811x *self)
+{
+	self->events.ints = 0;
+	return HLW811X_ERROR_NONE;
+}
+
+/* The peak, or the active power on overload, as the event was flagged */
+static hlw811x_error_t read_event_value(struct hlw811x *self,
+		hlw811x_intr_t flag, int32_t *value)
+{
+	hlw811x_error_t err;
+	hlw811x_reg_addr_t addr;
+	int32_t raw;
+	uint8_t i;
+
+	if (flag == HLW811X_INTR_OVERLOAD) {
+		if ((err = read_reg32(self, HLW811X_REG_POWER_PA, &raw))
+				== HLW811X_ERROR_NONE) {
+			*value = calc_power(self, HLW811X_CHANNEL_A, raw, 0);
+		}
+		return err;
+	}
+
+	if (flag == HLW811X_INTR_OVER_CURRENT_A) {
+		addr = HLW811X_REG_PEAK_IA;
+		i = 0;
+	} else if (flag == HLW811X_INTR_OVER_CURRENT_B) {
+		addr = HLW811X_REG_PEAK_IB;
+		i = 1;
+	} else {
+		addr = HLW811X_REG_PEAK_U;
+		i = 2;
+	}
+
+	if ((err = read_reg24(self, addr, &raw)) == HLW811X_ERROR_NONE) {
+		raw = fix_bit24_sign(raw);
+		scale(&self->factors.rms[i], &raw, value, 1);
+	}
+
+	return err;
+}
+
+hlw811x_error_t hlw811x_dev_capture_events(struct hlw811x *self,
+		hlw811x_intr_t ints)
+{
+	struct event_log *log = &self->events;
+	hlw811x_error_t first_err = HLW811X_ERROR_NONE;
+	uint32_t now;
+
+	if (!(ints & log->ints)) {
+		return HLW811X_ERROR_NONE;
+	}
+
+	now = (*log->clock)(log->clock_ctx);
+
+	for (uint32_t pending = (uint32_t)(ints & log->ints);
+			pending; pending &= pending - 1) {
+		const hlw811x_intr_t flag = (hlw811x_intr_t)
+			(1u << count_trailing_zeros(pending));
+		struct hlw811x_event *event;
+		hlw811x_error_t err;
+		int32_t value = 0;
+
+		/* before the read, so that a dropped event costs no transfer */
+		if (log->count >= HLW811X_EVENT_LOG_LEN) {
+			log->dropped++;
+			continue;
+		}
+
+		/* the flag is cleared already, so the event is logged with the
+		 * error rather than lost */
+		if ((err = read_event_value(self, flag, &value))
+				!= HLW811X_ERROR_NONE) {
+			value = 0;
+			if (first_err == HLW811X_ERROR_NONE) {
+				first_err = err;
+			}
+		}
+
+		event = &log->events[(log->head + log->count)
+				% HLW811X_EVENT_LOG_LEN];
+		*event = (struct hlw811x_event) {
+			.timestamp = now,
+			.type = flag,
+			.value = value,
+			.err = err,
+		};
+		log->count++;
+	}
+
+	return first_err;
+}
+
+size_t hlw811x_dev_drain_events(struct hlw811x *self,
+		struct hlw811x_event *events, size_t n)
+{
+	struct event_log *log = &self->events;
+	size_t i;
+
+	for (i = 0; i < n && log->count > 0; i++) {
+		events[i] = log->events[log->head];
+		log->head = (uint8_t)((log->head + 1) % HLW811X_EVENT_LOG_LEN);
+		log->count--;
+	}
+
+	return i;
+}
+
+uint32_t hlw811x_dev_get_dropped_events(struct hlw811x *self)
+{
+	return self->events.dropped;
+}
+
+/* Update period of the measurement registers, which is 2^20 MCLK cycles at
+ * HLW811X_DATA_UPDATE_FREQ_HZ_3_4 and halves at each step. */
+static uint32_t get_update_period_us(hlw811x_data_update_freq_t freq)
+{
+	return (uint32_t)((1000000ull << (20 - (unsigned int)freq))
+			/ HLW811X_MCLK);
+}
+
+static uint8_t get_poll_periods(const struct poll_sched *sched,
+		uint16_t interval_ms)
+{
+	const uint32_t periods = ((uint32_t)interval_ms * 1000
+			+ sched->period_us / 2) / sched->period_us;
+
+	if (periods == 0) {
+		return 1;
+	} else if (periods > UINT8_MAX) {
+		return UINT8_MAX;
+	}
+
+	return (uint8_t)periods;
+}
+
+/* True if the temperature is read by switching channel B over to it. */
+static bool is_temp_interleaved(const struct hlw811x *self)
+{
+	return self->poll.temp_switched ||
+		self->b_mode != HLW811X_B_MODE_TEMPERATURE;
+}
+
+/* Register transfers a quantity takes. The apparent power needs the current
+ * channel as well, unless the channel mux knows it. An interleaved
+ * temperature takes a read-modify-write of METER_CTRL_2 for the switch,
+ * whose read is saved by the shadow, and the reading on the way back. */
+static uint8_t get_poll_cost(const struct hlw811x *self,
+		hlw811x_quantity_t qty)
+{
+	const uint8_t mode_switch = self->shadow.enabled? 1 : 2;
+
+	if (qty == HLW811X_QTY_POWER_S &&
+			!(self->mux.enabled && self->mux.selected != 0)) {
+		return 2;
+	} else if (qty == HLW811X_QTY_TEMPERATURE &&
+			is_temp_interleaved(self)) {
+		return (uint8_t)(mode_switch + self->poll.temp_switched);
+	}
+
+	return 1;
+}
+
+/* Channel B is not available for current while switched to the temperature
+ * or settling, and the temperature is not ready until it settles. */
+static bool is_poll_held(const struct poll_sched *sched,
+		hlw811x_quantity_t qty)
+{
+	if (qty == HLW811X_QTY_RMS_B || qty == HLW811X_QTY_POWER_B) {
+		return sched->temp_switched || sched->temp_settle != 0;
+	} else if (qty == HLW811X_QTY_TEMPERATURE) {
+		return sched->temp_settle != 0;
+	}
+
+	return false;
+}
+
+/* HLW811X_BUSY when channel B has just been switched to the temperature,
+ * to be read once it settles. */
+static hlw811x_error_t poll_temperature(struct hlw811x *self, int32_t *val)
+{
+	struct poll_sched *sched = &self->poll;
+	hlw811x_error_t err;
+	int32_t raw;
+
+	if (!is_temp_interleaved(self)) {
+		return hlw811x_dev_get_temperature(self, val);
+	}
+
+	if (!sched->temp_switched) {
+		if ((err = set_b_mode(self, HLW811X_B_MODE_TEMPERATURE))
+				!= HLW811X_ERROR_NONE) {
+			return err;
+		}
+		sched->temp_switched = true;
+		sched->temp_settle = HLW811X_TEMP_SETTLE_PERIODS;
+		return HLW811X_BUSY;
+	}
+
+	if ((err = read_reg24(self, HLW811X_REG_RMS_IB, &raw))
+			!= HLW811X_ERROR_NONE ||
+			(err = set_b_mode(self, HLW811X_B_MODE_NORMAL))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	sched->temp_switched = false;
+	sched->temp_settle = HLW811X_TEMP_SETTLE_PERIODS;
+	*val = calc_temperature(raw);
+
+	return HLW811X_ERROR_NONE;
+}
+
+/* Channel B goes back to the current if left on the temperature. */
+static hlw811x_error_t restore_b_mode(struct hlw811x *self)
+{
+	hlw811x_error_t err;
+
+	if (!self->poll.temp_switched) {
+		return HLW811X_ERROR_NONE;
+	}
+
+	if ((err = set_b_mode(self, HLW811X_B_MODE_NORMAL))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	self->poll.temp_switched = false;
+
+	return HLW811X_ERROR_NONE;
+}
+
+static hlw811x_error_t read_quantity(struct hlw811x *self,
+		hlw811x_quantity_t qty, int32_t *val)
+{
+	hlw811x_line_freq_t freq;
+	hlw811x_error_t err;
+
+	switch (qty) {
+	case HLW811X_QTY_RMS_A:
+		return hlw811x_dev_get_rms(self, HLW811X_CHANNEL_A, val);
+	case HLW811X_QTY_RMS_B:
+		return hlw811x_dev_get_rms(self, HLW811X_CHANNEL_B, val);
+	case HLW811X_QTY_RMS_U:
+		return hlw811x_dev_get_rms(self, HLW811X_CHANNEL_U, val);
+	case HLW811X_QTY_POWER_A:
+		return hlw811x_dev_get_power(self, HLW811X_CHANNEL_A, val);
+	case HLW811X_QTY_POWER_B:
+		return hlw811x_dev_get_power(self, HLW811X_CHANNEL_B, val);
+	case HLW811X_QTY_POWER_S:
+		return hlw811x_dev_get_power(self, HLW811X_CHANNEL_U, val);
+	case HLW811X_QTY_ENERGY_A:
+		return hlw811x_dev_get_energy(self, HLW811X_CHANNEL_A, val);
+	case HLW811X_QTY_ENERGY_B:
+		return hlw811x_dev_get_energy(self, HLW811X_CHANNEL_B, val);
+	case HLW811X_QTY_POWER_FACTOR:
+		return hlw811x_dev_get_power_factor(self, val);
+	case HLW811X_QTY_FREQUENCY:
+		if ((err = hlw811x_dev_get_frequency(self, val))
+				== HLW811X_ERROR_NONE) {
+			self->poll.centihertz = *val;
+		}
+		return err;
+	case HLW811X_QTY_PHASE_ANGLE:
+		freq = self->poll.centihertz > 5500?
+			HLW811X_LINE_FREQ_60HZ : HLW811X_LINE_FREQ_50HZ;
+		return hlw811x_dev_get_phase_angle(self, val, freq);
+	case HLW811X_QTY_TEMPERATURE:
+		return poll_temperature(self, val);
+	case HLW811X_QTY_MAX:
+	default:
+		return HLW811X_INVALID_PARAM;
+	}
+}
+
+/* The due entry of the highest priority, the lowest quantity first on a tie.
+ * HLW811X_QTY_MAX if none is left. */
+static hlw811x_quantity_t pick_due(const struct poll_sched *sched,
+		uint32_t served)
+{
+	hlw811x_quantity_t pick = HLW811X_QTY_MAX;
+
+	for (uint8_t i = 0; i < HLW811X_QTY_MAX; i++) {
+		const struct poll_entry *e = &sched->entries[i];
+
+		if (e->interval_ms == 0 || e->countdown != 0 ||
+				(served & (1u << i)) ||
+				is_poll_held(sched, (hlw811x_quantity_t)i)) {
+			continue;
+		}
+		if (pick == HLW811X_QTY_MAX ||
+				e->priority > sched->entries[pick].priority) {
+			pick = (hlw811x_quantity_t)i;
+		}
+	}
+
+	return pick;
+}
+
+hlw811x_error_t hlw811x_dev_add_poll(struct hlw811x *self,
+		hlw811x_quantity_t qty, uint16_t interval_ms, uint8_t priority)
+{
+	struct poll_sched *sched = &self->poll;
+
+	if ((unsigned int)qty >= HLW811X_QTY_MAX || interval_ms == 0) {
+		return HLW811X_INVALID_PARAM;
+	} else if (qty == HLW811X_QTY_TEMPERATURE && !TEMP_FIT_DEFINED) {
+		return HLW811X_NOT_IMPLEMENTED;
+	}
+
+	sched->entries[qty] = (struct poll_entry) {
+		.interval_ms = interval_ms,
+		.priority = priority,
+		.periods = sched->period_us?
+			get_poll_periods(sched, interval_ms) : 1,
+	};
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_remove_poll(struct hlw811x *self,
+		hlw811x_quantity_t qty)
+{
+	if ((unsigned int)qty >= HLW811X_QTY_MAX) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	self->poll.entries[qty].interval_ms = 0;
+
+	if (qty == HLW811X_QTY_TEMPERATURE) {
+		return restore_b_mode(self);
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_start_poll_scheduler(struct hlw811x *self,
+		hlw811x_clock_t clock, void *clock_ctx, uint8_t budget,
+		hlw811x_poll_cb_t cb, void *cb_ctx)
+{
+	struct poll_sched *sched = &self->poll;
+	hlw811x_data_update_freq_t freq;
+	hlw811x_error_t err;
+	uint32_t reg;
+	uint32_t val;
+
+	if (clock == NULL || cb == NULL) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	/* read once here, so that the periods and the mode of channel B are
+	 * known without a read */
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL_2, &reg))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	val = get_field(reg, HLW811X_METER_CTRL_2_DUP);
+	freq = (hlw811x_data_update_freq_t)val;
+	val = get_field(reg, HLW811X_METER_CTRL_2_CHS_IB);
+	self->b_mode = (hlw811x_channel_b_mode_t)val;
+	self->b_mode_known = true;
+
+	sched->clock = clock;
+	sched->clock_ctx = clock_ctx;
+	sched->cb = cb;
+	sched->cb_ctx = cb_ctx;
+	sched->budget = budget;
+	sched->period_us = get_update_period_us(freq);
+	sched->next = (*clock)(clock_ctx);
+	sched->temp_settle = 0;
+	sched->running = true;
+
+	for (uint8_t i = 0; i < HLW811X_QTY_MAX; i++) {
+		struct poll_entry *e = &sched->entries[i];
+		e->periods = get_poll_periods(sched, e->interval_ms);
+		e->countdown = 0;
+	}
+
+	HLW811X_INFO("Polling every %uus", sched->period_us);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_stop_poll_scheduler(struct hlw811x *self)
+{
+	self->poll.running = false;
+	return restore_b_mode(self);
+}
+
+hlw811x_error_t hlw811x_dev_sync_poll_scheduler(struct hlw811x *self)
+{
+	struct poll_sched *sched = &self->poll;
+
+	if (!sched->running) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	sched->next = (*sched->clock)(sched->clock_ctx);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_run_poll_scheduler(struct hlw811x *self)
+{
+	struct poll_sched *sched = &self->poll;
+	hlw811x_quantity_t qty;
+	hlw811x_error_t err;
+	uint32_t elapsed;
+	uint32_t periods;
+	uint32_t served = 0;
+	uint8_t budget;
+
+	if (!sched->running) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	elapsed = (*sched->clock)(sched->clock_ctx) - sched->next;
+
+	if ((int32_t)elapsed < 0) {
+		return HLW811X_ERROR_NONE; /* this period is served already */
+	}
+
+	/* keep the grid the periods started on, even over missed ones */
+	periods = elapsed / sched->period_us + 1;
+	sched->next += periods * sched->period_us;
+	sched->stats.periods++;
+	sched->stats.missed += periods - 1;
+
+	for (uint8_t i = 0; i < HLW811X_QTY_MAX; i++) {
+		struct poll_entry *e = &sched->entries[i];
+		e->countdown = (uint8_t)(e->countdown > periods?
+				e->countdown - periods : 0);
+	}
+
+	sched->temp_settle = (uint8_t)(sched->temp_settle > periods?
+			sched->temp_settle - periods : 0);
+
+	budget = sched->budget? sched->budget : UINT8_MAX;
+
+	while ((qty = pick_due(sched, served)) != HLW811X_QTY_MAX) {
+		struct poll_entry *e = &sched->entries[qty];
+		const uint8_t cost = get_poll_cost(self, qty);
+		int32_t val;
+
+		served |= 1u << qty;
+
+		/* shed the rest, which stay due for the next period */
+		if (cost > budget) {
+			sched->stats.shed++;
+			continue;
+		}
+
+		if ((err = read_quantity(self, qty, &val))
+				!= HLW811X_ERROR_NONE && err != HLW811X_BUSY) {
+			return err;
+		}
+
+		budget = (uint8_t)(budget - cost);
+		sched->stats.reads += cost;
+
+		if (err == HLW811X_BUSY) { /* stays due, with nothing read */
+			continue;
+		}
+
+		e->countdown = e->periods;
+
+		(*sched->cb)(qty, val, sched->cb_ctx);
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_poll_stats(struct hlw811x *self,
+		struct hlw811x_poll_stats *stats)
+{
+	*stats = self->poll.stats;
+	return HLW811X_ERROR_NONE;
+}
+
+/* Producer side of the ring. Only the producer writes head and dropped. */
+static bool push_wave(struct hlw811x_wave_ring *ring,
+		const struct hlw811x_wave_sample *sample)
+{
+	const uint32_t head = ring->head;
+
+	if (head - ring->tail >= ring->capacity) {
+		ring->dropped++;
+		return false;
+	}
+
+	ring->buf[head & (ring->capacity - 1)] = *sample;
+	HLW811X_MEMORY_BARRIER(); /* publish the sample before the index */
+	ring->head = head + 1;
+
+	return true;
+}
+
+hlw811x_error_t hlw811x_wave_ring_init(struct hlw811x_wave_ring *ring,
+		struct hlw811x_wave_sample *buf, uint32_t capacity)
+{
+	if (ring == NULL || buf == NULL ||
+			capacity == 0 || (capacity & (capacity - 1)) != 0) {
+		HLW811X_ERROR("Invalid ring: %u", capacity);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	*ring = (struct hlw811x_wave_ring) {
+		.buf = buf,
+		.capacity = capacity,
+	};
+
+	return HLW811X_ERROR_NONE;
+}
+
+bool hlw811x_wave_ring_pop(struct hlw811x_wave_ring *ring,
+		struct hlw811x_wave_sample *sample)
+{
+	const uint32_t tail = ring->tail;
+
+	if (ring->head == tail) {
+		return false;
+	}
+
+	HLW811X_MEMORY_BARRIER(); /* read the sample only after the index */
+	*sample = ring->buf[tail & (ring->capacity - 1)];
+	HLW811X_MEMORY_BARRIER(); /* done with the slot before releasing it */
+	ring->tail = tail + 1;
+
+	return true;
+}
+
+hlw811x_error_t hlw811x_dev_start_waveform_stream(struct hlw811x *self,
+		hlw811x_channel_t channels, struct hlw811x_wave_ring *ring)
+{
+	if (ring == NULL || ring->buf == NULL ||
+			(channels & HLW811X_CHANNEL_ALL) == 0 ||
+			(channels & ~HLW811X_CHANNEL_ALL) != 0) {
+		HLW811X_ERROR("Invalid parameter: %x", channels);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	self->wave_channels = channels;
+	self->wave_ring = ring;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_stop_waveform_stream(struct hlw811x *self)
+{
+	self->wave_ring = NULL;
+	self->wave_channels = 0;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_sample_waveform(struct hlw811x *self)
+{
+	const struct {
+		hlw811x_channel_t channel;
+		hlw811x_reg_addr_t addr;
+	} waves[] = {
+		{ HLW811X_CHANNEL_A, HLW811X_REG_WAVE_IA },
+		{ HLW811X_CHANNEL_B, HLW811X_REG_WAVE_IB },
+		{ HLW811X_CHANNEL_U, HLW811X_REG_WAVE_U },
+	};
+	struct hlw811x_wave_sample sample = { 0, };
+	int32_t *vals[] = { &sample.IA, &sample.IB, &sample.U };
+	hlw811x_error_t err;
+
+	if (self->wave_ring == NULL) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	for (size_t i = 0; i < sizeof(waves) / sizeof(waves[0]); i++) {
+		if (!(self->wave_channels & waves[i].channel)) {
+			continue;
+		}
+
+		if ((err = read_reg24(self, waves[i].addr, vals[i]))
+				!= HLW811X_ERROR_NONE) {
+			return err;
+		}
+
+		*vals[i] = fix_bit24_sign(*vals[i]);
+	}
+
+	if (!push_wave(self->wave_ring, &sample)) {
+		return HLW811X_BUFFER_TOO_SMALL;
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+/* (counts * mult) >> shift without overflowing 64 bits for any counts. */
+static uint64_t scale_u64(const struct factor *f, uint64_t counts)
+{
+	const uint64_t q = counts >> f->shift;
+	const uint64_t r = counts & ((1ull << f->shift) - 1);
+	uint64_t frac;
+
+	if (f->shift <= 32) {
+		frac = (r * f->mult) >> f->shift;
+	} else {
+		const uint64_t hi = (r >> 32) * f->mult;
+		const uint64_t lo = ((r & 0xFFFFFFFFu) * f->mult) >> 32;
+		frac = (hi + lo) >> (f->shift - 32);
+	}
+
+	return q * f->mult + frac;
+}
+
+static void accumulate_energy(struct energy_acc *acc, uint32_t raw,
+		bool cleared_on_read, bool overflowed)
+{
+	const bool wrapped = !cleared_on_read && acc->primed && raw < acc->last;
+	uint64_t delta;
+
+	if (cleared_on_read) {
+		/* every read starts the register over from zero */
+		delta = raw;
+	} else if (!acc->primed) {
+		delta = 0; /* nothing to compare with yet */
+	} else {
+		delta = (raw - acc->last) & (ENERGY_REG_RANGE - 1);
+	}
+
+	/* a wrap that brought the register back past the last value is
+	 * visible only through the overflow interrupt. A flag still given at
+	 * the next poll is the same wrap, as IF holds it until RIF is read.
+	 * The flags are read ahead of the register, so a wrap in between is
+	 * counted by the modular difference and flagged only at the next
+	 * poll. */
+	if (overflowed && !acc->overflow_held && !wrapped &&
+			!acc->wrap_unflagged && (cleared_on_read ||
+					acc->primed)) {
+		delta += ENERGY_REG_RANGE;
+	}
+
+	acc->wrap_unflagged = wrapped && !overflowed;
+	acc->overflow_held = overflowed;
+	acc->total += delta;
+	acc->last = cleared_on_read? 0 : raw;
+	acc->primed = true;
+}
+
+hlw811x_error_t hlw811x_dev_update_energy(struct hlw811x *self,
+		hlw811x_intr_t ints)
+{
+	const hlw811x_intr_t overflow[] = {
+		HLW811X_INTR_ACTIVE_POWER_OVERFLOW_A,
+		HLW811X_INTR_ACTIVE_POWER_OVERFLOW_B,
+	};
+	const hlw811x_reg_addr_t addr[] = {
+		HLW811X_REG_ENERGY_PA,
+		HLW811X_REG_ENERGY_PB,
+	};
+	hlw811x_error_t err;
+	uint32_t meter_ctrl_2;
+	int32_t raw[2];
+
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL_2, &meter_ctrl_2))
+			!= HLW811X_ERROR_NONE ||
+			(err = read_reg24(self, addr[0], &raw[0]))
+			!= HLW811X_ERROR_NONE ||
+			(err = read_reg24(self, addr[1], &raw[1]))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	for (size_t i = 0; i < 2; i++) {
+		/* EPA_CA and EPA_CB read 0 when the clearance is enabled */
+		const bool cleared = !get_field(meter_ctrl_2, i == 0 ?
+				HLW811X_METER_CTRL_2_EPA_CA :
+				HLW811X_METER_CTRL_2_EPA_CB);
+		accumulate_energy(&self->energy[i], (uint32_t)raw[i], cleared,
+				(ints & overflow[i]) != 0);
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_energy_total(struct hlw811x *self,
+		hlw811x_channel_t channel, uint64_t *Wh)
+{
+	if (channel != HLW811X_CHANNEL_A && channel != HLW811X_CHANNEL_B) {
+		HLW811X_ERROR("Invalid channel: %d", channel);
+		return HLW811X_INVALID_PARAM;
+	}
+
+	const uint8_t i = get_channel_index(channel);
+	*Wh = scale_u64(&self->factors.energy[i], self->energy[i].total);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_energy_delta(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t *Wh)
+{
+	hlw811x_error_t err;
+	uint64_t total;
+
+	if ((err = hlw811x_dev_get_energy_total(self, channel, &total))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	struct energy_acc *acc = &self->energy[get_channel_index(channel)];
+	/* the fraction of a Wh stays in the total, to be handed out once it
+	 * adds up */
+	*Wh = (int32_t)(total - acc->billed);
+	acc->billed = total;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_select_channel(struct hlw811x *self,
+		hlw811x_channel_t channel)
+{
+	return select_channel(self, channel);
+}
+
+hlw811x_error_t hlw811x_dev_read_current_channel(struct hlw811x *self,
+		hlw811x_channel_t *channel)
+{
+	return read_current_channel(self, channel);
+}
+
+hlw811x_error_t hlw811x_dev_start_channel_mux(struct hlw811x *self,
+		hlw811x_clock_t clock, void *ctx, uint16_t settle_ms)
+{
+	if (clock == NULL) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	self->mux = (struct chan_mux) {
+		.clock = clock,
+		.clock_ctx = ctx,
+		.settle_us = (uint32_t)settle_ms * 1000,
+		.enabled = true,
+	};
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_stop_channel_mux(struct hlw811x *self)
+{
+	self->mux.enabled = false;
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_read_channel_group(struct hlw811x *self,
+		hlw811x_channel_t channel, struct hlw811x_channel_group *group)
+{
+	hlw811x_error_t err;
+
+	if (!self->mux.enabled) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if ((err = select_channel(self, channel)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if (is_channel_settling(&self->mux)) {
+		return HLW811X_BUSY;
+	}
+
+	if ((err = hlw811x_dev_get_power(self, HLW811X_CHANNEL_U,
+			&group->power_S)) != HLW811X_ERROR_NONE ||
+			(err = hlw811x_dev_get_power_factor(self,
+					&group->power_factor))
+			!= HLW811X_ERROR_NONE ||
+			(err = hlw811x_dev_get_power(self, channel,
+					&group->power)) != HLW811X_ERROR_NONE ||
+			(err = hlw811x_dev_get_rms(self, channel,
+					&group->current))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	group->channel = channel;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_get_channel_mux_stats(struct hlw811x *self,
+		struct hlw811x_channel_mux_stats *stats)
+{
+	*stats = self->mux.stats;
+	return HLW811X_ERROR_NONE;
+}
+
+static uint16_t calc_coeff_chksum(const struct hlw811x_coeff *coeff)
+{
+	return (uint16_t)~(0xFFFFu
+			+ coeff->rms.A + coeff->rms.B + coeff->rms.U
+			+ coeff->power.A + coeff->power.B + coeff->power.S
+			+ coeff->energy.A + coeff->energy.B);
+}
+
+hlw811x_error_t hlw811x_dev_read_coeff(struct hlw811x *self,
+		struct hlw811x_coeff *coeff)
+{
+	hlw811x_error_t err;
+	uint16_t chksum;
+
+	err = read_reg16(self, HLW811X_REG_PULSE_FREQ, &coeff->hfconst);
+	err |= read_reg16(self, HLW811X_REG_RMS_IA_COEFF, &coeff->rms.A);
+	err |= read_reg16(self, HLW811X_REG_RMS_IB_COEFF, &coeff->rms.B);
+	err |= read_reg16(self, HLW811X_REG_RMS_U_COEFF, &coeff->rms.U);
+	err |= read_reg16(self, HLW811X_REG_POWER_A_COEFF, &coeff->power.A);
+	err |= read_reg16(self, HLW811X_REG_POWER_B_COEFF, &coeff->power.B);
+	err |= read_reg16(self, HLW811X_REG_POWER_S_COEFF, &coeff->power.S);
+	err |= read_reg16(self, HLW811X_REG_ENERGY_A_COEFF, &coeff->energy.A);
+	err |= read_reg16(self, HLW811X_REG_ENERGY_B_COEFF, &coeff->energy.B);
+
+	if (err != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if ((err = read_reg16(self, HLW811X_REG_COEFF_CHKSUM, &chksum))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if (chksum != calc_coeff_chksum(coeff)) {
+		return HLW811X_CHECKSUM_MISMATCH;
+	}
+
+	memcpy(&self->coeff, coeff, sizeof(self->coeff));
+	update_factors(self);
+
+	HLW811X_DEBUG("Coefficients: HFConst=%d, "
+			"RMS_A=%d, RMS_B=%d, RMS_U=%d, "
+			"Power_A=%d, Power_B=%d, Power_S=%d, "
+			"Energy_A=%d, Energy_B=%d",
+			coeff->hfconst,
+			coeff->rms.A, coeff->rms.B, coeff->rms.U,
+			coeff->power.A, coeff->power.B, coeff->power.S,
+			coeff->energy.A, coeff->energy.B);
+
+	return err;
+}
+
+void hlw811x_dev_set_resistor_ratio(struct hlw811x *self,
+		const struct hlw811x_resistor_ratio *ratio)
+{
+	memcpy(&self->ratio, ratio, sizeof(self->ratio));
+	update_factors(self);
+	HLW811X_INFO("Resistor ratio set: K1_A=%d, K1_B=%d, K2=%d",
+			ratio->K1_A, ratio->K1_B, ratio->K2);
+}
+
+void hlw811x_dev_get_resistor_ratio(struct hlw811x *self,
+		struct hlw811x_resistor_ratio *ratio)
+{
+	memcpy(ratio, &self->ratio, sizeof(self->ratio));
+}
+
+/* CRC-16/CCITT-FALSE */
+static uint16_t calc_crc16(const uint8_t *data, size_t datalen)
+{
+	uint16_t crc = 0xFFFFu;
+
+	for (size_t i = 0; i < datalen; i++) {
+		crc ^= (uint16_t)(data[i] << 8);
+		for (int j = 0; j < 8; j++) {
+			if (crc & 0x8000u) {
+				crc = (uint16_t)((crc << 1) ^ 0x1021u);
+			} else {
+				crc = (uint16_t)(crc << 1);
+			}
+		}
+	}
+
+	return crc;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t val)
+{
+	*p++ = (uint8_t)(val >> 8);
+	*p++ = (uint8_t)val;
+	return p;
+}
+
+static const uint8_t *get_u16(const uint8_t *p, uint16_t *val)
+{
+	*val = (uint16_t)((p[0] << 8) | p[1]);
+	return p + 2;
+}
+
+static uint8_t *put_float(uint8_t *p, float val)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &val, sizeof(bits));
+	p = put_u16(p, (uint16_t)(bits >> 16));
+	return put_u16(p, (uint16_t)bits);
+}
+
+static const uint8_t *get_float(const uint8_t *p, float *val)
+{
+	uint16_t hi;
+	uint16_t lo;
+	uint32_t bits;
+
+	p = get_u16(get_u16(p, &hi), &lo);
+	bits = ((uint32_t)hi << 16) | lo;
+	memcpy(val, &bits, sizeof(*val));
+
+	return p;
+}
+
+/* Blob layout, all big-endian:
+ *   magic(2) version(1) HFConst(2) the 8 coefficients(16) COEFF_CHKSUM(2)
+ *   K1_A K1_B K2(12) PGA A U B(3) CRC-16 of the preceding bytes(2) */
+#define CALIB_MAGIC		0x4843u /* "HC" */
+
+hlw811x_error_t hlw811x_dev_export_calib(struct hlw811x *self,
+		uint8_t *buf, size_t bufsize, size_t *len)
+{
+	const struct hlw811x_coeff *coeff = &self->coeff;
+	uint8_t *p = buf;
+
+	if (bufsize < HLW811X_CALIB_BLOB_SIZE) {
+		HLW811X_ERROR("Buffer size is too small: %d", bufsize);
+		return HLW811X_BUFFER_TOO_SMALL;
+	}
+
+	p = put_u16(p, CALIB_MAGIC);
+	*p++ = HLW811X_CALIB_BLOB_VERSION;
+	p = put_u16(p, coeff->hfconst);
+	p = put_u16(p, coeff->rms.A);
+	p = put_u16(p, coeff->rms.B);
+	p = put_u16(p, coeff->rms.U);
+	p = put_u16(p, coeff->power.A);
+	p = put_u16(p, coeff->power.B);
+	p = put_u16(p, coeff->power.S);
+	p = put_u16(p, coeff->energy.A);
+	p = put_u16(p, coeff->energy.B);
+	p = put_u16(p, calc_coeff_chksum(coeff));
+	p = put_float(p, self->ratio.K1_A);
+	p = put_float(p, self->ratio.K1_B);
+	p = put_float(p, self->ratio.K2);
+	*p++ = (uint8_t)self->pga.A;
+	*p++ = (uint8_t)self->pga.U;
+	*p++ = (uint8_t)self->pga.B;
+	p = put_u16(p, calc_crc16(buf, (size_t)(p - buf)));
+
+	if (len != NULL) {
+		*len = (size_t)(p - buf);
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_import_calib(struct hlw811x *self,
+		const uint8_t *blob, size_t bloblen, bool *refreshed)
+{
+	struct hlw811x_coeff coeff;
+	struct hlw811x_resistor_ratio ratio;
+	struct hlw811x_pga pga;
+	uint16_t stored;
+	uint16_t chksum;
+	uint16_t word;
+	const uint8_t *p = blob;
+	hlw811x_error_t err;
+
+	if (refreshed != NULL) {
+		*refreshed = false;
+	}
+
+	if (bloblen != HLW811X_CALIB_BLOB_SIZE) {
+		HLW811X_ERROR("Invalid blob size: %d", bloblen);
+		return HLW811X_INVALID_DATA;
+	}
+
+	get_u16(&blob[bloblen - 2], &word);
+	if (word != calc_crc16(blob, bloblen - 2)) {
+		HLW811X_ERROR("Blob corrupted");
+		return HLW811X_INVALID_DATA;
+	}
+
+	p = get_u16(p, &word);
+	if (word != CALIB_MAGIC || *p++ != HLW811X_CALIB_BLOB_VERSION) {
+		HLW811X_ERROR("Unknown blob");
+		return HLW811X_INVALID_DATA;
+	}
+
+	p = get_u16(p, &coeff.hfconst);
+	p = get_u16(p, &coeff.rms.A);
+	p = get_u16(p, &coeff.rms.B);
+	p = get_u16(p, &coeff.rms.U);
+	p = get_u16(p, &coeff.power.A);
+	p = get_u16(p, &coeff.power.B);
+	p = get_u16(p, &coeff.power.S);
+	p = get_u16(p, &coeff.energy.A);
+	p = get_u16(p, &coeff.energy.B);
+	p = get_u16(p, &stored);
+	p = get_float(p, &ratio.K1_A);
+	p = get_float(p, &ratio.K1_B);
+	p = get_float(p, &ratio.K2);
+	pga.A = (hlw811x_pga_gain_t)p[0];
+	pga.U = (hlw811x_pga_gain_t)p[1];
+	pga.B = (hlw811x_pga_gain_t)p[2];
+
+	if ((err = read_reg16(self, HLW811X_REG_COEFF_CHKSUM, &chksum))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	memcpy(&self->ratio, &ratio, sizeof(self->ratio));
+	memcpy(&self->pga, &pga, sizeof(self->pga));
+
+	if (chksum != stored) {
+		HLW811X_INFO("Coefficients changed. Reading them again");
+		if (refreshed != NULL) {
+			*refreshed = true;
+		}
+		return hlw811x_dev_read_coeff(self, &coeff);
+	}
+
+	memcpy(&self->coeff, &coeff, sizeof(self->coeff));
+	update_factors(self);
+
+	return HLW811X_ERROR_NONE;
+}
+
+/* Blob layout, all big-endian:
+ *   magic(2) version(1) channel(1) POWER_GAIN(2) ACTIVE_POWER_OFFSET(2)
+ *   PHASE(1) CRC-16 of the preceding bytes(2) */
+#define CALIB_REGS_MAGIC	0x4847u /* "HG" */
+
+hlw811x_error_t hlw811x_export_calib_regs(
+		const struct hlw811x_calib_regs *regs,
+		uint8_t *buf, size_t bufsize, size_t *len)
+{
+	uint8_t *p = buf;
+
+	if (bufsize < HLW811X_CALIB_REGS_BLOB_SIZE) {
+		HLW811X_ERROR("Buffer size is too small: %d", bufsize);
+		return HLW811X_BUFFER_TOO_SMALL;
+	}
+
+	p = put_u16(p, CALIB_REGS_MAGIC);
+	*p++ = HLW811X_CALIB_BLOB_VERSION;
+	*p++ = regs->channel;
+	p = put_u16(p, regs->power_gain);
+	p = put_u16(p, (uint16_t)regs->power_offset);
+	*p++ = (uint8_t)regs->phase;
+	p = put_u16(p, calc_crc16(buf, (size_t)(p - buf)));
+
+	if (len != NULL) {
+		*len = (size_t)(p - buf);
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_import_calib_regs(const uint8_t *blob,
+		size_t bloblen, struct hlw811x_calib_regs *regs)
+{
+	const uint8_t *p = blob;
+	uint16_t offset;
+	uint16_t word;
+	hlw811x_channel_t channel;
+
+	if (bloblen != HLW811X_CALIB_REGS_BLOB_SIZE) {
+		HLW811X_ERROR("Invalid blob size: %d", bloblen);
+		return HLW811X_INVALID_DATA;
+	}
+
+	get_u16(&blob[bloblen - 2], &word);
+	if (word != calc_crc16(blob, bloblen - 2)) {
+		HLW811X_ERROR("Blob corrupted");
+		return HLW811X_INVALID_DATA;
+	}
+
+	p = get_u16(p, &word);
+	if (word != CALIB_REGS_MAGIC || *p++ != HLW811X_CALIB_BLOB_VERSION) {
+		HLW811X_ERROR("Unknown blob");
+		return HLW811X_INVALID_DATA;
+	}
+
+	channel = *p++;
+	if (channel != HLW811X_CHANNEL_A && channel != HLW811X_CHANNEL_B) {
+		HLW811X_ERROR("Invalid channel: %d", channel);
+		return HLW811X_INVALID_DATA;
+	}
+
+	regs->channel = channel;
+	p = get_u16(p, &regs->power_gain);
+	p = get_u16(p, &offset);
+	regs->power_offset = (int16_t)offset;
+	regs->phase = (int8_t)*p;
+
+	return HLW811X_ERROR_NONE;
+}
+
+/* Written in one write-enabled window, or staged into the transaction of
+ * the caller if one is in progress. */
+static hlw811x_error_t write_calib_regs(struct hlw811x *self,
+		const struct hlw811x_calib_regs *regs)
+{
+	const bool nested = self->txn.active;
+	const bool b = regs->channel == HLW811X_CHANNEL_B;
+	hlw811x_error_t err;
+
+	if (!nested && (err = hlw811x_dev_begin_config(self))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if ((err = write_regval(self, b? HLW811X_REG_POWER_GAIN_B :
+			HLW811X_REG_POWER_GAIN_A, regs->power_gain))
+			!= HLW811X_ERROR_NONE ||
+			(err = write_regval(self, b? HLW811X_REG_PHASE_B :
+				HLW811X_REG_PHASE_A, (uint8_t)regs->phase))
+			!= HLW811X_ERROR_NONE ||
+			(err = write_regval(self,
+				b? HLW811X_REG_ACTIVE_POWER_OFFSET_B :
+				HLW811X_REG_ACTIVE_POWER_OFFSET_A,
+				(uint16_t)regs->power_offset))
+			!= HLW811X_ERROR_NONE) {
+		if (!nested) {
+			hlw811x_dev_abort_config(self);
+		}
+		return err;
+	}
+
+	return nested? HLW811X_ERROR_NONE : hlw811x_dev_commit_config(self);
+}
+
+static int32_t clamp_i32(int64_t val, int32_t min, int32_t max)
+{
+	if (val < min) {
+		return min;
+	} else if (val > max) {
+		return max;
+	}
+	return (int32_t)val;
+}
+
+/* The power gain register corrects by gain / 2^15, as a signed value. */
+static float get_power_gain(const struct hlw811x_calib_regs *regs)
+{
+	return (float)(int16_t)regs->power_gain / 32768.f;
+}
+
+static void solve_gain(struct hlw811x_calib_regs *regs, int32_t measured,
+		int32_t ref)
+{
+	/* Err = (measured - ref) / ref, gain = -Err / (1 + Err) */
+	const int64_t gain = measured == 0? 0 :
+		(((int64_t)ref - measured) * 32768) / measured;
+
+	regs->power_gain = (uint16_t)clamp_i32(gain, INT16_MIN, INT16_MAX);
+}
+
+/* With the current lagging by 60 degrees, an error of the active power comes
+ * from a phase error of Err / sqrt(3) radian. Each step of the register
+ * delays by 4 MCLK cycles. */
+static void solve_phase(struct hlw811x_calib_regs *regs, float measured,
+		int32_t ref, int32_t centihertz)
+{
+	const float err = (measured - (float)ref) / (float)ref;
+	const float step = 2.f * 3.14159265f * (float)centihertz / 100.f
+		* 4.f / (float)HLW811X_MCLK;
+	const float steps = err / 1.7320508f / step;
+
+	regs->phase = (int8_t)clamp_i32((int64_t)(steps < 0?
+			steps - .5f : steps + .5f), INT8_MIN, INT8_MAX);
+}
+
+hlw811x_error_t hlw811x_dev_calib_begin(struct hlw811x *self,
+		hlw811x_channel_t channel, uint8_t samples)
+{
+	struct calib *calib = &self->calib;
+	hlw811x_error_t err;
+
+	if ((channel != HLW811X_CHANNEL_A && channel != HLW811X_CHANNEL_B) ||
+			samples == 0 || samples > HLW811X_CALIB_SAMPLES_MAX) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	*calib = (struct calib) {
+		.regs = { .channel = channel, },
+		.samples = samples,
+	};
+
+	/* measure without any correction applied */
+	if ((err = write_calib_regs(self, &calib->regs))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	calib->active = true;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_calib_feed(struct hlw811x *self,
+		hlw811x_calib_step_t step, int32_t ref_milliwatt)
+{
+	struct calib *calib = &self->calib;
+	const hlw811x_channel_t ch = calib->regs.channel;
+	hlw811x_error_t err;
+	int32_t raw;
+	int32_t avg;
+	int32_t measured;
+	int32_t centihertz;
+	float corrected;
+
+	if (!calib->active || ref_milliwatt <= 0) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if (step != calib->step) {
+		calib->step = step;
+		calib->sum = 0;
+		calib->count = 0;
+	}
+
+	if ((err = read_reg32(self, ch == HLW811X_CHANNEL_B?
+			HLW811X_REG_POWER_PB : HLW811X_REG_POWER_PA, &raw))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	calib->sum += raw;
+
+	if (++calib->count < calib->samples) {
+		return HLW811X_BUSY;
+	}
+
+	avg = (int32_t)(calib->sum / calib->count);
+	measured = calc_power(self, ch, avg, 0);
+	corrected = (float)measured * (1.f + get_power_gain(&calib->regs));
+	calib->sum = 0;
+	calib->count = 0;
+
+	switch (step) {
+	case HLW811X_CALIB_GAIN:
+		solve_gain(&calib->regs, measured, ref_milliwatt);
+		break;
+	case HLW811X_CALIB_PHASE:
+		if ((err = hlw811x_dev_get_frequency(self, &centihertz))
+				!= HLW811X_ERROR_NONE) {
+			return err;
+		} else if (centihertz == 0) {
+			return HLW811X_INVALID_DATA;
+		}
+		solve_phase(&calib->regs, corrected, ref_milliwatt,
+				centihertz);
+		break;
+	case HLW811X_CALIB_OFFSET:
+		calib->regs.power_offset = (int16_t)clamp_i32(
+				(int64_t)unscale(&self->factors.power[ch ==
+					HLW811X_CHANNEL_B? 1 : 0],
+					(uint32_t)ref_milliwatt)
+				- (int64_t)((float)avg * (1.f +
+					get_power_gain(&calib->regs))),
+				INT16_MIN, INT16_MAX);
+		break;
+	default:
+		return HLW811X_INVALID_PARAM;
+	}
+
+	HLW811X_INFO("Calibration step %d: %d mW for %d mW",
+			step, measured, ref_milliwatt);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_calib_commit(struct hlw811x *self,
+		struct hlw811x_calib_regs *regs)
+{
+	struct calib *calib = &self->calib;
+	hlw811x_error_t err;
+
+	if (!calib->active) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if ((err = write_calib_regs(self, &calib->regs))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	calib->active = false;
+
+	if (regs != NULL) {
+		*regs = calib->regs;
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_calib_apply(struct hlw811x *self,
+		const struct hlw811x_calib_regs *regs)
+{
+	if (regs->channel != HLW811X_CHANNEL_A &&
+			regs->channel != HLW811X_CHANNEL_B) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	return write_calib_regs(self, regs);
+}
+
+hlw811x_error_t hlw811x_dev_set_pga(struct hlw811x *self,
+		const struct hlw811x_pga *pga)
+{
+	hlw811x_error_t err;
+	uint32_t reg;
+
+	if ((err = read_regval(self, HLW811X_REG_SYS_CTRL, &reg))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	reg = set_field(reg, HLW811X_SYS_CTRL_PGAIA, (uint32_t)pga->A);
+	reg = set_field(reg, HLW811X_SYS_CTRL_PGAU, (uint32_t)pga->U);
+	reg = set_field(reg, HLW811X_SYS_CTRL_PGAIB, (uint32_t)pga->B);
+
+	if ((err = write_regval(self, HLW811X_REG_SYS_CTRL, reg))
+			== HLW811X_ERROR_NONE) {
+		memcpy(&self->pga, pga, sizeof(self->pga));
+		update_factors(self);
+		HLW811X_INFO("PGA set: A=%d, U=%d, B=%d",
+				pga->A, pga->U, pga->B);
+	}
+
+	return err;
+}
+
+hlw811x_error_t hlw811x_dev_get_pga(struct hlw811x *self,
+		struct hlw811x_pga *pga)
+{
+	hlw811x_error_t err;
+	uint32_t reg;
+
+	if ((err = read_regval(self, HLW811X_REG_SYS_CTRL, &reg))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	pga->A = get_field(reg, HLW811X_SYS_CTRL_PGAIA);
+	pga->U = get_field(reg, HLW811X_SYS_CTRL_PGAU);
+	pga->B = get_field(reg, HLW811X_SYS_CTRL_PGAIB);
+
+	memcpy(&self->pga, pga, sizeof(self->pga));
+	update_factors(self);
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_enable_channel(struct hlw811x *self,
+		hlw811x_channel_t channel)
+{
+	hlw811x_error_t err;
+	uint32_t reg;
+
+	if ((err = read_regval(self, HLW811X_REG_SYS_CTRL, &reg))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if (channel & HLW811X_CHANNEL_A) {
+		reg = set_field(reg, HLW811X_SYS_CTRL_ADC1ON, 1);
+	}
+	if (channel & HLW811X_CHANNEL_B) {
+		reg = set_field(reg, HLW811X_SYS_CTRL_ADC2ON, 1);
+	}
+	if (channel & HLW811X_CHANNEL_U) {
+		reg = set_field(reg, HLW811X_SYS_CTRL_ADC3ON, 1);
+	}
+
+	if ((err = write_regval(self, HLW811X_REG_SYS_CTRL, reg))
+			== HLW811X_ERROR_NONE) {
+		HLW811X_INFO("Channel enabled: %d", channel);
+	}
+
+	return err;
+}
+
+hlw811x_error_t hlw811x_dev_disable_channel(struct hlw811x *self,
+		hlw811x_channel_t channel)
+{
+	hlw811x_error_t err;
+	uint32_t reg;
+
+	if ((err = read_regval(self, HLW811X_REG_SYS_CTRL, &reg))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if (channel & HLW811X_CHANNEL_A) {
+		reg = set_field(reg, HLW811X_SYS_CTRL_ADC1ON, 0);
+	}
+	if (channel & HLW811X_CHANNEL_B) {
+		reg = set_field(reg, HLW811X_SYS_CTRL_ADC2ON, 0);
+	}
+	if (channel & HLW811X_CHANNEL_U) {
+		reg = set_field(reg, HLW811X_SYS_CTRL_ADC3ON, 0);
+	}
+
+	if ((err = write_regval(self, HLW811X_REG_SYS_CTRL, reg))
+			== HLW811X_ERROR_NONE) {
+		HLW811X_INFO("Channel disabled: %d", channel);
+	}
+
+	return err;
+}
+
+hlw811x_error_t hlw811x_dev_reset(struct hlw811x *self)
+{
+	HLW811X_INFO("Resetting HLW811X chip");
+	/* the registers go back to their defaults */
+	self->shadow.enabled = false;
+	self->mux.selected = 0;
+	self->b_mode_known = false;
+	self->power_save.enabled = false;
+	/* the energy registers start over, keeping the totals only */
+	for (size_t i = 0; i < 2; i++) {
+		self->energy[i].last = 0;
+		self->energy[i].primed = false;
+		self->energy[i].overflow_held = false;
+		self->energy[i].wrap_unflagged = false;
+	}
+	return reset_chip(self);
+}
+
+static uint16_t build_sys_ctrl(uint16_t reg, const struct hlw811x_config *cfg)
+{
+	uint32_t val = reg;
+
+	val = set_field(val, HLW811X_SYS_CTRL_PGAIA, (uint32_t)cfg->pga.A);
+	val = set_field(val, HLW811X_SYS_CTRL_PGAU, (uint32_t)cfg->pga.U);
+	val = set_field(val, HLW811X_SYS_CTRL_PGAIB, (uint32_t)cfg->pga.B);
+	val = set_field(val, HLW811X_SYS_CTRL_ADC1ON,
+			!!(cfg->channels & HLW811X_CHANNEL_A));
+	val = set_field(val, HLW811X_SYS_CTRL_ADC2ON,
+			!!(cfg->channels & HLW811X_CHANNEL_B));
+	val = set_field(val, HLW811X_SYS_CTRL_ADC3ON,
+			!!(cfg->channels & HLW811X_CHANNEL_U));
+
+	return (uint16_t)val;
+}
+
+static uint16_t build_meter_ctrl(uint16_t reg, const struct hlw811x_config *cfg)
+{
+	uint32_t val = reg;
+
+	val = set_field(val, HLW811X_METER_CTRL_PARUN,
+			!!(cfg->pulse & HLW811X_CHANNEL_A));
+	val = set_field(val, HLW811X_METER_CTRL_PBRUN,
+			!!(cfg->pulse & HLW811X_CHANNEL_B));
+	val = set_field(val, HLW811X_METER_CTRL_HPFUOFF,
+			!(cfg->hpf & HLW811X_CHANNEL_U));
+	val = set_field(val, HLW811X_METER_CTRL_HPFAOFF,
+			!(cfg->hpf & HLW811X_CHANNEL_A));
+	val = set_field(val, HLW811X_METER_CTRL_HPFBOFF,
+			!(cfg->hpf & HLW811X_CHANNEL_B));
+	val = set_field(val, HLW811X_METER_CTRL_ZXD,
+			(uint32_t)cfg->zerocrossing_mode);
+	val = set_field(val, HLW811X_METER_CTRL_DC_MODE,
+			cfg->rms_mode == HLW811X_RMS_MODE_DC);
+	val = set_field(val, HLW811X_METER_CTRL_PMODE,
+			(uint32_t)cfg->active_power_mode);
+	val = set_field(val, HLW811X_METER_CTRL_COMP_OFF,
+			!cfg->b_channel_comparator);
+	val = set_field(val, HLW811X_METER_CTRL_TENSOR_EN,
+			cfg->temperature_sensor);
+
+	return (uint16_t)val;
+}
+
+static uint16_t build_meter_ctrl_2(uint16_t reg,
+		const struct hlw811x_config *cfg)
+{
+	uint32_t val = reg;
+
+	val = set_field(val, HLW811X_METER_CTRL_2_PEAK_EN,
+			cfg->peak_detection);
+	val = set_field(val, HLW811X_METER_CTRL_2_ZX_EN, cfg->zerocrossing);
+	val = set_field(val, HLW811X_METER_CTRL_2_OVER_EN,
+			cfg->overload_detection);
+	val = set_field(val, HLW811X_METER_CTRL_2_SAG_EN,
+			cfg->voltage_drop_detection);
+	val = set_field(val, HLW811X_METER_CTRL_2_WAVE_EN, cfg->waveform);
+	val = set_field(val, HLW811X_METER_CTRL_2_PFACTOR_EN,
+			cfg->power_factor);
+	val = set_field(val, HLW811X_METER_CTRL_2_CHS_IB,
+			cfg->b_mode == HLW811X_B_MODE_NORMAL);
+	val = set_field(val, HLW811X_METER_CTRL_2_DUP,
+			(uint32_t)cfg->data_update_freq);
+	/* EPA_CA and EPA_CB */
+	val = set_field(val, HLW811X_METER_CTRL_2_EPA_CA,
+			!(cfg->energy_clearance & HLW811X_CHANNEL_A));
+	val = set_field(val, HLW811X_METER_CTRL_2_EPA_CB,
+			!(cfg->energy_clearance & HLW811X_CHANNEL_B));
+
+	return (uint16_t)val;
+}
+
+static uint16_t build_int(uint16_t reg, const struct hlw811x_config *cfg)
+{
+	uint32_t val = reg;
+
+	val = set_field(val, HLW811X_INT_P1SEL,
+			get_regval_from_intr(cfg->int1));
+	val = set_field(val, HLW811X_INT_P2SEL,
+			get_regval_from_intr(cfg->int2));
+
+	return (uint16_t)val;
+}
+
+static uint16_t build_ie(uint16_t reg, const struct hlw811x_config *cfg)
+{
+	(void)reg;
+	return (uint16_t)cfg->interrupts;
+}
+
+hlw811x_error_t hlw811x_dev_begin_config(struct hlw811x *self)
+{
+	if (self->txn.active) {
+		HLW811X_ERROR("Transaction already in progress");
+		return HLW811X_INVALID_PARAM;
+	}
+
+	self->txn.count = 0;
+	self->txn.active = true;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_commit_config(struct hlw811x *self)
+{
+	hlw811x_error_t err = HLW811X_ERROR_NONE;
+	hlw811x_error_t rc;
+	const uint8_t count = self->txn.count;
+
+	if (!self->txn.active) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	self->txn.active = false;
+
+	if (count == 0) {
+		return HLW811X_ERROR_NONE;
+	}
+
+	if ((err = enable_write(self)) != HLW811X_ERROR_NONE) {
+		HLW811X_ERROR("enable_write() failed");
+		return err;
+	}
+
+	for (uint8_t i = 0; i < count; i++) {
+		const struct staged_write *w = &self->txn.writes[i];
+
+		if ((err = write_cmd(self, w->addr, w->data, w->len))
+				!= HLW811X_ERROR_NONE) {
+			HLW811X_ERROR("write_cmd() failed");
+			break;
+		}
+
+		update_shadow(self, w->addr, w->data, w->len);
+	}
+
+	if ((rc = disable_write(self)) != HLW811X_ERROR_NONE) {
+		HLW811X_ERROR("disable_write() failed");
+		if (err == HLW811X_ERROR_NONE) {
+			err = rc;
+		}
+	}
+
+	return err;
+}
+
+void hlw811x_dev_abort_config(struct hlw811x *self)
+{
+	self->txn.active = false;
+	self->txn.count = 0;
+	self->b_mode_known = false; /* may have been staged */
+}
+
+hlw811x_error_t hlw811x_dev_apply_config(struct hlw811x *self,
+		const struct hlw811x_config *cfg)
+{
+	static const struct {
+		hlw811x_reg_addr_t addr;
+		uint16_t (*build)(uint16_t reg,
+				const struct hlw811x_config *cfg);
+	} tbl[] = {
+		{ HLW811X_REG_SYS_CTRL,		build_sys_ctrl },
+		{ HLW811X_REG_METER_CTRL,	build_meter_ctrl },
+		{ HLW811X_REG_METER_CTRL_2,	build_meter_ctrl_2 },
+		{ HLW811X_REG_INT,		build_int },
+		{ HLW811X_REG_IE,		build_ie },
+	};
+	uint16_t regs[sizeof(tbl) / sizeof(tbl[0])];
+	const bool own_txn = !self->txn.active;
+	hlw811x_error_t err;
+
+	if (!is_intr_pin_valid(cfg->int1) || !is_intr_pin_valid(cfg->int2)) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	for (size_t i = 0; i < sizeof(tbl) / sizeof(tbl[0]); i++) {
+		if ((err = read_reg16(self, tbl[i].addr, &regs[i]))
+				!= HLW811X_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	if (own_txn) {
+		hlw811x_dev_begin_config(self);
+	}
+
+	for (size_t i = 0; i < sizeof(tbl) / sizeof(tbl[0]); i++) {
+		const uint16_t val = (*tbl[i].build)(regs[i], cfg);
+
+		if (val == regs[i]) {
+			continue;
+		}
+
+		if ((err = write_regval(self, tbl[i].addr, val))
+				!= HLW811X_ERROR_NONE) {
+			if (own_txn) {
+				hlw811x_dev_abort_config(self);
+			}
+			return err;
+		}
+	}
+
+	if (own_txn && (err = hlw811x_dev_commit_config(self))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	memcpy(&self->pga, &cfg->pga, sizeof(self->pga));
+	update_factors(self);
+	self->b_mode = cfg->b_mode;
+	self->b_mode_known = true;
+	HLW811X_INFO("Config applied");
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_enable_shadow(struct hlw811x *self)
+{
+	hlw811x_error_t err;
+
+	self->shadow.enabled = false;
+
+	for (size_t i = 0; i < SHADOW_MAX; i++) {
+		if ((err = read_reg16(self, shadowed_regs[i],
+				&self->shadow.regs[i])) != HLW811X_ERROR_NONE) {
+			return err;
+		}
+	}
+
+	self->shadow.enabled = true;
+
+	return HLW811X_ERROR_NONE;
+}
+
+void hlw811x_dev_disable_shadow(struct hlw811x *self)
+{
+	self->shadow.enabled = false;
+}
+
+hlw811x_error_t hlw811x_dev_verify_shadow(struct hlw811x *self)
+{
+	hlw811x_error_t err = HLW811X_ERROR_NONE;
+
+	if (!self->shadow.enabled) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	for (size_t i = 0; i < SHADOW_MAX; i++) {
+		uint8_t buf[2];
+		hlw811x_error_t rc;
+
+		if ((rc = read_reg(self, shadowed_regs[i], buf, sizeof(buf)))
+				!= HLW811X_ERROR_NONE) {
+			return rc;
+		}
+
+		const uint16_t reg = (uint16_t)convert_16bits_to_int16(buf);
+
+		if (reg != self->shadow.regs[i]) {
+			HLW811X_ERROR("shadow mismatch at %x: %x != %x",
+					shadowed_regs[i], reg,
+					self->shadow.regs[i]);
+			self->shadow.regs[i] = reg;
+			err = HLW811X_INVALID_DATA;
+		}
+	}
+
+	return err;
+}
+
+/* Powers the gated ADCs and pulse outputs given in adc and pulse, and powers
+ * down the rest of the gated ones. They are switched together from the
+ * shadow, with a single write per register changed, all in one write-enabled
+ * window. */
+static hlw811x_error_t gate_power(struct hlw811x *self,
+		hlw811x_channel_t adc, hlw811x_channel_t pulse)
+{
+	const struct power_save *ps = &self->power_save;
+	const bool nested = self->txn.active;
+	hlw811x_error_t err;
+	uint32_t sys;
+	uint32_t meter;
+	uint32_t new_sys;
+	uint32_t new_meter;
+	bool window;
+
+	if ((err = read_regval(self, HLW811X_REG_SYS_CTRL, &sys))
+			!= HLW811X_ERROR_NONE ||
+			(err = read_regval(self, HLW811X_REG_METER_CTRL,
+					&meter)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	new_sys = sys;
+	new_meter = meter;
+
+	if (ps->channels & HLW811X_CHANNEL_A) {
+		new_sys = set_field(new_sys, HLW811X_SYS_CTRL_ADC1ON,
+				(adc & HLW811X_CHANNEL_A) != 0);
+	}
+	if (ps->channels & HLW811X_CHANNEL_B) {
+		new_sys = set_field(new_sys, HLW811X_SYS_CTRL_ADC2ON,
+				(adc & HLW811X_CHANNEL_B) != 0);
+	}
+	if (ps->channels & HLW811X_CHANNEL_U) {
+		new_sys = set_field(new_sys, HLW811X_SYS_CTRL_ADC3ON,
+				(adc & HLW811X_CHANNEL_U) != 0);
+	}
+	if (ps->pulse & HLW811X_CHANNEL_A) {
+		new_meter = set_field(new_meter, HLW811X_METER_CTRL_PARUN,
+				(pulse & HLW811X_CHANNEL_A) != 0);
+	}
+	if (ps->pulse & HLW811X_CHANNEL_B) {
+		new_meter = set_field(new_meter, HLW811X_METER_CTRL_PBRUN,
+				(pulse & HLW811X_CHANNEL_B) != 0);
+	}
+
+	window = !nested && new_sys != sys && new_meter != meter;
+
+	if (window && (err = hlw811x_dev_begin_config(self))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if ((new_sys != sys && (err = write_regval(self,
+					HLW811X_REG_SYS_CTRL, new_sys))
+				!= HLW811X_ERROR_NONE) ||
+			(new_meter != meter && (err = write_regval(self,
+					HLW811X_REG_METER_CTRL, new_meter))
+				!= HLW811X_ERROR_NONE)) {
+		if (window) {
+			hlw811x_dev_abort_config(self);
+		}
+		return err;
+	}
+
+	return window? hlw811x_dev_commit_config(self) : HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_start_power_save(struct hlw811x *self,
+		hlw811x_channel_t channels, hlw811x_channel_t pulse,
+		hlw811x_clock_t clock, void *clock_ctx)
+{
+	struct power_save *ps = &self->power_save;
+	hlw811x_error_t err;
+	uint32_t reg;
+	uint32_t sys;
+	uint32_t meter;
+	uint32_t val;
+
+	if (clock == NULL || (channels & ~HLW811X_CHANNEL_ALL) ||
+			(pulse & ~(HLW811X_CHANNEL_A | HLW811X_CHANNEL_B))) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	/* the transitions are then writes only */
+	if (!self->shadow.enabled && (err = hlw811x_dev_enable_shadow(self))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	if ((err = read_regval(self, HLW811X_REG_METER_CTRL_2, &reg))
+			!= HLW811X_ERROR_NONE ||
+			(err = read_regval(self, HLW811X_REG_SYS_CTRL, &sys))
+			!= HLW811X_ERROR_NONE ||
+			(err = read_regval(self, HLW811X_REG_METER_CTRL,
+					&meter)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	val = get_field(reg, HLW811X_METER_CTRL_2_DUP);
+
+	*ps = (struct power_save) {
+		.clock = clock,
+		.clock_ctx = clock_ctx,
+		.settle_us = HLW811X_POWER_SAVE_SETTLE_PERIODS *
+			get_update_period_us((hlw811x_data_update_freq_t)val),
+		.channels = channels,
+		.pulse = pulse,
+	};
+
+	/* to be restored on stop */
+	if (get_field(sys, HLW811X_SYS_CTRL_ADC1ON)) {
+		ps->channels_on |= HLW811X_CHANNEL_A;
+	}
+	if (get_field(sys, HLW811X_SYS_CTRL_ADC2ON)) {
+		ps->channels_on |= HLW811X_CHANNEL_B;
+	}
+	if (get_field(sys, HLW811X_SYS_CTRL_ADC3ON)) {
+		ps->channels_on |= HLW811X_CHANNEL_U;
+	}
+	if (get_field(meter, HLW811X_METER_CTRL_PARUN)) {
+		ps->pulse_on |= HLW811X_CHANNEL_A;
+	}
+	if (get_field(meter, HLW811X_METER_CTRL_PBRUN)) {
+		ps->pulse_on |= HLW811X_CHANNEL_B;
+	}
+
+	if ((err = gate_power(self, 0, 0)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	ps->enabled = true;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_stop_power_save(struct hlw811x *self)
+{
+	struct power_save *ps = &self->power_save;
+	hlw811x_error_t err;
+
+	if (!ps->enabled) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	/* left powered as before the start */
+	if ((err = gate_power(self, ps->channels_on, ps->pulse_on))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	ps->enabled = false;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_open_window(struct hlw811x *self)
+{
+	struct power_save *ps = &self->power_save;
+	hlw811x_error_t err;
+
+	if (!ps->enabled) {
+		return HLW811X_INVALID_PARAM;
+	} else if (ps->open) {
+		return HLW811X_ERROR_NONE;
+	}
+
+	if ((err = gate_power(self, ps->channels, ps->pulse))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	ps->opened = (*ps->clock)(ps->clock_ctx);
+	ps->open = true;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_close_window(struct hlw811x *self)
+{
+	struct power_save *ps = &self->power_save;
+	hlw811x_error_t err;
+
+	if (!ps->enabled) {
+		return HLW811X_INVALID_PARAM;
+	} else if (!ps->open) {
+		return HLW811X_ERROR_NONE;
+	}
+
+	if ((err = gate_power(self, 0, 0)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	ps->open = false;
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_dev_is_window_ready(struct hlw811x *self)
+{
+	const struct power_save *ps = &self->power_save;
+
+	if (!ps->enabled || !ps->open) {
+		return HLW811X_INVALID_PARAM;
+	}
+
+	if ((*ps->clock)(ps->clock_ctx) - ps->opened < ps->settle_us) {
+		return HLW811X_BUSY;
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+struct hlw811x *hlw811x_create(hlw811x_interface_t interface,
+		const struct hlw811x_io *io)
+{
+	struct hlw811x *self = NULL;
+
+	if (io == NULL || io->ll_write == NULL || io->ll_read == NULL) {
+		HLW811X_ERROR("Invalid io");
+		return NULL;
+	}
+
+	for (size_t i = 0; i < HLW811X_MAX_INSTANCES; i++) {
+		if (!instances[i].allocated) {
+			self = &instances[i];
+			break;
+		}
+	}
+
+	if (self == NULL) {
+		HLW811X_ERROR("No free instance");
+		return NULL;
+	}
+
+	memset(self, 0, sizeof(*self));
+
+	self->iface = interface;
+	self->io = *io;
+	self->allocated = true;
+
+	return self;
+}
+
+void hlw811x_destroy(struct hlw811x *self)
+{
+	if (self == NULL) {
+		return;
+	}
+
+	memset(self, 0, sizeof(*self));
 }
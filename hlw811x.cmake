@@ -2,5 +2,6 @@
 
 list(APPEND HLW811X_SRCS
 	${CMAKE_CURRENT_LIST_DIR}/hlw811x.c
+	${CMAKE_CURRENT_LIST_DIR}/hlw811x_default.c
 )
 list(APPEND HLW811X_INCS ${CMAKE_CURRENT_LIST_DIR})
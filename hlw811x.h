@@ -13,6 +13,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "hlw811x_regs.h"
 
 typedef enum {
@@ -26,6 +27,8 @@ typedef enum {
 	HLW811X_BUFFER_TOO_SMALL,
 	HLW811X_CHECKSUM_MISMATCH,
 	HLW811X_INVALID_DATA,
+	HLW811X_NO_MEMORY,
+	HLW811X_BUSY,
 } hlw811x_error_t;
 
 enum hlw811x_channel {
@@ -92,7 +95,6 @@ typedef enum {
 	HLW811X_INTR_ACTIVE_POWER_OVERFLOW_A	= 0x0008,
 	HLW811X_INTR_ACTIVE_POWER_OVERFLOW_B	= 0x0010,
 	HLW811X_INTR_RESERVED			= 0x0020,
-	HLW811X_INTR_IRQ			= 0x0020,
 	HLW811X_INTR_INSTANTAENOUS_UPDATED	= 0x0040,
 	HLW811X_INTR_OVER_CURRENT_A		= 0x0080,
 	HLW811X_INTR_OVER_CURRENT_B		= 0x0100,
@@ -103,6 +105,9 @@ typedef enum {
 	HLW811X_INTR_ZERO_CROSSING_CURRENT_B	= 0x2000,
 	HLW811X_INTR_ZERO_CROSSING_VOLTAGE	= 0x4000,
 	HLW811X_INTR_B_LEAKAGE			= 0x8000,
+	/* Not a flag but the IRQ output selectable for INT1 and INT2, asserted
+	 * on any of the enabled interrupts. */
+	HLW811X_INTR_IRQ			= 0x10000,
 } hlw811x_intr_t;
 
 struct hlw811x_resistor_ratio {
@@ -130,17 +135,366 @@ struct hlw811x_coeff {
 	uint16_t hfconst; /* pulse frequency constant */
 };
 
+#define HLW811X_CALIB_BLOB_VERSION	1
+#define HLW811X_CALIB_BLOB_SIZE		40 /* bytes */
+#define HLW811X_CALIB_REGS_BLOB_SIZE	11 /* bytes */
+
 struct hlw811x_pga {
 	hlw811x_pga_gain_t A;
 	hlw811x_pga_gain_t B;
 	hlw811x_pga_gain_t U;
 };
 
+/* Complete set of the chip control settings applied by
+ * hlw811x_apply_config(). Every field maps to a setter of the same meaning. */
+struct hlw811x_config {
+	struct hlw811x_pga pga;
+	hlw811x_channel_t channels; /* ADC channels to be powered on */
+	hlw811x_channel_t pulse; /* pulse output and energy accumulation */
+	hlw811x_channel_t hpf; /* channels with the high-pass filter */
+	hlw811x_channel_t energy_clearance; /* clear energy after read */
+	hlw811x_active_power_mode_t active_power_mode;
+	hlw811x_rms_mode_t rms_mode;
+	hlw811x_data_update_freq_t data_update_freq;
+	hlw811x_channel_b_mode_t b_mode;
+	hlw811x_zerocrossing_mode_t zerocrossing_mode;
+	bool waveform;
+	bool zerocrossing;
+	bool power_factor;
+	bool b_channel_comparator;
+	bool temperature_sensor;
+	bool peak_detection;
+	bool overload_detection;
+	bool voltage_drop_detection;
+	hlw811x_intr_t interrupts; /* interrupts to be enabled */
+	hlw811x_intr_t int1; /* interrupt routed to INT1 */
+	hlw811x_intr_t int2; /* interrupt routed to INT2 */
+};
+
+/* Temperature of a snapshot taken with channel B measuring current */
+#define HLW811X_TEMPERATURE_NONE	INT32_MIN
+
+/* All quantities of one measurement update, as read by
+ * hlw811x_read_snapshot(). Units follow the single-value getters. */
+struct hlw811x_snapshot {
+	struct {
+		int32_t A; /* current of channel A in milliampere */
+		int32_t B; /* current of channel B in milliampere */
+		int32_t U; /* voltage in millivolt */
+	} rms;
+	struct {
+		int32_t A; /* active power of channel A in milliwatt */
+		int32_t B; /* active power of channel B in milliwatt */
+		int32_t S; /* apparent power in milli-VA */
+	} power;
+	struct {
+		int32_t A; /* active energy of channel A in watt-hour */
+		int32_t B; /* active energy of channel B in watt-hour */
+	} energy;
+	int32_t power_factor; /* centiunit */
+	int32_t phase_angle; /* centidegree */
+	int32_t frequency; /* centihertz */
+	hlw811x_channel_t channel; /* current channel selected for power S */
+	/* centidegree Celsius, or HLW811X_TEMPERATURE_NONE unless channel B
+	 * is known to be in HLW811X_B_MODE_TEMPERATURE and the fit of
+	 * hlw811x_get_temperature() is defined */
+	int32_t temperature;
+};
+
+/* Called on completion of hlw811x_submit_read(). data is valid only for the
+ * duration of the call and datalen is the requested register width. */
+typedef void (*hlw811x_read_cb_t)(hlw811x_error_t err,
+		hlw811x_reg_addr_t addr, const uint8_t *data, size_t datalen,
+		void *ctx);
+
+/* Called on completion of hlw811x_submit_snapshot(). snapshot is valid only
+ * for the duration of the call and holds nothing unless err is none. */
+typedef void (*hlw811x_snapshot_cb_t)(hlw811x_error_t err,
+		const struct hlw811x_snapshot *snapshot, void *ctx);
+
+/* Statistics of the asynchronous read queue, to help size
+ * HLW811X_ASYNC_QUEUE_LEN and HLW811X_ASYNC_PIPELINE_DEPTH. */
+struct hlw811x_queue_stats {
+	uint32_t submitted; /* reads accepted by hlw811x_submit_read() */
+	uint32_t completed; /* reads whose callback has been called */
+	uint32_t stalls; /* reads rejected because the queue was full */
+	uint32_t deferred; /* reads that waited for room in the pipeline */
+	uint8_t depth; /* reads currently queued, including in-flight ones */
+	uint8_t max_depth; /* high-water mark of depth */
+};
+
+/* How the blocking register reads recover from transport errors */
+struct hlw811x_transport_policy {
+	/* Attempts made after the first one fails with a checksum mismatch,
+	 * no response or an incomplete response. 0 disables the retry. */
+	uint8_t retries;
+	/* Wait before the first retry in milliseconds, doubled on each of the
+	 * following retries. Ignored when delay_ms is NULL. */
+	uint16_t backoff_ms;
+	/* Optional. Blocks for the given milliseconds. Called with the ctx of
+	 * struct hlw811x_io. */
+	void (*delay_ms)(uint32_t ms, void *ctx);
+};
+
+struct hlw811x_transport_stats {
+	uint32_t retries; /* read attempts made after a failed one */
+	uint32_t checksum_errors; /* responses with a bad checksum */
+	uint32_t timeouts; /* read attempts that got no response */
+	uint32_t resyncs; /* receive flushes before a retry */
+	uint32_t short_reads; /* responses shorter than the register */
+	uint32_t failures; /* reads given up after all the retries */
+};
+
+/* One sample of the waveform registers. Channels not being streamed read 0. */
+struct hlw811x_wave_sample {
+	int32_t IA;
+	int32_t IB;
+	int32_t U;
+};
+
+/* Single-producer/single-consumer ring of waveform samples. The producer is
+ * hlw811x_sample_waveform() and the consumer is hlw811x_wave_ring_pop(), which
+ * may run on different cores or contexts without locking. The indices run
+ * freely and wrap on capacity, which must be a power of two. */
+struct hlw811x_wave_ring {
+	struct hlw811x_wave_sample *buf;
+	uint32_t capacity;
+	volatile uint32_t head; /* written by the producer only */
+	volatile uint32_t tail; /* written by the consumer only */
+	volatile uint32_t dropped; /* samples lost as the ring was full */
+};
+
+/* Called by hlw811x_handle_irq() for each pending interrupt flag it has been
+ * registered for, with flag being a single bit. */
+typedef void (*hlw811x_irq_handler_t)(hlw811x_intr_t flag, void *ctx);
+
+/* Monotonic clock in microseconds, free to wrap around. */
+typedef uint32_t (*hlw811x_clock_t)(void *ctx);
+
+typedef enum {
+	HLW811X_THRESHOLD_OVER_CURRENT_A, /* peak current in milliampere */
+	HLW811X_THRESHOLD_OVER_CURRENT_B, /* peak current in milliampere */
+	HLW811X_THRESHOLD_OVER_VOLTAGE, /* peak voltage in millivolt */
+	HLW811X_THRESHOLD_UNDER_VOLTAGE, /* peak voltage in millivolt */
+	HLW811X_THRESHOLD_OVERLOAD, /* active power of channel A in milliwatt */
+} hlw811x_threshold_t;
+
+/* A power-quality event logged by hlw811x_capture_events() */
+struct hlw811x_event {
+	uint32_t timestamp; /* clock of the capture in microseconds */
+	hlw811x_intr_t type; /* the interrupt flag raised */
+	/* Peak current in milliampere or peak voltage in millivolt read on
+	 * capture, or the active power of channel A in milliwatt on
+	 * HLW811X_INTR_OVERLOAD. 0 if err is not none. */
+	int32_t value;
+	hlw811x_error_t err; /* result of reading the value */
+};
+
+/* Reference loads to calibrate against, one per step */
+typedef enum {
+	HLW811X_CALIB_GAIN, /* resistive load, power factor 1 */
+	HLW811X_CALIB_PHASE, /* inductive load, power factor 0.5 lagging */
+	HLW811X_CALIB_OFFSET, /* small load, power factor 1 */
+} hlw811x_calib_step_t;
+
+/* Power correction of a channel as written to the chip. Kept by the
+ * application, e.g. through hlw811x_export_calib_regs(), to be restored with
+ * hlw811x_calib_apply() after a reset. */
+struct hlw811x_calib_regs {
+	hlw811x_channel_t channel; /* HLW811X_CHANNEL_A or HLW811X_CHANNEL_B */
+	uint16_t power_gain; /* POWER_GAIN_A/B */
+	int16_t power_offset; /* ACTIVE_POWER_OFFSET_A/B */
+	int8_t phase; /* PHASE_A/B */
+};
+
+/* Channel-dependent quantities read together by hlw811x_read_channel_group()
+ * in the units of the getters */
+struct hlw811x_channel_group {
+	hlw811x_channel_t channel; /* HLW811X_CHANNEL_A or HLW811X_CHANNEL_B */
+	int32_t current; /* RMS current in milliampere */
+	int32_t power; /* active power in milliwatt */
+	int32_t power_S; /* apparent power in milli-VA */
+	int32_t power_factor; /* centiunit */
+};
+
+struct hlw811x_channel_mux_stats {
+	uint32_t switches; /* channel select commands sent */
+	uint32_t skipped; /* selections of the channel selected already */
+};
+
+/* Quantities polled by the scheduler, in the units of the getters */
+typedef enum {
+	HLW811X_QTY_RMS_A,
+	HLW811X_QTY_RMS_B,
+	HLW811X_QTY_RMS_U,
+	HLW811X_QTY_POWER_A,
+	HLW811X_QTY_POWER_B,
+	HLW811X_QTY_POWER_S,
+	HLW811X_QTY_ENERGY_A,
+	HLW811X_QTY_ENERGY_B,
+	HLW811X_QTY_POWER_FACTOR,
+	HLW811X_QTY_FREQUENCY,
+	HLW811X_QTY_PHASE_ANGLE,
+	HLW811X_QTY_TEMPERATURE,
+	HLW811X_QTY_MAX,
+} hlw811x_quantity_t;
+
+/* Called by hlw811x_run_poll_scheduler() for each quantity read. */
+typedef void (*hlw811x_poll_cb_t)(hlw811x_quantity_t qty, int32_t value,
+		void *ctx);
+
+struct hlw811x_poll_stats {
+	uint32_t periods; /* update periods served */
+	uint32_t missed; /* update periods passed without a run */
+	uint32_t reads; /* register reads made */
+	uint32_t shed; /* due quantities left for a later period */
+};
+
+#define HLW811X_STATS_BUCKETS		8
+/* Upper bound of the first latency bucket in microseconds. Each following
+ * bucket doubles it and the last one takes the rest. */
+#define HLW811X_STATS_BUCKET_US		250
+/* Registers counted individually, i.e. addresses below this */
+#define HLW811X_STATS_REG_MAX		0x78
+
+typedef enum {
+	HLW811X_OP_READ, /* register read */
+	HLW811X_OP_WRITE, /* register write */
+	HLW811X_OP_COMMAND, /* write to HLW811X_REG_COMMAND */
+	HLW811X_OP_MAX,
+} hlw811x_op_t;
+
+struct hlw811x_op_stats {
+	uint32_t calls;
+	uint32_t errors;
+	uint32_t bytes; /* on the wire in both directions */
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t total_us; /* divide by calls for the average */
+	uint32_t histogram[HLW811X_STATS_BUCKETS];
+};
+
+struct hlw811x_reg_stats {
+	uint32_t calls;
+	uint32_t errors;
+	uint32_t bytes;
+	uint32_t max_us;
+	uint32_t total_us;
+};
+
+struct hlw811x_stats {
+	struct hlw811x_op_stats ops[HLW811X_OP_MAX];
+	struct hlw811x_reg_stats regs[HLW811X_STATS_REG_MAX];
+};
+
+struct hlw811x;
+
+/* Health of a chip in an aggregator, judged by its read of the last round */
+typedef enum {
+	HLW811X_CHIP_OK, /* read with no transport error */
+	HLW811X_CHIP_DEGRADED, /* read, but only after transport errors */
+	HLW811X_CHIP_FAILED, /* not read, the snapshot is from a past round */
+	HLW811X_CHIP_OFFLINE, /* failed HLW811X_AGG_OFFLINE_ROUNDS in a row */
+} hlw811x_chip_health_t;
+
+/* The reading of one chip in an aggregator round */
+struct hlw811x_agg_sample {
+	struct hlw811x_snapshot snapshot;
+	/* transport counters gained during the read */
+	struct hlw811x_transport_stats errors;
+	uint32_t timestamp; /* clock at the start of the read */
+	hlw811x_error_t err; /* result of the read */
+	hlw811x_chip_health_t health;
+	uint16_t failures; /* rounds failed in a row */
+};
+
+/* One chip of an aggregator, maintained by the aggregator only. Each chip has
+ * a single reader, so that chips on different buses may be read from
+ * different contexts without locking. */
+struct hlw811x_agg_chip {
+	struct hlw811x *dev;
+	struct hlw811x_agg *agg;
+	struct hlw811x_agg_sample work; /* being read in the current round */
+	struct hlw811x_agg_sample published; /* of the last complete round */
+	/* transport counters at the start of the read */
+	struct hlw811x_transport_stats before;
+	volatile bool pending; /* submitted by hlw811x_agg_step() */
+	volatile uint32_t round; /* last round read, written by the reader */
+};
+
+/* Reads a snapshot of each of many chips per round, and publishes them
+ * together once all are read. */
+struct hlw811x_agg {
+	struct hlw811x_agg_chip *chips;
+	uint8_t n;
+	hlw811x_clock_t clock;
+	void *clock_ctx;
+	volatile uint32_t round; /* round being read, from 1 on */
+	/* start of the earliest read of the published, and from there to
+	 * the latest one. Only the chips read in the round count, unless
+	 * none is. */
+	uint32_t timestamp;
+	uint32_t skew;
+};
+
+struct hlw811x_io {
+	/* Returns the number of bytes written, or a negative error code. */
+	int (*ll_write)(const uint8_t *data, size_t datalen, void *ctx);
+	/* Returns the number of bytes read, or a negative error code. */
+	int (*ll_read)(uint8_t *buf, size_t bufsize, void *ctx);
+	/* Optional. Drives the chip select line for the legacy SPI wiring where
+	 * the select is a GPIO rather than handled by the SPI peripheral: it is
+	 * asserted before and released after each whole frame, so that a read
+	 * keeps the line low between ll_write() and ll_read(). Leave it NULL
+	 * for UART or when the transport asserts the line by itself. */
+	void (*ll_select)(bool selected, void *ctx);
+	void *ctx; /* passed as is to the callbacks above */
+};
+
+/**
+ * @brief Create a HLW811X device instance.
+ *
+ * This function allocates an instance from the static pool of
+ * HLW811X_MAX_INSTANCES entries and binds it to the given low level I/O
+ * callbacks. Each instance keeps its own state, so different instances can be
+ * used from different threads without locking as long as a single instance is
+ * not shared.
+ *
+ * @note This function is not thread-safe. Create instances at initialization.
+ *
+ * @param[in] interface The interface to be used.
+ * @param[in] io Low level I/O callbacks. Copied into the instance.
+ *
+ * @return struct hlw811x* Pointer to the created instance, or NULL if @p io is
+ *                         invalid or no free instance is left.
+ */
+struct hlw811x *hlw811x_create(hlw811x_interface_t interface,
+		const struct hlw811x_io *io);
+
+/**
+ * @brief Destroy a HLW811X device instance.
+ *
+ * This function returns the instance to the pool.
+ *
+ * @param[in] self Instance created by hlw811x_create().
+ */
+void hlw811x_destroy(struct hlw811x *self);
+
 /**
  * @brief Initializes the HLW811X device with the specified interface.
  *
- * This function sets up the HLW811X device using the provided interface,
- * preparing it for operation.
+ * This function sets up the default HLW811X device instance using the provided
+ * interface, preparing it for operation. The default instance talks to the
+ * chip through hlw811x_ll_write() and hlw811x_ll_read() declared in
+ * hlw811x_overrides.h, and all the functions below without a device handle
+ * operate on it. Until this succeeds, they return HLW811X_INVALID_PARAM, or
+ * nothing, without touching the bus.
+ *
+ * With HLW811X_SPI, frames are sent without the header and the checksum, and
+ * hlw811x_ll_read() is asked for exactly the register width. As the default
+ * instance has no chip select callback, the transport must keep the chip
+ * selected from hlw811x_ll_write() through hlw811x_ll_read() of a read. Use
+ * hlw811x_create() with hlw811x_io.ll_select otherwise.
  *
  * @param[in] interface The interface to be used.
  *
@@ -164,6 +518,171 @@ hlw811x_error_t hlw811x_init(hlw811x_interface_t interface);
  */
 hlw811x_error_t hlw811x_reset(void);
 
+/**
+ * @brief Enable the shadow cache of the control registers.
+ *
+ * This function reads SYS_CTRL, METER_CTRL, METER_CTRL_2, INT and IE once and
+ * keeps a write-through copy of them. While the shadow is enabled, setters
+ * cost a single register write instead of a read-modify-write and getters of
+ * those registers do not touch the bus at all.
+ *
+ * @note The shadow is disabled by hlw811x_reset() as the chip registers go
+ *       back to their defaults. Call this function again after the reset.
+ *
+ * @note Registers written behind the driver's back, e.g. by another host on
+ *       the same bus, go unnoticed until hlw811x_verify_shadow() is called.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ *                         The shadow stays disabled on failure.
+ */
+hlw811x_error_t hlw811x_enable_shadow(void);
+
+/**
+ * @brief Disable the shadow cache of the control registers.
+ *
+ * All the accessors go to the chip again afterward.
+ */
+void hlw811x_disable_shadow(void);
+
+/**
+ * @brief Verify the shadow cache against the chip.
+ *
+ * This function reads back all the shadowed registers and compares them with
+ * the cached values. Mismatched entries are replaced with the values read from
+ * the chip.
+ *
+ * @return hlw811x_error_t HLW811X_ERROR_NONE if the shadow matches the chip,
+ *         HLW811X_INVALID_DATA if any of the registers differ, e.g. after an
+ *         unexpected chip reset, HLW811X_INVALID_PARAM if the shadow is not
+ *         enabled.
+ */
+hlw811x_error_t hlw811x_verify_shadow(void);
+
+/**
+ * @brief Start duty cycling the ADCs and the pulse outputs.
+ *
+ * The given ADC channels and pulse outputs are powered only while a sampling
+ * window is open, and powered down now. The shadow cache is enabled if not
+ * yet, so that each transition is a single write of SYS_CTRL, and of
+ * METER_CTRL for the pulses, in one write-enabled window.
+ *
+ * @note The energy of a gated channel does not accumulate while closed.
+ *
+ * @param[in] channels ADC channels to gate, HLW811X_CHANNEL_A, B and U.
+ * @param[in] pulse Pulse outputs to gate, HLW811X_CHANNEL_A and B.
+ * @param[in] clock Monotonic clock for the settling of a window.
+ * @param[in] clock_ctx Passed to @p clock.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_start_power_save(hlw811x_channel_t channels,
+		hlw811x_channel_t pulse,
+		hlw811x_clock_t clock, void *clock_ctx);
+
+/**
+ * @brief Stop duty cycling, leaving the gated channels powered as they were
+ *        before hlw811x_start_power_save().
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_PARAM if not started, otherwise
+ *                         the result of the operation.
+ */
+hlw811x_error_t hlw811x_stop_power_save(void);
+
+/**
+ * @brief Power the gated channels on for a sampling window.
+ *
+ * The measurements are not valid until hlw811x_is_window_ready() tells so.
+ * Opening a window already open does nothing.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_open_window(void);
+
+/**
+ * @brief Power the gated channels down until the next window.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_close_window(void);
+
+/**
+ * @brief Tell if the measurements of the open window are valid.
+ *
+ * The ADCs and the averaging settle for HLW811X_POWER_SAVE_SETTLE_PERIODS
+ * update periods of the data update frequency read at the start.
+ *
+ * @return hlw811x_error_t HLW811X_ERROR_NONE once settled, HLW811X_BUSY
+ *                         until then or HLW811X_INVALID_PARAM if no window
+ *                         is open.
+ */
+hlw811x_error_t hlw811x_is_window_ready(void);
+
+/**
+ * @brief Begin a configuration transaction.
+ *
+ * Register writes issued after this call, by hlw811x_write_reg() or any of the
+ * setters, are staged in memory instead of being sent right away. Writes to
+ * the same register are coalesced into one, and reading a staged register
+ * through a getter returns the staged value. The staged writes are sent by
+ * hlw811x_commit_config() in a single write-enabled window.
+ *
+ * @note Up to HLW811X_CONFIG_TXN_MAX distinct registers can be staged.
+ *
+ * @note Commands such as hlw811x_reset() and hlw811x_select_channel() are not
+ *       staged and take effect immediately.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_PARAM if a transaction is already in
+ *                         progress.
+ */
+hlw811x_error_t hlw811x_begin_config(void);
+
+/**
+ * @brief Commit the configuration transaction.
+ *
+ * This function enables writing once, sends all the staged register writes
+ * back to back in the order they were first staged and disables writing
+ * again. It costs 2 + N frames for N distinct registers instead of 3 * N.
+ *
+ * @note The transaction is closed even on failure. Registers after the failed
+ *       one are not written.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ *         HLW811X_INVALID_PARAM if no transaction is in progress.
+ */
+hlw811x_error_t hlw811x_commit_config(void);
+
+/**
+ * @brief Abort the configuration transaction.
+ *
+ * This function drops all the staged writes without touching the chip.
+ *
+ * @note Driver-side state updated by setters while staging, e.g. the PGA
+ *       settings used for conversions, is not rolled back.
+ */
+void hlw811x_abort_config(void);
+
+/**
+ * @brief Apply a complete configuration profile.
+ *
+ * This function computes the final SYS_CTRL, METER_CTRL, METER_CTRL_2, INT
+ * and IE words from @p cfg in memory, compares them with the current register
+ * values and writes only the registers that differ, all in a single
+ * write-enabled window. Bits not covered by @p cfg are left untouched.
+ *
+ * @note The current register values come from the shadow when
+ *       hlw811x_enable_shadow() is in effect, so applying an unchanged profile
+ *       costs no bus traffic at all. Otherwise the five registers are read
+ *       first.
+ *
+ * @note When called inside hlw811x_begin_config(), the writes are staged in
+ *       the ongoing transaction instead of being committed right away.
+ *
+ * @param[in] cfg The configuration profile to apply.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_apply_config(const struct hlw811x_config *cfg);
+
 /**
  * @brief Write data to a specified HLW811X register.
  *
@@ -194,6 +713,193 @@ hlw811x_error_t hlw811x_write_reg(hlw811x_reg_addr_t addr,
 hlw811x_error_t hlw811x_read_reg(hlw811x_reg_addr_t addr,
 		uint8_t *buf, size_t bufsize);
 
+/**
+ * @brief Read a range of HLW811X registers back to back.
+ *
+ * This function reads every register from @p start to @p end inclusive, each
+ * in its own width, and packs the values in address order as they come from
+ * the chip, i.e. most significant byte first. Addresses in the range that are
+ * not registers are skipped. The registers are read from the chip directly,
+ * bypassing the shadow and any open configuration transaction.
+ *
+ * For example, reading HLW811X_REG_PEAK_IA to HLW811X_REG_INSTAN_S gives nine
+ * 24-bit values followed by two 32-bit values, 35 bytes in total.
+ *
+ * @param[in] start The address of the first register.
+ * @param[in] end The address of the last register.
+ * @param[out] buf Pointer to the buffer to store the read data.
+ * @param[in] bufsize Size of the buffer.
+ * @param[out] len Number of the bytes stored in @p buf. Can be NULL.
+ *
+ * @return hlw811x_error_t HLW811X_BUFFER_TOO_SMALL if @p buf cannot hold the
+ *                         whole range, in which case nothing is read.
+ */
+hlw811x_error_t hlw811x_read_regs(hlw811x_reg_addr_t start,
+		hlw811x_reg_addr_t end, uint8_t *buf, size_t bufsize,
+		size_t *len);
+
+/**
+ * @brief Start reading a HLW811X register without waiting for the response.
+ *
+ * This function sends the read request and returns right away. The response is
+ * to be fed by hlw811x_on_rx() as it arrives, typically from the UART receive
+ * interrupt or DMA completion, and @p cb is called once the response is
+ * complete. hlw811x_ll_write() should therefore not block either.
+ *
+ * Up to HLW811X_ASYNC_QUEUE_LEN reads can be queued, completed in the order of
+ * submission. On UART, up to HLW811X_ASYNC_PIPELINE_DEPTH read headers are sent
+ * ahead, so the next request is already on the wire while the previous
+ * response is still arriving. The rest are sent as the responses complete. On
+ * SPI, one read is on the wire at a time.
+ *
+ * The reads go to the chip directly, bypassing the shadow and any open
+ * configuration transaction, and must not be interleaved with the blocking
+ * functions.
+ *
+ * @param[in] addr The address of the HLW811X register to read from.
+ * @param[in] len Width of the register in bytes, up to 4.
+ * @param[in] cb Callback to be called with the result.
+ * @param[in] ctx User context passed to @p cb as is.
+ *
+ * @return hlw811x_error_t HLW811X_BUSY if the queue is full.
+ */
+hlw811x_error_t hlw811x_submit_read(hlw811x_reg_addr_t addr, size_t len,
+		hlw811x_read_cb_t cb, void *ctx);
+
+/**
+ * @brief Feed received bytes to the outstanding read.
+ *
+ * The responses may come in any number of chunks, and a chunk may span more
+ * than one response. The callback of each read is called from within this
+ * function once its response is complete, so it runs in the context of the
+ * caller.
+ *
+ * @param[in] data Received bytes.
+ * @param[in] datalen Number of the received bytes.
+ *
+ * @return hlw811x_error_t HLW811X_INCORRECT_RESPONSE if more bytes than the
+ *                         in-flight reads expect are received. The excess
+ *                         bytes are discarded.
+ */
+hlw811x_error_t hlw811x_on_rx(const uint8_t *data, size_t datalen);
+
+/**
+ * @brief Start reading a snapshot without waiting for the responses.
+ *
+ * The same as hlw811x_read_snapshot() but through hlw811x_submit_read(), one
+ * register after another as the queue makes room, so the same rules apply:
+ * the responses are fed by hlw811x_on_rx() and hlw811x_ll_write() should not
+ * block. @p cb is called from within hlw811x_on_rx() once the last register is
+ * in, or with the error of the first read failing.
+ *
+ * One snapshot can be in progress at a time. Other reads may be submitted
+ * alongside, at the cost of the queue room.
+ *
+ * @param[in] cb Callback to be called with the result.
+ * @param[in] ctx User context passed to @p cb as is.
+ *
+ * @return hlw811x_error_t HLW811X_BUSY if a snapshot is already in progress or
+ *                         the queue is full, in which case @p cb is not
+ *                         called.
+ */
+hlw811x_error_t hlw811x_submit_snapshot(hlw811x_snapshot_cb_t cb, void *ctx);
+
+/**
+ * @brief Drop all the queued asynchronous reads.
+ *
+ * Meant for a response that never comes. The callback of each queued read is
+ * called with HLW811X_NO_RESPONSE, and each read in flight is counted as a
+ * timeout in the transport counters. The bytes of a late response must not be
+ * fed to hlw811x_on_rx() afterward, e.g. flush the receive path first.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_cancel_reads(void);
+
+/**
+ * @brief Get the statistics of the asynchronous read queue.
+ *
+ * @param[out] stats Pointer to the structure where the statistics will be
+ *                   stored.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_get_queue_stats(struct hlw811x_queue_stats *stats);
+
+/**
+ * @brief Set how the blocking register reads recover from transport errors.
+ *
+ * A read failing with HLW811X_CHECKSUM_MISMATCH, HLW811X_NO_RESPONSE or
+ * HLW811X_INCORRECT_RESPONSE is retried up to @p policy->retries times. On
+ * UART, the bytes left in the receive path are drained through
+ * hlw811x_ll_read() before each retry, so that a late or partial response does
+ * not shift the frames that follow. Nothing is retried by default.
+ *
+ * Writes and the asynchronous reads are not retried. A write cannot be told
+ * apart from a lost one on UART, as the chip does not acknowledge it.
+ *
+ * @param[in] policy Pointer to the policy to apply.
+ */
+void hlw811x_set_transport_policy(
+		const struct hlw811x_transport_policy *policy);
+
+/**
+ * @brief Get the transport error counters.
+ *
+ * The counters accumulate from hlw811x_init() on and can be used to tune the
+ * baud rate and the retry policy. The checksum errors of the asynchronous
+ * reads count too, and so do the reads dropped in flight by
+ * hlw811x_cancel_reads() as timeouts.
+ *
+ * @param[out] stats Pointer to the structure where the counters will be
+ *                   stored.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_get_transport_stats(
+		struct hlw811x_transport_stats *stats);
+
+/**
+ * @brief Set the clock timestamping the bus transfers for the statistics.
+ *
+ * The clock also times the transfers reported to the HLW811X_TRACE hook.
+ * Without a clock, the calls, bytes and errors are still counted while the
+ * latencies stay 0.
+ *
+ * @param[in] clock Monotonic clock in microseconds. NULL to stop timing.
+ * @param[in] ctx User context passed to @p clock as is.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_set_stats_clock(hlw811x_clock_t clock, void *ctx);
+
+/**
+ * @brief Get the bus statistics.
+ *
+ * Every blocking register read, register write and command is counted by its
+ * kind of operation and by its register. The latency is the time from sending
+ * the frame until the response is received, or until the frame is sent for a
+ * write. The asynchronous reads are not counted.
+ *
+ * @note Available only when built with HLW811X_STATS defined to 1. Each
+ *       instance takes sizeof(struct hlw811x_stats) more memory then.
+ *
+ * @param[out] stats Pointer to the structure where the statistics will be
+ *                   stored.
+ *
+ * @return hlw811x_error_t HLW811X_NOT_IMPLEMENTED if built without
+ *                         HLW811X_STATS.
+ */
+hlw811x_error_t hlw811x_get_stats(struct hlw811x_stats *stats);
+
+/**
+ * @brief Clear the bus statistics.
+ *
+ * @return hlw811x_error_t HLW811X_NOT_IMPLEMENTED if built without
+ *                         HLW811X_STATS.
+ */
+hlw811x_error_t hlw811x_clear_stats(void);
+
 /**
  * @brief Enable a specified HLW811X channel.
  *
@@ -260,6 +966,71 @@ hlw811x_error_t hlw811x_enable_waveform(void);
  */
 hlw811x_error_t hlw811x_disable_waveform(void);
 
+/**
+ * @brief Initialize a waveform sample ring.
+ *
+ * @param[out] ring The ring to be initialized.
+ * @param[in] buf Storage for the samples, owned by the caller.
+ * @param[in] capacity Number of the samples @p buf can hold. It must be a power
+ *                     of two.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_wave_ring_init(struct hlw811x_wave_ring *ring,
+		struct hlw811x_wave_sample *buf, uint32_t capacity);
+
+/**
+ * @brief Take the oldest sample out of a waveform sample ring.
+ *
+ * This is the consumer side of the ring and must be called from a single
+ * context.
+ *
+ * @param[in] ring The ring to take the sample from.
+ * @param[out] sample Pointer to the variable where the sample will be stored.
+ *
+ * @return bool true if a sample was taken, false if the ring is empty.
+ */
+bool hlw811x_wave_ring_pop(struct hlw811x_wave_ring *ring,
+		struct hlw811x_wave_sample *sample);
+
+/**
+ * @brief Start streaming the waveform registers into a ring.
+ *
+ * This function only binds the ring. Samples are taken by
+ * hlw811x_sample_waveform(), which is meant to be called at the sampling rate
+ * from a timer or the data ready interrupt. The waveform data must be enabled
+ * by hlw811x_enable_waveform() beforehand.
+ *
+ * @param[in] channels Channels to be sampled, WAVE_IA, WAVE_IB and WAVE_U
+ *                     respectively.
+ * @param[in] ring The ring to push the samples into. It must stay valid until
+ *                 hlw811x_stop_waveform_stream() is called.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_start_waveform_stream(hlw811x_channel_t channels,
+		struct hlw811x_wave_ring *ring);
+
+/**
+ * @brief Stop streaming the waveform registers.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_stop_waveform_stream(void);
+
+/**
+ * @brief Take one waveform sample into the streaming ring.
+ *
+ * This function reads the waveform registers of the streamed channels, fixes
+ * the sign of the 24-bit values and pushes them as one sample. It is the only
+ * producer of the ring.
+ *
+ * @return hlw811x_error_t HLW811X_BUFFER_TOO_SMALL if the sample was dropped as
+ *                         the ring is full, HLW811X_INVALID_PARAM if not
+ *                         streaming.
+ */
+hlw811x_error_t hlw811x_sample_waveform(void);
+
 /**
  * @brief Enable zero-crossing detection.
  *
@@ -391,191 +1162,619 @@ hlw811x_error_t hlw811x_disable_b_channel_comparator(void);
  * This function enables the temperature sensor of the HLW811X,
  * allowing for temperature measurements.
  *
- * @note hlw811x_set_b_channel_mode() must be set to B_MODE_TEMPERATURE to use
- * this functionality.
+ * @note hlw811x_set_b_channel_mode() must be set to B_MODE_TEMPERATURE to use
+ * this functionality.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_enable_temperature_sensor(void);
+
+/**
+ * @brief Disable temperature sensor.
+ *
+ * This function disables the temperature sensor of the HLW811X,
+ * preventing temperature measurements.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_disable_temperature_sensor(void);
+
+/**
+ * @brief Enable peak detection.
+ *
+ * This function enables the peak detection feature of the HLW811X,
+ * allowing the detection of peak values in the channel signals.
+ *
+ * @note hlw811x_enable_waveform() must be enabled to use this functionality.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_enable_peak_detection(void);
+
+/**
+ * @brief Disable peak detection.
+ *
+ * This function disables the peak detection feature of the HLW811X,
+ * preventing the detection of peak values in the channel signals.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_disable_peak_detection(void);
+
+/**
+ * @brief Enable overload detection.
+ *
+ * This function enables the overload detection feature of the HLW811X,
+ * allowing the detection of overload conditions in the channel signals.
+ *
+ * @note hlw811x_enable_waveform() must be enabled to use this functionality.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_enable_overload_detection(void);
+
+/**
+ * @brief Disable overload detection.
+ *
+ * This function disables the overload detection feature of the HLW811X,
+ * preventing the detection of overload conditions int the channel signals.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_disable_overload_detection(void);
+
+/**
+ * @brief Enable voltage drop detection.
+ *
+ * This function enables the voltage drop detection feature of the HLW811X,
+ * allowing the detection of voltage drops in the channel signals.
+ *
+ * @note hlw811x_enable_waveform() must be enabled to use this functionality.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_enable_voltage_drop_detection(void);
+
+/**
+ * @brief Disable voltage drop detection.
+ *
+ * This function disables the voltage drop detection feature of the HLW811X,
+ * preventing the detection of voltage drops in the channel signals.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_disable_voltage_drop_detection(void);
+
+/**
+ * @brief Set a detection threshold in engineering units.
+ *
+ * The value is converted to register counts with the coefficients, the
+ * resistor ratio and the PGA gains currently held, so set the thresholds
+ * after those, and again when any of them changes. The chip compares the
+ * current and voltage thresholds against the waveform peak, so for an RMS
+ * limit of a sine, pass the RMS value times 1.414.
+ *
+ * @param[in] type Threshold to set.
+ * @param[in] milliunit Threshold in the unit of @p type. Values beyond the
+ *                      register range saturate.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_DATA if no calibration is loaded
+ *                         yet.
+ */
+hlw811x_error_t hlw811x_set_threshold(hlw811x_threshold_t type,
+		int32_t milliunit);
+
+/**
+ * @brief Set how long the voltage stays below its threshold to be a sag.
+ *
+ * @param[in] half_cycles Duration in half line cycles.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_set_sag_period(uint16_t half_cycles);
+
+/**
+ * @brief Start logging power-quality events.
+ *
+ * From then on, hlw811x_handle_irq() logs each of the given flags it finds
+ * pending, with a timestamp and the peak value read right away. Up to
+ * HLW811X_EVENT_LOG_LEN events are kept until drained, and events beyond
+ * are dropped and counted. The detections and their interrupts must be
+ * enabled separately.
+ *
+ * @param[in] ints Any of HLW811X_INTR_OVER_CURRENT_A,
+ *                 HLW811X_INTR_OVER_CURRENT_B, HLW811X_INTR_OVER_VOLTAGE,
+ *                 HLW811X_INTR_UNDER_VOLTAGE and HLW811X_INTR_OVERLOAD.
+ * @param[in] clock Clock to timestamp the events.
+ * @param[in] ctx User context passed to @p clock as is.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_start_event_capture(hlw811x_intr_t ints,
+		hlw811x_clock_t clock, void *ctx);
+
+/**
+ * @brief Stop logging power-quality events. Logged ones are kept.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_stop_event_capture(void);
+
+/**
+ * @brief Log the power-quality events among the given interrupt flags.
+ *
+ * This is called by hlw811x_handle_irq(). Call it directly when the flags
+ * are read otherwise, e.g. by hlw811x_get_interrupt_ext().
+ *
+ * An event whose value fails to be read is logged nonetheless with the error,
+ * as the flag is cleared already. An event coming while the log is full is
+ * only counted, without reading its value.
+ *
+ * @param[in] ints Pending interrupts.
+ *
+ * @return hlw811x_error_t The error of the first value failed to be read, after
+ *                         all the events are logged.
+ */
+hlw811x_error_t hlw811x_capture_events(hlw811x_intr_t ints);
+
+/**
+ * @brief Take the logged events out, the oldest first.
+ *
+ * @note Not to be called concurrently with the capture.
+ *
+ * @param[out] events Array to store the events.
+ * @param[in] n Capacity of @p events.
+ *
+ * @return Number of the events stored in @p events.
+ */
+size_t hlw811x_drain_events(struct hlw811x_event *events, size_t n);
+
+/**
+ * @brief Get the number of events dropped as the log was full.
+ *
+ * @return Number of the dropped events since the capture started.
+ */
+uint32_t hlw811x_get_dropped_events(void);
+
+/**
+ * @brief Enable specific interrupts for the HLW811X.
+ *
+ * This function enables the specified interrupts for the HLW811X,
+ * allowing the device to generate interrupt signals for the specified events.
+ *
+ * @param[in] ints The interrupts to enable.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_enable_interrupt(hlw811x_intr_t ints);
+
+/**
+ * @brief Disable specific interrupts for the HLW811X.
+ *
+ * This function disables the specified interrupts for the HLW811X,
+ * preventing the device from generating interrupt signals for the specified
+ * events.
+ *
+ * @param[in] ints The interrupts to disable.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_disable_interrupt(hlw811x_intr_t ints);
+
+/**
+ * @brief Set the interrupt mode for the HLW811X.
+ *
+ * This function sets the interrupt mode for the HLW811X, configuring how
+ * the device handles and generates interrupt signals.
+ *
+ * @param[in] int1 Interrupt mode for INT1 to set.
+ * @param[in] int2 Interrupt mode for INT2 to set.
+ *
+ * @note Each of @p int1 and @p int2 is a single flag or HLW811X_INTR_IRQ.
+ *       0 selects HLW811X_INTR_PULSE_OUT_A, the default of the chip.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_PARAM if a flag cannot be routed to
+ *                         the pin, e.g. HLW811X_INTR_RESERVED.
+ */
+hlw811x_error_t hlw811x_set_interrupt_mode(hlw811x_intr_t int1,
+		hlw811x_intr_t int2);
+
+/**
+ * @brief Get the current interrupt status for the HLW811X.
+ *
+ * This function retrieves the current interrupt status from the HLW811X,
+ * indicating which interrupts are currently active.
+ *
+ * @param[out] ints Pointer to the variable where the current interrupt status
+ * will be stored.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_get_interrupt(hlw811x_intr_t *ints);
+
+/**
+ * @brief Get the current interrupt status for the HLW811X.
+ *
+ * This function retrieves the current interrupt status from the HLW811X,
+ * indicating which interrupts are currently active.
+ *
+ * @param[out] ints Pointer to the variable where the current interrupt status
+ * will be stored.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_get_interrupt_ext(hlw811x_intr_t *ints);
+
+/**
+ * @brief Register a handler for HLW811X interrupt flags.
+ *
+ * The handler replaces the one registered before for the same flags. Passing
+ * NULL unregisters.
+ *
+ * @param[in] ints Interrupt flags to be handled. More than one can be given.
+ * @param[in] handler Handler to be called by hlw811x_handle_irq().
+ * @param[in] ctx User context passed to @p handler as is.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_register_irq_handler(hlw811x_intr_t ints,
+		hlw811x_irq_handler_t handler, void *ctx);
+
+/**
+ * @brief Dispatch the pending HLW811X interrupts.
+ *
+ * This function reads and clears the interrupt flags once, then calls the
+ * registered handler of each pending flag in bit order. It is meant to be
+ * called when INT1 or INT2 is asserted. The handlers run in the context of the
+ * caller and usually read the chip, e.g. hlw811x_read_snapshot() on
+ * HLW811X_INTR_AVERAGE_UPDATED, so call it from a task woken up by the GPIO
+ * interrupt rather than from the ISR itself unless the bus can be used there.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ *                         A failure of hlw811x_capture_events() is returned
+ *                         after the handlers are called.
+ */
+hlw811x_error_t hlw811x_handle_irq(void);
+
+/**
+ * @brief Call a function for each flag set in an interrupt mask.
+ *
+ * The flags are visited from the lowest bit, skipping the clear ones, so the
+ * cost is proportional to the number of pending flags. This is useful when
+ * decoding the mask returned by hlw811x_get_interrupt() without registering
+ * handlers.
+ *
+ * @param[in] ints Interrupt mask, e.g. as read by hlw811x_get_interrupt().
+ * @param[in] fn Function to be called with a single flag at a time.
+ * @param[in] ctx User context passed to @p fn as is.
+ */
+void hlw811x_for_each_pending(hlw811x_intr_t ints,
+		hlw811x_irq_handler_t fn, void *ctx);
+
+/**
+ * @brief Start tracking the line frequency and phase from zero-crossings.
+ *
+ * The tracker keeps a filtered line period from the voltage crossings and the
+ * phase of current A against the voltage, without reading any register per
+ * crossing. The zero-crossing mode is read once here, so call it again after
+ * changing the mode. The zero-crossing interrupts must be enabled separately.
+ *
+ * @param[in] clock Clock to timestamp the crossings dispatched by
+ *                  hlw811x_handle_irq(). NULL if the crossings are fed only by
+ *                  hlw811x_feed_zerocrossing().
+ * @param[in] ctx User context passed to @p clock as is.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_start_zc_tracker(hlw811x_clock_t clock, void *ctx);
+
+/**
+ * @brief Stop the zero-crossing tracker.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_stop_zc_tracker(void);
+
+/**
+ * @brief Feed a zero-crossing to the tracker.
+ *
+ * Use this to timestamp the crossings right in the GPIO ISR, which is more
+ * accurate than the timestamp taken by hlw811x_handle_irq(). Intervals out of
+ * 40Hz to 70Hz, e.g. due to a missed crossing, are ignored.
+ *
+ * @param[in] flag HLW811X_INTR_ZERO_CROSSING_VOLTAGE or
+ *                 HLW811X_INTR_ZERO_CROSSING_CURRENT_A.
+ * @param[in] timestamp_us Time of the crossing in microseconds.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_feed_zerocrossing(hlw811x_intr_t flag,
+		uint32_t timestamp_us);
+
+/**
+ * @brief Get the line frequency tracked from the zero-crossings.
+ *
+ * @param[out] centihertz Pointer to the variable where the frequency (in
+ *                        centihertz) will be stored.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_DATA if no line period has been
+ *                         measured yet.
+ */
+hlw811x_error_t hlw811x_get_tracked_frequency(int32_t *centihertz);
+
+/**
+ * @brief Get the phase of current A behind the voltage from the zero-crossings.
+ *
+ * With HLW811x_ZERO_CROSSING_MODE_BOTH, the phase is within a half cycle.
+ *
+ * @param[out] centidegree Pointer to the variable where the phase (in
+ *                         centidegrees) will be stored.
+ *
+ * @note hlw811x_handle_irq() skips the phase when the voltage and current
+ *       crossings are read in the same batch, as their timestamps would be
+ *       the same.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_DATA if no phase has been measured
+ *                         yet.
+ */
+hlw811x_error_t hlw811x_get_tracked_phase(int32_t *centidegree);
+
+/**
+ * @brief Get the nominal line frequency nearest to the tracked one.
+ *
+ * The result can be passed to hlw811x_get_phase_angle().
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @param[out] freq Pointer to the variable where the line frequency will be
+ *                  stored.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_DATA if no line period has been
+ *                         measured yet.
  */
-hlw811x_error_t hlw811x_enable_temperature_sensor(void);
+hlw811x_error_t hlw811x_get_line_freq(hlw811x_line_freq_t *freq);
 
 /**
- * @brief Disable temperature sensor.
+ * @brief Predict the time of the next voltage zero-crossing.
  *
- * This function disables the temperature sensor of the HLW811X,
- * preventing temperature measurements.
+ * Useful to align reads with the line cycles.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @param[out] timestamp_us Pointer to the variable where the time (in
+ *                          microseconds of the tracker clock) will be stored.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_DATA if no line period has been
+ *                         measured yet.
  */
-hlw811x_error_t hlw811x_disable_temperature_sensor(void);
+hlw811x_error_t hlw811x_get_next_zerocrossing(uint32_t *timestamp_us);
 
 /**
- * @brief Enable peak detection.
+ * @brief Select the active HLW811X channel.
  *
- * This function enables the peak detection feature of the HLW811X,
- * allowing the detection of peak values in the channel signals.
+ * This function selects the specified HLW811X channel as the active channel for
+ * subsequent operations.
  *
- * @note hlw811x_enable_waveform() must be enabled to use this functionality.
+ * @param[in] channel The HLW811X channel to select.
  *
  * @return hlw811x_error_t Error code indicating the result of the operation.
  */
-hlw811x_error_t hlw811x_enable_peak_detection(void);
+hlw811x_error_t hlw811x_select_channel(hlw811x_channel_t channel);
 
 /**
- * @brief Disable peak detection.
+ * @brief Read the current active HLW811X channel.
  *
- * This function disables the peak detection feature of the HLW811X,
- * preventing the detection of peak values in the channel signals.
+ * This function reads the current active channel of the HLW811X and stores it
+ * in the provided channel variable.
+ *
+ * @param[out] channel Pointer to the variable where the current active channel
+ * will be stored.
  *
  * @return hlw811x_error_t Error code indicating the result of the operation.
  */
-hlw811x_error_t hlw811x_disable_peak_detection(void);
+hlw811x_error_t hlw811x_read_current_channel(hlw811x_channel_t *channel);
 
 /**
- * @brief Enable overload detection.
+ * @brief Start the channel-aware acquisition mode.
  *
- * This function enables the overload detection feature of the HLW811X,
- * allowing the detection of overload conditions in the channel signals.
+ * The selected current channel is kept in memory from then on. Selecting the
+ * channel selected already sends nothing, and the current channel is no
+ * longer read from METER_STATUS, e.g. for each apparent power. The channel
+ * is read once when not known yet, as after hlw811x_reset().
  *
- * @note hlw811x_enable_waveform() must be enabled to use this functionality.
+ * @note Selecting the channel through hlw811x_write_reg() bypasses the cache.
+ *
+ * @param[in] clock Clock to time the settling after a switch.
+ * @param[in] ctx User context passed to @p clock as is.
+ * @param[in] settle_ms Time the channel-dependent registers take to reflect
+ *                      a newly selected channel. At least one update period
+ *                      of the chip.
  *
  * @return hlw811x_error_t Error code indicating the result of the operation.
  */
-hlw811x_error_t hlw811x_enable_overload_detection(void);
+hlw811x_error_t hlw811x_start_channel_mux(hlw811x_clock_t clock, void *ctx,
+		uint16_t settle_ms);
 
 /**
- * @brief Disable overload detection.
- *
- * This function disables the overload detection feature of the HLW811X,
- * preventing the detection of overload conditions int the channel signals.
+ * @brief Stop the channel-aware acquisition mode.
  *
  * @return hlw811x_error_t Error code indicating the result of the operation.
  */
-hlw811x_error_t hlw811x_disable_overload_detection(void);
+hlw811x_error_t hlw811x_stop_channel_mux(void);
 
 /**
- * @brief Enable voltage drop detection.
+ * @brief Read the quantities of a current channel together.
  *
- * This function enables the voltage drop detection feature of the HLW811X,
- * allowing the detection of voltage drops in the channel signals.
+ * The channel is selected first unless selected already. Reading all the
+ * quantities of one channel before moving to the other keeps the switches
+ * to one per group. Right after a switch, HLW811X_BUSY is returned until
+ * the settling time has passed, without switching again when called back.
  *
- * @note hlw811x_enable_waveform() must be enabled to use this functionality.
+ * @param[in] channel HLW811X_CHANNEL_A or HLW811X_CHANNEL_B.
+ * @param[out] group Pointer to the structure to store the quantities.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @return hlw811x_error_t HLW811X_BUSY while the channel settles,
+ *                         HLW811X_INVALID_PARAM if the mode is not started.
  */
-hlw811x_error_t hlw811x_enable_voltage_drop_detection(void);
+hlw811x_error_t hlw811x_read_channel_group(hlw811x_channel_t channel,
+		struct hlw811x_channel_group *group);
 
 /**
- * @brief Disable voltage drop detection.
+ * @brief Get the statistics of the channel-aware acquisition mode.
  *
- * This function disables the voltage drop detection feature of the HLW811X,
- * preventing the detection of voltage drops in the channel signals.
+ * @param[out] stats Pointer to the structure to store the statistics.
  *
  * @return hlw811x_error_t Error code indicating the result of the operation.
  */
-hlw811x_error_t hlw811x_disable_voltage_drop_detection(void);
+hlw811x_error_t hlw811x_get_channel_mux_stats(
+		struct hlw811x_channel_mux_stats *stats);
 
 /**
- * @brief Enable specific interrupts for the HLW811X.
+ * @brief Read the calibration coefficients from the HLW811X.
  *
- * This function enables the specified interrupts for the HLW811X,
- * allowing the device to generate interrupt signals for the specified events.
+ * This function reads the calibration coefficients from the HLW811X and stores
+ * them in the provided hlw811x_coeff structure.
  *
- * @param[in] ints The interrupts to enable.
+ * @param[out] coeff Pointer to the structure where the calibration coefficients
+ * will be stored.
  *
  * @return hlw811x_error_t Error code indicating the result of the operation.
  */
-hlw811x_error_t hlw811x_enable_interrupt(hlw811x_intr_t ints);
+hlw811x_error_t hlw811x_read_coeff(struct hlw811x_coeff *coeff);
 
 /**
- * @brief Disable specific interrupts for the HLW811X.
+ * @brief Export the calibration as a blob to be kept in non-volatile memory.
  *
- * This function disables the specified interrupts for the HLW811X,
- * preventing the device from generating interrupt signals for the specified
- * events.
+ * The blob holds the coefficients last read by hlw811x_read_coeff(), their
+ * COEFF_CHKSUM, the resistor ratio and the PGA gains the conversion assumes.
+ * It is versioned and protected by a CRC-16. The byte order is fixed, so the
+ * blob can be moved between targets.
  *
- * @param[in] ints The interrupts to disable.
+ * @param[out] buf Buffer to store the blob.
+ * @param[in] bufsize Size of the buffer, at least HLW811X_CALIB_BLOB_SIZE.
+ * @param[out] len Number of the bytes stored in @p buf. Can be NULL.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @return hlw811x_error_t HLW811X_BUFFER_TOO_SMALL if @p buf is too small.
  */
-hlw811x_error_t hlw811x_disable_interrupt(hlw811x_intr_t ints);
+hlw811x_error_t hlw811x_export_calib(uint8_t *buf, size_t bufsize,
+		size_t *len);
 
 /**
- * @brief Set the interrupt mode for the HLW811X.
+ * @brief Restore the calibration from a blob made by hlw811x_export_calib().
  *
- * This function sets the interrupt mode for the HLW811X, configuring how
- * the device handles and generates interrupt signals.
+ * This function validates the stored coefficients with a single read of the
+ * COEFF_CHKSUM register instead of reading all of them. Only when the chip
+ * reports another checksum are the coefficients read again, as
+ * hlw811x_read_coeff() does, in which case @p refreshed is set to tell that
+ * the blob should be exported again.
  *
- * @param[in] int1 Interrupt mode for INT1 to set.
- * @param[in] int2 Interrupt mode for INT2 to set.
+ * The resistor ratio and the PGA gains only update the conversion. The PGA
+ * registers of the chip are left untouched and still have to be configured
+ * after a reset of the chip.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @param[in] blob The blob.
+ * @param[in] bloblen Size of the blob.
+ * @param[out] refreshed Set true if the coefficients were read from the
+ *                       chip instead. Can be NULL.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_DATA if the blob is corrupted or of
+ *                         another version, in which case nothing is changed.
  */
-hlw811x_error_t hlw811x_set_interrupt_mode(hlw811x_intr_t int1,
-		hlw811x_intr_t int2);
+hlw811x_error_t hlw811x_import_calib(const uint8_t *blob, size_t bloblen,
+		bool *refreshed);
 
 /**
- * @brief Get the current interrupt status for the HLW811X.
+ * @brief Start calibrating the active power of a channel.
  *
- * This function retrieves the current interrupt status from the HLW811X,
- * indicating which interrupts are currently active.
+ * This function clears the power gain, phase and offset registers of the
+ * channel so that the following steps measure the uncorrected power. The
+ * steps are then run with hlw811x_calib_feed(), the gain step first, and
+ * the results written with hlw811x_calib_commit().
  *
- * @param[out] ints Pointer to the variable where the current interrupt status
- * will be stored.
+ * @param[in] channel HLW811X_CHANNEL_A or HLW811X_CHANNEL_B.
+ * @param[in] samples Number of updates averaged per step, up to
+ *                    HLW811X_CALIB_SAMPLES_MAX.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @return hlw811x_error_t HLW811X_ERROR_NONE on success, otherwise an error
+ *                         code.
  */
-hlw811x_error_t hlw811x_get_interrupt(hlw811x_intr_t *ints);
+hlw811x_error_t hlw811x_calib_begin(hlw811x_channel_t channel,
+		uint8_t samples);
 
 /**
- * @brief Get the current interrupt status for the HLW811X.
+ * @brief Feed a measurement of a calibration step.
  *
- * This function retrieves the current interrupt status from the HLW811X,
- * indicating which interrupts are currently active.
+ * This function is to be called once per data update period while the
+ * reference load of @p step is applied. It reads the active power of the
+ * channel and, once enough samples are averaged, solves the register of the
+ * step against @p ref_milliwatt. Switching to another step starts over.
  *
- * @param[out] ints Pointer to the variable where the current interrupt status
- * will be stored.
+ * @param[in] step The reference load applied.
+ * @param[in] ref_milliwatt Active power of the reference in milliwatt.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @return hlw811x_error_t HLW811X_BUSY while collecting samples,
+ *                         HLW811X_ERROR_NONE once the step is solved or
+ *                         HLW811X_INVALID_PARAM if no calibration is started.
  */
-hlw811x_error_t hlw811x_get_interrupt_ext(hlw811x_intr_t *ints);
+hlw811x_error_t hlw811x_calib_feed(hlw811x_calib_step_t step,
+		int32_t ref_milliwatt);
 
 /**
- * @brief Select the active HLW811X channel.
+ * @brief Write the solved registers and finish the calibration.
  *
- * This function selects the specified HLW811X channel as the active channel for
- * subsequent operations.
+ * The registers are written in a single write-enabled window, or staged
+ * into the transaction in progress if any.
  *
- * @param[in] channel The HLW811X channel to select.
+ * @param[out] regs The registers written, to be persisted. Can be NULL.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @return hlw811x_error_t HLW811X_ERROR_NONE on success, otherwise an error
+ *                         code.
  */
-hlw811x_error_t hlw811x_select_channel(hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_calib_commit(struct hlw811x_calib_regs *regs);
 
 /**
- * @brief Read the current active HLW811X channel.
+ * @brief Restore the registers of a previous calibration.
  *
- * This function reads the current active channel of the HLW811X and stores it
- * in the provided channel variable.
+ * @param[in] regs The registers given by hlw811x_calib_commit().
  *
- * @param[out] channel Pointer to the variable where the current active channel
- * will be stored.
+ * @return hlw811x_error_t HLW811X_ERROR_NONE on success, otherwise an error
+ *                         code.
+ */
+hlw811x_error_t hlw811x_calib_apply(const struct hlw811x_calib_regs *regs);
+
+/**
+ * @brief Serialize the registers of a calibration to be kept in non-volatile
+ *        memory.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * The blob is framed as the one of hlw811x_export_calib(): versioned,
+ * protected by a CRC-16 and in a fixed byte order.
+ *
+ * @param[in] regs The registers given by hlw811x_calib_commit().
+ * @param[out] buf Buffer to store the blob.
+ * @param[in] bufsize Size of the buffer, at least
+ *                    HLW811X_CALIB_REGS_BLOB_SIZE.
+ * @param[out] len Number of the bytes stored in @p buf. Can be NULL.
+ *
+ * @return hlw811x_error_t HLW811X_BUFFER_TOO_SMALL if @p buf is too small.
  */
-hlw811x_error_t hlw811x_read_current_channel(hlw811x_channel_t *channel);
+hlw811x_error_t hlw811x_export_calib_regs(
+		const struct hlw811x_calib_regs *regs,
+		uint8_t *buf, size_t bufsize, size_t *len);
 
 /**
- * @brief Read the calibration coefficients from the HLW811X.
+ * @brief Restore the registers of a calibration from a blob made by
+ *        hlw811x_export_calib_regs().
  *
- * This function reads the calibration coefficients from the HLW811X and stores
- * them in the provided hlw811x_coeff structure.
+ * Nothing is written to the chip. Pass @p regs to hlw811x_calib_apply() for
+ * that.
  *
- * @param[out] coeff Pointer to the structure where the calibration coefficients
- * will be stored.
+ * @param[in] blob The blob.
+ * @param[in] bloblen Size of the blob.
+ * @param[out] regs Pointer to the structure where the registers will be
+ *                  stored.
  *
- * @return hlw811x_error_t Error code indicating the result of the operation.
+ * @return hlw811x_error_t HLW811X_INVALID_DATA if the blob is corrupted or of
+ *                         another version, in which case @p regs is left
+ *                         untouched.
  */
-hlw811x_error_t hlw811x_read_coeff(struct hlw811x_coeff *coeff);
+hlw811x_error_t hlw811x_import_calib_regs(const uint8_t *blob,
+		size_t bloblen, struct hlw811x_calib_regs *regs);
 
 /**
  * @brief Set the resistor ratio for the HLW811X.
@@ -792,6 +1991,111 @@ hlw811x_error_t hlw811x_get_power(hlw811x_channel_t channel, int32_t *milliwatt)
  */
 hlw811x_error_t hlw811x_get_energy(hlw811x_channel_t channel, int32_t *Wh);
 
+/**
+ * @brief Convert raw RMS register values without accessing the bus.
+ *
+ * This function applies the same conversion as hlw811x_get_rms() to an array
+ * of raw register values, e.g. a register dump forwarded to a gateway. The
+ * conversion uses the coefficients, the resistor ratio and the PGA gains the
+ * instance currently holds.
+ *
+ * @param[in] channel The HLW811X channel the values were read from.
+ * @param[in] raw Array of @p n raw register values.
+ * @param[out] milliunit Array of @p n converted values, in milliunits.
+ * @param[in] n Number of the values.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_DATA if any of the values has the
+ *                         sign bit set, for which 0 is stored instead.
+ */
+hlw811x_error_t hlw811x_convert_rms_batch(hlw811x_channel_t channel,
+		const int32_t *raw, int32_t *milliunit, size_t n);
+
+/**
+ * @brief Convert raw power register values without accessing the bus.
+ *
+ * @param[in] channel The HLW811X channel the values were read from.
+ *                    HLW811X_CHANNEL_U for the apparent power.
+ * @param[in] current_channel The current channel selected when the apparent
+ *                            power was read. Ignored for other channels.
+ * @param[in] raw Array of @p n raw register values.
+ * @param[out] milliwatt Array of @p n converted values, in milliwatts.
+ * @param[in] n Number of the values.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_convert_power_batch(hlw811x_channel_t channel,
+		hlw811x_channel_t current_channel,
+		const int32_t *raw, int32_t *milliwatt, size_t n);
+
+/**
+ * @brief Convert raw energy register values without accessing the bus.
+ *
+ * @param[in] channel HLW811X_CHANNEL_A or HLW811X_CHANNEL_B.
+ * @param[in] raw Array of @p n raw register values.
+ * @param[out] Wh Array of @p n converted values, in watt-hours.
+ * @param[in] n Number of the values.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_convert_energy_batch(hlw811x_channel_t channel,
+		const int32_t *raw, int32_t *Wh, size_t n);
+
+/**
+ * @brief Poll the energy registers into the 64-bit accumulators.
+ *
+ * This function reads ENERGY_PA and ENERGY_PB and adds what has been counted
+ * since the last poll to the accumulator of each channel, in raw register
+ * units. A channel with the energy clearance enabled adds what it reads, and
+ * any other channel adds the difference from the last poll modulo the 24-bit
+ * register range. The first poll of a channel without the clearance only sets
+ * the baseline.
+ *
+ * A register wrap that leaves the register past the last read value can only
+ * be told by the overflow interrupt, so pass the flags consumed from RIF since
+ * the last poll, i.e. read by hlw811x_get_interrupt_ext() or gathered from the
+ * handlers of hlw811x_handle_irq(). A flag given at consecutive polls is
+ * counted once, as IF read by hlw811x_get_interrupt() keeps it until RIF is
+ * read. Polling once per wrap period is enough otherwise.
+ *
+ * @note Reading the energy registers otherwise, e.g. by hlw811x_get_energy(),
+ *       drops the energy read from the accumulators on channels with the
+ *       energy clearance enabled.
+ *
+ * @param[in] ints Pending interrupts. HLW811X_INTR_ACTIVE_POWER_OVERFLOW_A and
+ *                 HLW811X_INTR_ACTIVE_POWER_OVERFLOW_B are looked at.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_update_energy(hlw811x_intr_t ints);
+
+/**
+ * @brief Get the energy accumulated by hlw811x_update_energy().
+ *
+ * The raw counts are converted with the calibration at the time of the call.
+ *
+ * @param[in] channel HLW811X_CHANNEL_A or HLW811X_CHANNEL_B.
+ * @param[out] Wh Pointer to the variable where the accumulated energy (in
+ *                watt-hours) will be stored.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_get_energy_total(hlw811x_channel_t channel,
+		uint64_t *Wh);
+
+/**
+ * @brief Get the energy accumulated since the last call.
+ *
+ * Only whole watt-hours are handed out. The fraction is carried over to the
+ * next call, so that nothing is lost however often it is called.
+ *
+ * @param[in] channel HLW811X_CHANNEL_A or HLW811X_CHANNEL_B.
+ * @param[out] Wh Pointer to the variable where the energy (in watt-hours) will
+ *                be stored.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_energy_delta(hlw811x_channel_t channel, int32_t *Wh);
+
 /**
  * @brief Get the frequency of the HLW811X.
  *
@@ -838,6 +2142,471 @@ hlw811x_error_t hlw811x_get_power_factor(int32_t *centiunit);
 hlw811x_error_t hlw811x_get_phase_angle(int32_t *centidegree,
 		hlw811x_line_freq_t freq);
 
+/**
+ * @brief Get the temperature inside the HLW811X.
+ *
+ * This function reads channel B, which must be in HLW811X_B_MODE_TEMPERATURE
+ * with the temperature sensor enabled. The mode is cached from
+ * hlw811x_set_channel_b_mode(), hlw811x_apply_config() or the polling
+ * scheduler, so it is read from the chip only when not known yet.
+ *
+ * The reading is converted linearly by HLW811X_TEMP_REF_RAW, the reading at
+ * HLW811X_TEMP_REF_CENTIDEGREE, and HLW811X_TEMP_COUNTS_PER_DEGREE. The
+ * datasheet gives no such figures, so they are to be characterized on the
+ * board and defined at build time. There are no defaults.
+ *
+ * @param[out] centidegree Pointer to the variable where the temperature (in
+ * centidegree Celsius) will be stored.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_PARAM if channel B measures
+ *                         current, or HLW811X_NOT_IMPLEMENTED if built
+ *                         without the fit.
+ */
+hlw811x_error_t hlw811x_get_temperature(int32_t *centidegree);
+
+/**
+ * @brief Read all the measurements of the HLW811X at once.
+ *
+ * This function reads every measurement register exactly once, back to back in
+ * address order, and converts them afterward. Compared to calling each getter
+ * in turn, the chip status is read only once and all values come from the same
+ * update period as long as the reads fit in it, which is best ensured by
+ * calling this function right after HLW811X_INTR_AVERAGE_UPDATED.
+ *
+ * The phase angle is scaled for 60Hz if the measured frequency is above 55Hz,
+ * and for 50Hz otherwise.
+ *
+ * @note The energy registers are cleared on read for the channels enabled by
+ *       hlw811x_enable_energy_clearance(), just like hlw811x_get_energy().
+ *
+ * @note With channel B in HLW811X_B_MODE_TEMPERATURE, its reading is given as
+ *       the temperature too, and the current and power of channel B are not
+ *       meaningful.
+ *
+ * @param[out] snapshot Pointer to the structure where the measurements will be
+ *                      stored.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_read_snapshot(struct hlw811x_snapshot *snapshot);
+
+/**
+ * @brief Register a quantity to be polled by the scheduler.
+ *
+ * The interval is rounded to a whole number of chip update periods, of one
+ * at least. Registering a quantity again replaces its interval and priority.
+ *
+ * HLW811X_QTY_TEMPERATURE is interleaved when channel B measures current:
+ * the channel is switched to the temperature, read once settled for
+ * HLW811X_TEMP_SETTLE_PERIODS, and switched back. The current and power of
+ * channel B are held meanwhile, so poll the temperature at a low rate. It is
+ * rejected with HLW811X_NOT_IMPLEMENTED if built without the fit of
+ * hlw811x_get_temperature().
+ *
+ * @param[in] qty Quantity to poll.
+ * @param[in] interval_ms Target interval between the reads in milliseconds.
+ * @param[in] priority Higher values are read first within a period and are
+ *                     the last to be shed.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_add_poll(hlw811x_quantity_t qty,
+		uint16_t interval_ms, uint8_t priority);
+
+/**
+ * @brief Stop polling a quantity.
+ *
+ * @param[in] qty Quantity to stop polling.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_remove_poll(hlw811x_quantity_t qty);
+
+/**
+ * @brief Start the cooperative polling scheduler.
+ *
+ * The scheduler divides time into the update periods of the chip, read once
+ * here from the data update frequency, so call it again after changing the
+ * frequency. In each period, the due quantities are read at most once, the
+ * highest priority first, until @p budget is spent. The ones that do not fit
+ * are shed to the next period, which keeps the bus duty cycle bounded when
+ * the bus is shared with other traffic.
+ *
+ * @param[in] clock Clock the periods are measured with.
+ * @param[in] clock_ctx User context passed to @p clock as is.
+ * @param[in] budget Register reads allowed per period. 0 for no limit.
+ * @param[in] cb Function to be called with each value read.
+ * @param[in] cb_ctx User context passed to @p cb as is.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_start_poll_scheduler(hlw811x_clock_t clock,
+		void *clock_ctx, uint8_t budget, hlw811x_poll_cb_t cb,
+		void *cb_ctx);
+
+/**
+ * @brief Stop the polling scheduler.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_stop_poll_scheduler(void);
+
+/**
+ * @brief Align the scheduler periods to the chip updates.
+ *
+ * Without this, the periods start at hlw811x_start_poll_scheduler() and drift
+ * against the chip by the tolerance of the clocks. Calling this on
+ * HLW811X_INTR_AVERAGE_UPDATED starts a period at each update of the chip,
+ * so that the reads never straddle one.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_PARAM if the scheduler is stopped.
+ */
+hlw811x_error_t hlw811x_sync_poll_scheduler(void);
+
+/**
+ * @brief Run the polling scheduler.
+ *
+ * Call this as often as convenient from the main loop or a task. It returns
+ * right away without accessing the bus until the next period starts.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_PARAM if the scheduler is stopped,
+ *                         or the error of the read that failed, which is
+ *                         tried again in the next period.
+ */
+hlw811x_error_t hlw811x_run_poll_scheduler(void);
+
+/**
+ * @brief Get the statistics of the polling scheduler.
+ *
+ * @param[out] stats Pointer to the structure to store the statistics.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_get_poll_stats(struct hlw811x_poll_stats *stats);
+
+/*
+ * Per-instance API.
+ *
+ * Each function below behaves exactly as its default-instance counterpart
+ * without the `_dev` infix, e.g. hlw811x_dev_get_rms() as hlw811x_get_rms(),
+ * but operates on the instance given by @p self.
+ */
+hlw811x_error_t hlw811x_dev_reset(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_shadow(struct hlw811x *self);
+void hlw811x_dev_disable_shadow(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_verify_shadow(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_start_power_save(struct hlw811x *self,
+		hlw811x_channel_t channels, hlw811x_channel_t pulse,
+		hlw811x_clock_t clock, void *clock_ctx);
+hlw811x_error_t hlw811x_dev_stop_power_save(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_open_window(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_close_window(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_is_window_ready(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_begin_config(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_commit_config(struct hlw811x *self);
+void hlw811x_dev_abort_config(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_apply_config(struct hlw811x *self,
+		const struct hlw811x_config *cfg);
+hlw811x_error_t hlw811x_dev_write_reg(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, const uint8_t *data, size_t datalen);
+hlw811x_error_t hlw811x_dev_read_reg(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, uint8_t *buf, size_t bufsize);
+hlw811x_error_t hlw811x_dev_read_regs(struct hlw811x *self,
+		hlw811x_reg_addr_t start, hlw811x_reg_addr_t end,
+		uint8_t *buf, size_t bufsize, size_t *len);
+hlw811x_error_t hlw811x_dev_submit_read(struct hlw811x *self,
+		hlw811x_reg_addr_t addr, size_t len,
+		hlw811x_read_cb_t cb, void *ctx);
+hlw811x_error_t hlw811x_dev_on_rx(struct hlw811x *self,
+		const uint8_t *data, size_t datalen);
+hlw811x_error_t hlw811x_dev_submit_snapshot(struct hlw811x *self,
+		hlw811x_snapshot_cb_t cb, void *ctx);
+hlw811x_error_t hlw811x_dev_cancel_reads(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_get_queue_stats(struct hlw811x *self,
+		struct hlw811x_queue_stats *stats);
+void hlw811x_dev_set_transport_policy(struct hlw811x *self,
+		const struct hlw811x_transport_policy *policy);
+hlw811x_error_t hlw811x_dev_get_transport_stats(struct hlw811x *self,
+		struct hlw811x_transport_stats *stats);
+hlw811x_error_t hlw811x_dev_set_stats_clock(struct hlw811x *self,
+		hlw811x_clock_t clock, void *ctx);
+hlw811x_error_t hlw811x_dev_get_stats(struct hlw811x *self,
+		struct hlw811x_stats *stats);
+hlw811x_error_t hlw811x_dev_clear_stats(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_channel(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_disable_channel(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_enable_pulse(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_disable_pulse(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_enable_waveform(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_disable_waveform(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_start_waveform_stream(struct hlw811x *self,
+		hlw811x_channel_t channels, struct hlw811x_wave_ring *ring);
+hlw811x_error_t hlw811x_dev_stop_waveform_stream(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_sample_waveform(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_zerocrossing(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_disable_zerocrossing(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_power_factor(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_disable_power_factor(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_energy_clearance(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_disable_energy_clearance(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_enable_hpf(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_disable_hpf(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_enable_b_channel_comparator(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_disable_b_channel_comparator(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_temperature_sensor(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_disable_temperature_sensor(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_peak_detection(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_disable_peak_detection(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_overload_detection(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_disable_overload_detection(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_voltage_drop_detection(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_disable_voltage_drop_detection(
+		struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_set_threshold(struct hlw811x *self,
+		hlw811x_threshold_t type, int32_t milliunit);
+hlw811x_error_t hlw811x_dev_set_sag_period(struct hlw811x *self,
+		uint16_t half_cycles);
+hlw811x_error_t hlw811x_dev_start_event_capture(struct hlw811x *self,
+		hlw811x_intr_t ints, hlw811x_clock_t clock, void *ctx);
+hlw811x_error_t hlw811x_dev_stop_event_capture(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_capture_events(struct hlw811x *self,
+		hlw811x_intr_t ints);
+size_t hlw811x_dev_drain_events(struct hlw811x *self,
+		struct hlw811x_event *events, size_t n);
+uint32_t hlw811x_dev_get_dropped_events(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_enable_interrupt(struct hlw811x *self,
+		hlw811x_intr_t ints);
+hlw811x_error_t hlw811x_dev_disable_interrupt(struct hlw811x *self,
+		hlw811x_intr_t ints);
+hlw811x_error_t hlw811x_dev_set_interrupt_mode(struct hlw811x *self,
+		hlw811x_intr_t int1, hlw811x_intr_t int2);
+hlw811x_error_t hlw811x_dev_get_interrupt(struct hlw811x *self,
+		hlw811x_intr_t *ints);
+hlw811x_error_t hlw811x_dev_get_interrupt_ext(struct hlw811x *self,
+		hlw811x_intr_t *ints);
+hlw811x_error_t hlw811x_dev_register_irq_handler(struct hlw811x *self,
+		hlw811x_intr_t ints, hlw811x_irq_handler_t handler, void *ctx);
+hlw811x_error_t hlw811x_dev_handle_irq(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_start_zc_tracker(struct hlw811x *self,
+		hlw811x_clock_t clock, void *ctx);
+hlw811x_error_t hlw811x_dev_stop_zc_tracker(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_feed_zerocrossing(struct hlw811x *self,
+		hlw811x_intr_t flag, uint32_t timestamp_us);
+hlw811x_error_t hlw811x_dev_get_tracked_frequency(struct hlw811x *self,
+		int32_t *centihertz);
+hlw811x_error_t hlw811x_dev_get_tracked_phase(struct hlw811x *self,
+		int32_t *centidegree);
+hlw811x_error_t hlw811x_dev_get_line_freq(struct hlw811x *self,
+		hlw811x_line_freq_t *freq);
+hlw811x_error_t hlw811x_dev_get_next_zerocrossing(struct hlw811x *self,
+		uint32_t *timestamp_us);
+hlw811x_error_t hlw811x_dev_select_channel(struct hlw811x *self,
+		hlw811x_channel_t channel);
+hlw811x_error_t hlw811x_dev_read_current_channel(struct hlw811x *self,
+		hlw811x_channel_t *channel);
+hlw811x_error_t hlw811x_dev_start_channel_mux(struct hlw811x *self,
+		hlw811x_clock_t clock, void *ctx, uint16_t settle_ms);
+hlw811x_error_t hlw811x_dev_stop_channel_mux(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_read_channel_group(struct hlw811x *self,
+		hlw811x_channel_t channel, struct hlw811x_channel_group *group);
+hlw811x_error_t hlw811x_dev_get_channel_mux_stats(struct hlw811x *self,
+		struct hlw811x_channel_mux_stats *stats);
+hlw811x_error_t hlw811x_dev_read_coeff(struct hlw811x *self,
+		struct hlw811x_coeff *coeff);
+hlw811x_error_t hlw811x_dev_export_calib(struct hlw811x *self,
+		uint8_t *buf, size_t bufsize, size_t *len);
+hlw811x_error_t hlw811x_dev_import_calib(struct hlw811x *self,
+		const uint8_t *blob, size_t bloblen, bool *refreshed);
+hlw811x_error_t hlw811x_dev_calib_begin(struct hlw811x *self,
+		hlw811x_channel_t channel, uint8_t samples);
+hlw811x_error_t hlw811x_dev_calib_feed(struct hlw811x *self,
+		hlw811x_calib_step_t step, int32_t ref_milliwatt);
+hlw811x_error_t hlw811x_dev_calib_commit(struct hlw811x *self,
+		struct hlw811x_calib_regs *regs);
+hlw811x_error_t hlw811x_dev_calib_apply(struct hlw811x *self,
+		const struct hlw811x_calib_regs *regs);
+void hlw811x_dev_set_resistor_ratio(struct hlw811x *self,
+		const struct hlw811x_resistor_ratio *ratio);
+void hlw811x_dev_get_resistor_ratio(struct hlw811x *self,
+		struct hlw811x_resistor_ratio *ratio);
+hlw811x_error_t hlw811x_dev_set_pga(struct hlw811x *self,
+		const struct hlw811x_pga *pga);
+hlw811x_error_t hlw811x_dev_get_pga(struct hlw811x *self,
+		struct hlw811x_pga *pga);
+hlw811x_error_t hlw811x_dev_set_active_power_calc_mode(struct hlw811x *self,
+		hlw811x_active_power_mode_t mode);
+hlw811x_error_t hlw811x_dev_get_active_power_calc_mode(struct hlw811x *self,
+		hlw811x_active_power_mode_t *mode);
+hlw811x_error_t hlw811x_dev_set_rms_calc_mode(struct hlw811x *self,
+		hlw811x_rms_mode_t mode);
+hlw811x_error_t hlw811x_dev_get_rms_calc_mode(struct hlw811x *self,
+		hlw811x_rms_mode_t *mode);
+hlw811x_error_t hlw811x_dev_set_data_update_frequency(struct hlw811x *self,
+		hlw811x_data_update_freq_t freq);
+hlw811x_error_t hlw811x_dev_get_data_update_frequency(struct hlw811x *self,
+		hlw811x_data_update_freq_t *freq);
+hlw811x_error_t hlw811x_dev_set_channel_b_mode(struct hlw811x *self,
+		hlw811x_channel_b_mode_t mode);
+hlw811x_error_t hlw811x_dev_get_channel_b_mode(struct hlw811x *self,
+		hlw811x_channel_b_mode_t *mode);
+hlw811x_error_t hlw811x_dev_set_zerocrossing_mode(struct hlw811x *self,
+		hlw811x_zerocrossing_mode_t mode);
+hlw811x_error_t hlw811x_dev_get_zerocrossing_mode(struct hlw811x *self,
+		hlw811x_zerocrossing_mode_t *mode);
+hlw811x_error_t hlw811x_dev_get_rms(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t *milliunit);
+hlw811x_error_t hlw811x_dev_get_power(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t *milliwatt);
+hlw811x_error_t hlw811x_dev_get_energy(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t *Wh);
+hlw811x_error_t hlw811x_dev_convert_rms_batch(const struct hlw811x *self,
+		hlw811x_channel_t channel, const int32_t *raw,
+		int32_t *milliunit, size_t n);
+hlw811x_error_t hlw811x_dev_convert_power_batch(const struct hlw811x *self,
+		hlw811x_channel_t channel, hlw811x_channel_t current_channel,
+		const int32_t *raw, int32_t *milliwatt, size_t n);
+hlw811x_error_t hlw811x_dev_convert_energy_batch(const struct hlw811x *self,
+		hlw811x_channel_t channel, const int32_t *raw, int32_t *Wh,
+		size_t n);
+hlw811x_error_t hlw811x_dev_update_energy(struct hlw811x *self,
+		hlw811x_intr_t ints);
+hlw811x_error_t hlw811x_dev_get_energy_total(struct hlw811x *self,
+		hlw811x_channel_t channel, uint64_t *Wh);
+hlw811x_error_t hlw811x_dev_energy_delta(struct hlw811x *self,
+		hlw811x_channel_t channel, int32_t *Wh);
+hlw811x_error_t hlw811x_dev_get_frequency(struct hlw811x *self,
+		int32_t *centihertz);
+hlw811x_error_t hlw811x_dev_get_power_factor(struct hlw811x *self,
+		int32_t *centiunit);
+hlw811x_error_t hlw811x_dev_get_phase_angle(struct hlw811x *self,
+		int32_t *centidegree, hlw811x_line_freq_t freq);
+hlw811x_error_t hlw811x_dev_get_temperature(struct hlw811x *self,
+		int32_t *centidegree);
+hlw811x_error_t hlw811x_dev_read_snapshot(struct hlw811x *self,
+		struct hlw811x_snapshot *snapshot);
+hlw811x_error_t hlw811x_dev_add_poll(struct hlw811x *self,
+		hlw811x_quantity_t qty, uint16_t interval_ms, uint8_t priority);
+hlw811x_error_t hlw811x_dev_remove_poll(struct hlw811x *self,
+		hlw811x_quantity_t qty);
+hlw811x_error_t hlw811x_dev_start_poll_scheduler(struct hlw811x *self,
+		hlw811x_clock_t clock, void *clock_ctx, uint8_t budget,
+		hlw811x_poll_cb_t cb, void *cb_ctx);
+hlw811x_error_t hlw811x_dev_stop_poll_scheduler(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_sync_poll_scheduler(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_run_poll_scheduler(struct hlw811x *self);
+hlw811x_error_t hlw811x_dev_get_poll_stats(struct hlw811x *self,
+		struct hlw811x_poll_stats *stats);
+
+/*
+ * Multi-chip aggregation.
+ *
+ * An aggregator reads the snapshots of many instances, typically one per
+ * circuit on buses of their own, in rounds. A round is published only once
+ * every chip has been read in it, so that the published snapshots are close in
+ * time and come with the health of each chip.
+ */
+
+/**
+ * @brief Initialize an aggregator over the given instances.
+ *
+ * @param[out] agg The aggregator to be initialized.
+ * @param[out] chips Storage of @p n chips, owned by the caller.
+ * @param[in] devs Instances to be read, in the order they are published.
+ * @param[in] n Number of the instances.
+ * @param[in] clock Monotonic clock in microseconds timestamping the reads.
+ * @param[in] clock_ctx User context passed to @p clock as is.
+ *
+ * @return hlw811x_error_t Error code indicating the result of the operation.
+ */
+hlw811x_error_t hlw811x_agg_init(struct hlw811x_agg *agg,
+		struct hlw811x_agg_chip *chips, struct hlw811x *const *devs,
+		uint8_t n, hlw811x_clock_t clock, void *clock_ctx);
+
+/**
+ * @brief Read the snapshot of a chip for the current round.
+ *
+ * With a worker per bus, each worker calls this for the chips on its bus only,
+ * right after the chips update, e.g. on HLW811X_INTR_AVERAGE_UPDATED. A failed
+ * read is not retried within the round: the chip keeps its last snapshot and
+ * is marked HLW811X_CHIP_FAILED, so that a dead chip does not hold up the
+ * others.
+ *
+ * The read blocks on the bus of the chip. Do not mix this in with
+ * hlw811x_agg_step() on the same aggregator.
+ *
+ * @param[in] agg The aggregator.
+ * @param[in] index Index of the chip, as given to hlw811x_agg_init().
+ *
+ * @return hlw811x_error_t HLW811X_BUSY if the chip is already read in the
+ *                         current round or being read by hlw811x_agg_step(),
+ *                         or the error of the read.
+ */
+hlw811x_error_t hlw811x_agg_read_chip(struct hlw811x_agg *agg, uint8_t index);
+
+/**
+ * @brief Publish the current round and start the next one.
+ *
+ * Call this from a single context. With workers, it may be polled until every
+ * chip is read.
+ *
+ * @param[in] agg The aggregator.
+ *
+ * @return hlw811x_error_t HLW811X_BUSY if a chip is yet to be read.
+ */
+hlw811x_error_t hlw811x_agg_publish(struct hlw811x_agg *agg);
+
+/**
+ * @brief Read the chips concurrently from a single context.
+ *
+ * Each call submits a snapshot by hlw811x_dev_submit_snapshot() to every chip
+ * yet to be read in the current round and not busy with it already, so that
+ * all the buses transfer at once and a round takes about as long as the
+ * slowest chip. The call never waits on a bus: the received bytes of each
+ * bus are to be fed to hlw811x_dev_on_rx() of its instance, and ll_write()
+ * must not block. The snapshots complete from within hlw811x_dev_on_rx(), so
+ * feed it from the context calling this, or from an interrupt this context
+ * is not preempted by in the middle of a call.
+ *
+ * A chip whose snapshot is not in within HLW811X_AGG_TIMEOUT_MS of the
+ * submission gets its reads cancelled by hlw811x_dev_cancel_reads() and is
+ * marked HLW811X_CHIP_FAILED. The call finding every chip read publishes the
+ * round.
+ *
+ * @param[in] agg The aggregator.
+ *
+ * @return hlw811x_error_t HLW811X_BUSY while the round is being read, or
+ *                         HLW811X_ERROR_NONE once it is published. The
+ *                         errors of the reads are kept in the health of the
+ *                         chips.
+ */
+hlw811x_error_t hlw811x_agg_step(struct hlw811x_agg *agg);
+
+/**
+ * @brief Get the published reading of a chip.
+ *
+ * The reading stays until the next round is published, so call this from the
+ * context calling hlw811x_agg_publish(). The round itself is timestamped by
+ * the timestamp and skew of @p agg.
+ *
+ * @param[in] agg The aggregator.
+ * @param[in] index Index of the chip, as given to hlw811x_agg_init().
+ * @param[out] sample Pointer to the structure where the reading will be
+ *                    stored.
+ *
+ * @return hlw811x_error_t HLW811X_INVALID_PARAM if @p index is out of range,
+ *                         or HLW811X_BUSY if no round is published yet.
+ */
+hlw811x_error_t hlw811x_agg_get(const struct hlw811x_agg *agg, uint8_t index,
+		struct hlw811x_agg_sample *sample);
+
 #if defined(__cplusplus)
 }
 #endif
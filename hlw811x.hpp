@@ -0,0 +1,374 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef HLW811X_HPP
+#define HLW811X_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hlw811x.h"
+
+/* Header-only C++17 wrapper of the C API. The PGA gains, the resistor ratios
+ * and the channels are fixed at compile time, so that everything but the
+ * calibration coefficients of the chip folds into constants and the
+ * conversions reduce to a multiply and a shift, with the same results as the
+ * C API. Only the members used get instantiated. */
+namespace hlw {
+
+template <typename Tag>
+class Quantity {
+public:
+	constexpr Quantity() : value_(0) {}
+	constexpr explicit Quantity(int32_t value) : value_(value) {}
+	constexpr int32_t value() const { return value_; }
+
+	constexpr bool operator==(Quantity rhs) const {
+		return value_ == rhs.value_;
+	}
+	constexpr bool operator!=(Quantity rhs) const {
+		return value_ != rhs.value_;
+	}
+private:
+	int32_t value_;
+};
+
+using MilliVolts = Quantity<struct MilliVoltsTag>;
+using MilliAmps = Quantity<struct MilliAmpsTag>;
+using MilliWatts = Quantity<struct MilliWattsTag>;
+
+/* The resistor ratios are in centi, as the C API rounds them to. The
+ * defaults are the ones of the chip after reset. */
+template <hlw811x_pga_gain_t PgaA = HLW811X_PGA_GAIN_16,
+	hlw811x_pga_gain_t PgaB = HLW811X_PGA_GAIN_1,
+	hlw811x_pga_gain_t PgaU = HLW811X_PGA_GAIN_1,
+	uint16_t K1_A = 100, uint16_t K1_B = 100, uint16_t K2 = 100>
+struct Config {
+	static constexpr hlw811x_pga pga = { PgaA, PgaB, PgaU };
+	static constexpr uint16_t k1_a = K1_A;
+	static constexpr uint16_t k1_b = K1_B;
+	static constexpr uint16_t k2 = K2;
+
+	static_assert(K1_A != 0 && K1_B != 0 && K2 != 0,
+			"resistor ratios must not be zero");
+};
+
+namespace detail {
+
+/* Same as the conversion of the C API: (raw * mult) >> shift */
+struct Factor {
+	uint32_t mult;
+	uint8_t shift;
+};
+
+/* Mirrors make_factor() of hlw811x.c, so that both give the same results */
+constexpr Factor make_factor(uint64_t num, uint64_t den, int exp2) {
+	uint64_t q = 0;
+	uint64_t r = 0;
+	int t = 0;
+
+	if (num == 0 || den == 0) {
+		return Factor { 0, 0 };
+	}
+
+	q = num / den;
+	r = num % den;
+
+	while (q >= (1ull << 31)) {
+		q >>= 1;
+		t--;
+	}
+
+	while (q < (1ull << 30) && t - exp2 < 62) {
+		r <<= 1;
+		q <<= 1;
+		if (r >= den) {
+			r -= den;
+			q |= 1;
+		}
+		t++;
+	}
+
+	if (t - exp2 < 0) {
+		return Factor { INT32_MAX, 0 };
+	}
+
+	return Factor { static_cast<uint32_t>(q),
+		static_cast<uint8_t>(t - exp2) };
+}
+
+constexpr int32_t scale(Factor f, int32_t raw) {
+	const uint64_t mag = raw < 0?
+		static_cast<uint64_t>(-static_cast<int64_t>(raw)) :
+		static_cast<uint64_t>(raw);
+	const int64_t val = static_cast<int64_t>((mag * f.mult) >> f.shift);
+
+	return static_cast<int32_t>(raw < 0? -val : val);
+}
+
+constexpr uint32_t pga_mult(unsigned int gain) {
+	return 16u >> gain;
+}
+
+template <typename Cfg, hlw811x_channel_t Ch>
+struct Channel;
+
+/* Per unit of the calibration coefficient. num and den are the parts known
+ * at compile time of the factors made by update_factors() of hlw811x.c. */
+template <typename Cfg>
+struct Channel<Cfg, HLW811X_CHANNEL_A> {
+	static constexpr hlw811x_reg_addr_t rms_addr = HLW811X_REG_RMS_IA;
+	static constexpr hlw811x_reg_addr_t power_addr = HLW811X_REG_POWER_PA;
+	static constexpr uint64_t rms_num = 1000ull * pga_mult(Cfg::pga.A);
+	static constexpr uint64_t rms_den = Cfg::k1_a * 10ull;
+	static constexpr int rms_exp2 = -23;
+	static constexpr uint64_t power_num = 1000ull * 10000
+		* pga_mult(static_cast<unsigned int>(Cfg::pga.A + Cfg::pga.U));
+	static constexpr uint64_t power_den =
+		static_cast<uint64_t>(Cfg::k1_a) * Cfg::k2;
+	static uint16_t rms_coeff(const hlw811x_coeff &c) { return c.rms.A; }
+	static uint16_t power_coeff(const hlw811x_coeff &c) {
+		return c.power.A;
+	}
+};
+
+template <typename Cfg>
+struct Channel<Cfg, HLW811X_CHANNEL_B> {
+	static constexpr hlw811x_reg_addr_t rms_addr = HLW811X_REG_RMS_IB;
+	static constexpr hlw811x_reg_addr_t power_addr = HLW811X_REG_POWER_PB;
+	static constexpr uint64_t rms_num = 1000ull * pga_mult(Cfg::pga.B);
+	static constexpr uint64_t rms_den = Cfg::k1_b * 10ull;
+	static constexpr int rms_exp2 = -23;
+	static constexpr uint64_t power_num = 1000ull * 10000
+		* pga_mult(static_cast<unsigned int>(Cfg::pga.B + Cfg::pga.U));
+	static constexpr uint64_t power_den =
+		static_cast<uint64_t>(Cfg::k1_b) * Cfg::k2;
+	static uint16_t rms_coeff(const hlw811x_coeff &c) { return c.rms.B; }
+	static uint16_t power_coeff(const hlw811x_coeff &c) {
+		return c.power.B;
+	}
+};
+
+template <typename Cfg>
+struct Channel<Cfg, HLW811X_CHANNEL_U> {
+	static constexpr hlw811x_reg_addr_t rms_addr = HLW811X_REG_RMS_U;
+	static constexpr uint64_t rms_num = 1000ull * 10;
+	static constexpr uint64_t rms_den = Cfg::k2 * 10ull;
+	static constexpr int rms_exp2 = -(22 + static_cast<int>(Cfg::pga.U));
+	static uint16_t rms_coeff(const hlw811x_coeff &c) { return c.rms.U; }
+};
+
+#if defined(HLW811X_BIG_ENDIAN)
+constexpr int32_t decode(const uint8_t *buf, size_t len) {
+	uint32_t val = 0;
+	for (size_t i = len; i > 0; i--) {
+		val = (val << 8) | buf[i - 1];
+	}
+	return static_cast<int32_t>(val);
+}
+#else
+constexpr int32_t decode(const uint8_t *buf, size_t len) {
+	uint32_t val = 0;
+	for (size_t i = 0; i < len; i++) {
+		val = (val << 8) | buf[i];
+	}
+	return static_cast<int32_t>(val);
+}
+#endif
+
+} /* namespace detail */
+
+/* Transport is to provide:
+ *
+ *   static constexpr hlw811x_interface_t interface;
+ *   int write(const uint8_t *data, size_t datalen);
+ *   int read(uint8_t *buf, size_t bufsize);
+ *
+ * with the return values of the ll_write() and ll_read() of struct
+ * hlw811x_io. An instance of the C API is taken for the lifetime of the
+ * object, and is available through handle() for the rest of the API. */
+template <typename Transport, typename Cfg = Config<>>
+class Hlw811x {
+public:
+	explicit Hlw811x(Transport &transport)
+		: dev_(create(transport)) {}
+	~Hlw811x() { hlw811x_destroy(dev_); }
+
+	Hlw811x(const Hlw811x &) = delete;
+	Hlw811x &operator=(const Hlw811x &) = delete;
+
+	/* nullptr if no instance was left, see HLW811X_MAX_INSTANCES */
+	struct hlw811x *handle() const { return dev_; }
+
+	/* Read the calibration coefficients and apply the PGA gains of Cfg,
+	 * keeping the C API of handle() in line with the conversions here. */
+	hlw811x_error_t begin() {
+		/* half a centi up, as the C API truncates to centi and
+		 * K / 100.f may fall just below K in float */
+		const hlw811x_resistor_ratio ratio = {
+			(Cfg::k1_a + .5f) / 100.f,
+			(Cfg::k1_b + .5f) / 100.f,
+			(Cfg::k2 + .5f) / 100.f,
+		};
+		const hlw811x_pga pga = Cfg::pga;
+		hlw811x_error_t err;
+
+		if (dev_ == nullptr) {
+			return HLW811X_NO_MEMORY;
+		}
+
+		if ((err = hlw811x_dev_read_coeff(dev_, &coeff_))
+				!= HLW811X_ERROR_NONE) {
+			return err;
+		}
+
+		hlw811x_dev_set_resistor_ratio(dev_, &ratio);
+
+		/* the only factors made at runtime, once */
+		rms_[0] = make_rms_factor<HLW811X_CHANNEL_A>();
+		rms_[1] = make_rms_factor<HLW811X_CHANNEL_B>();
+		rms_[2] = make_rms_factor<HLW811X_CHANNEL_U>();
+		power_[0] = make_power_factor<HLW811X_CHANNEL_A>();
+		power_[1] = make_power_factor<HLW811X_CHANNEL_B>();
+
+		return hlw811x_dev_set_pga(dev_, &pga);
+	}
+
+	template <hlw811x_channel_t Ch>
+	MilliAmps to_current(int32_t raw) const {
+		static_assert(Ch == HLW811X_CHANNEL_A ||
+				Ch == HLW811X_CHANNEL_B,
+				"current is of channel A or B");
+		return MilliAmps(to_rms<Ch>(raw));
+	}
+
+	MilliVolts to_voltage(int32_t raw) const {
+		return MilliVolts(to_rms<HLW811X_CHANNEL_U>(raw));
+	}
+
+	template <hlw811x_channel_t Ch>
+	MilliWatts to_power(int32_t raw) const {
+		static_assert(Ch == HLW811X_CHANNEL_A ||
+				Ch == HLW811X_CHANNEL_B,
+				"active power is of channel A or B");
+		return MilliWatts(detail::scale(power_[index<Ch>()], raw));
+	}
+
+	template <hlw811x_channel_t Ch>
+	hlw811x_error_t read_current(MilliAmps &current) {
+		int32_t raw;
+		const hlw811x_error_t err =
+			read_raw(detail::Channel<Cfg, Ch>::rms_addr, 3, raw);
+
+		if (err != HLW811X_ERROR_NONE) {
+			return err;
+		} else if (raw & (1 << 23)) {
+			current = MilliAmps(0);
+			return HLW811X_INVALID_DATA;
+		}
+
+		current = to_current<Ch>(raw);
+
+		return HLW811X_ERROR_NONE;
+	}
+
+	hlw811x_error_t read_voltage(MilliVolts &voltage) {
+		int32_t raw;
+		const hlw811x_error_t err = read_raw(HLW811X_REG_RMS_U, 3, raw);
+
+		if (err != HLW811X_ERROR_NONE) {
+			return err;
+		} else if (raw & (1 << 23)) {
+			voltage = MilliVolts(0);
+			return HLW811X_INVALID_DATA;
+		}
+
+		voltage = to_voltage(raw);
+
+		return HLW811X_ERROR_NONE;
+	}
+
+	template <hlw811x_channel_t Ch>
+	hlw811x_error_t read_power(MilliWatts &power) {
+		int32_t raw;
+		const hlw811x_error_t err =
+			read_raw(detail::Channel<Cfg, Ch>::power_addr, 4, raw);
+
+		if (err == HLW811X_ERROR_NONE) {
+			power = to_power<Ch>(raw);
+		}
+
+		return err;
+	}
+
+private:
+	struct hlw811x *dev_;
+	hlw811x_coeff coeff_ {};
+	detail::Factor rms_[3] {}; /* A, B and U */
+	detail::Factor power_[2] {}; /* A and B */
+
+	template <hlw811x_channel_t Ch>
+	static constexpr size_t index() {
+		return Ch == HLW811X_CHANNEL_A? 0 :
+			Ch == HLW811X_CHANNEL_B? 1 : 2;
+	}
+
+	static int ll_write(const uint8_t *data, size_t datalen, void *ctx) {
+		return static_cast<Transport *>(ctx)->write(data, datalen);
+	}
+
+	static int ll_read(uint8_t *buf, size_t bufsize, void *ctx) {
+		return static_cast<Transport *>(ctx)->read(buf, bufsize);
+	}
+
+	static struct hlw811x *create(Transport &transport) {
+		hlw811x_io io {};
+
+		io.ll_write = ll_write;
+		io.ll_read = ll_read;
+		io.ctx = &transport;
+
+		return hlw811x_create(Transport::interface, &io);
+	}
+
+	/* All the terms but the coefficient fold into constants. */
+	template <hlw811x_channel_t Ch>
+	detail::Factor make_rms_factor() const {
+		using C = detail::Channel<Cfg, Ch>;
+		return detail::make_factor(C::rms_num * C::rms_coeff(coeff_),
+				C::rms_den, C::rms_exp2);
+	}
+
+	template <hlw811x_channel_t Ch>
+	detail::Factor make_power_factor() const {
+		using C = detail::Channel<Cfg, Ch>;
+		return detail::make_factor(
+				C::power_num * C::power_coeff(coeff_),
+				C::power_den, -31);
+	}
+
+	template <hlw811x_channel_t Ch>
+	int32_t to_rms(int32_t raw) const {
+		return detail::scale(rms_[index<Ch>()], raw);
+	}
+
+	hlw811x_error_t read_raw(hlw811x_reg_addr_t addr, size_t len,
+			int32_t &raw) {
+		uint8_t buf[4];
+		const hlw811x_error_t err =
+			hlw811x_dev_read_reg(dev_, addr, buf, len);
+
+		if (err == HLW811X_ERROR_NONE) {
+			raw = detail::decode(buf, len);
+		}
+
+		return err;
+	}
+};
+
+} /* namespace hlw */
+
+#endif /* HLW811X_HPP */
@@ -6,5 +6,6 @@ endif
 
 HLW811X_SRCS := \
 	$(hlw811x-basedir)hlw811x.c \
+	$(hlw811x-basedir)hlw811x_default.c \
 
 HLW811X_INCS := $(hlw811x-basedir)
@@ -0,0 +1,817 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "hlw811x.h"
+#include "hlw811x_overrides.h"
+
+static struct hlw811x *dev;
+
+/* The wrappers are not to be called before hlw811x_init() creates the
+ * instance, and return without touching the bus if they are. */
+#define RETURN_IF_NO_DEV(ret)	do { \
+	if (dev == NULL) { \
+		return ret; \
+	} \
+} while (0)
+
+static int ll_write(const uint8_t *data, size_t datalen, void *ctx)
+{
+	(void)ctx;
+	return hlw811x_ll_write(data, datalen);
+}
+
+static int ll_read(uint8_t *buf, size_t bufsize, void *ctx)
+{
+	(void)ctx;
+	return hlw811x_ll_read(buf, bufsize);
+}
+
+hlw811x_error_t hlw811x_init(hlw811x_interface_t interface)
+{
+	const struct hlw811x_io io = {
+		.ll_write = ll_write,
+		.ll_read = ll_read,
+	};
+
+	hlw811x_destroy(dev);
+
+	if ((dev = hlw811x_create(interface, &io)) == NULL) {
+		return HLW811X_NO_MEMORY;
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+hlw811x_error_t hlw811x_reset(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_reset(dev);
+}
+
+hlw811x_error_t hlw811x_enable_shadow(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_shadow(dev);
+}
+
+void hlw811x_disable_shadow(void)
+{
+	RETURN_IF_NO_DEV();
+	hlw811x_dev_disable_shadow(dev);
+}
+
+hlw811x_error_t hlw811x_verify_shadow(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_verify_shadow(dev);
+}
+
+hlw811x_error_t hlw811x_start_power_save(hlw811x_channel_t channels,
+		hlw811x_channel_t pulse,
+		hlw811x_clock_t clock, void *clock_ctx)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_start_power_save(dev, channels, pulse,
+			clock, clock_ctx);
+}
+
+hlw811x_error_t hlw811x_stop_power_save(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_stop_power_save(dev);
+}
+
+hlw811x_error_t hlw811x_open_window(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_open_window(dev);
+}
+
+hlw811x_error_t hlw811x_close_window(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_close_window(dev);
+}
+
+hlw811x_error_t hlw811x_is_window_ready(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_is_window_ready(dev);
+}
+
+hlw811x_error_t hlw811x_begin_config(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_begin_config(dev);
+}
+
+hlw811x_error_t hlw811x_commit_config(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_commit_config(dev);
+}
+
+void hlw811x_abort_config(void)
+{
+	RETURN_IF_NO_DEV();
+	hlw811x_dev_abort_config(dev);
+}
+
+hlw811x_error_t hlw811x_apply_config(const struct hlw811x_config *cfg)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_apply_config(dev, cfg);
+}
+
+hlw811x_error_t hlw811x_write_reg(hlw811x_reg_addr_t addr,
+		const uint8_t *data, size_t datalen)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_write_reg(dev, addr, data, datalen);
+}
+
+hlw811x_error_t hlw811x_read_reg(hlw811x_reg_addr_t addr,
+		uint8_t *buf, size_t bufsize)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_read_reg(dev, addr, buf, bufsize);
+}
+
+hlw811x_error_t hlw811x_read_regs(hlw811x_reg_addr_t start,
+		hlw811x_reg_addr_t end, uint8_t *buf, size_t bufsize,
+		size_t *len)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_read_regs(dev, start, end, buf, bufsize, len);
+}
+
+hlw811x_error_t hlw811x_submit_read(hlw811x_reg_addr_t addr, size_t len,
+		hlw811x_read_cb_t cb, void *ctx)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_submit_read(dev, addr, len, cb, ctx);
+}
+
+hlw811x_error_t hlw811x_on_rx(const uint8_t *data, size_t datalen)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_on_rx(dev, data, datalen);
+}
+
+hlw811x_error_t hlw811x_submit_snapshot(hlw811x_snapshot_cb_t cb, void *ctx)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_submit_snapshot(dev, cb, ctx);
+}
+
+hlw811x_error_t hlw811x_cancel_reads(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_cancel_reads(dev);
+}
+
+hlw811x_error_t hlw811x_get_queue_stats(struct hlw811x_queue_stats *stats)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_queue_stats(dev, stats);
+}
+
+void hlw811x_set_transport_policy(
+		const struct hlw811x_transport_policy *policy)
+{
+	RETURN_IF_NO_DEV();
+	hlw811x_dev_set_transport_policy(dev, policy);
+}
+
+hlw811x_error_t hlw811x_get_transport_stats(
+		struct hlw811x_transport_stats *stats)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_transport_stats(dev, stats);
+}
+
+hlw811x_error_t hlw811x_set_stats_clock(hlw811x_clock_t clock, void *ctx)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_stats_clock(dev, clock, ctx);
+}
+
+hlw811x_error_t hlw811x_get_stats(struct hlw811x_stats *stats)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_stats(dev, stats);
+}
+
+hlw811x_error_t hlw811x_clear_stats(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_clear_stats(dev);
+}
+
+hlw811x_error_t hlw811x_enable_channel(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_channel(dev, channel);
+}
+
+hlw811x_error_t hlw811x_disable_channel(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_channel(dev, channel);
+}
+
+hlw811x_error_t hlw811x_enable_pulse(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_pulse(dev, channel);
+}
+
+hlw811x_error_t hlw811x_disable_pulse(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_pulse(dev, channel);
+}
+
+hlw811x_error_t hlw811x_enable_waveform(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_waveform(dev);
+}
+
+hlw811x_error_t hlw811x_disable_waveform(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_waveform(dev);
+}
+
+hlw811x_error_t hlw811x_start_waveform_stream(hlw811x_channel_t channels,
+		struct hlw811x_wave_ring *ring)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_start_waveform_stream(dev, channels, ring);
+}
+
+hlw811x_error_t hlw811x_stop_waveform_stream(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_stop_waveform_stream(dev);
+}
+
+hlw811x_error_t hlw811x_sample_waveform(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_sample_waveform(dev);
+}
+
+hlw811x_error_t hlw811x_enable_zerocrossing(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_zerocrossing(dev);
+}
+
+hlw811x_error_t hlw811x_disable_zerocrossing(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_zerocrossing(dev);
+}
+
+hlw811x_error_t hlw811x_enable_power_factor(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_power_factor(dev);
+}
+
+hlw811x_error_t hlw811x_disable_power_factor(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_power_factor(dev);
+}
+
+hlw811x_error_t hlw811x_enable_energy_clearance(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_energy_clearance(dev, channel);
+}
+
+hlw811x_error_t hlw811x_disable_energy_clearance(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_energy_clearance(dev, channel);
+}
+
+hlw811x_error_t hlw811x_enable_hpf(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_hpf(dev, channel);
+}
+
+hlw811x_error_t hlw811x_disable_hpf(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_hpf(dev, channel);
+}
+
+hlw811x_error_t hlw811x_enable_b_channel_comparator(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_b_channel_comparator(dev);
+}
+
+hlw811x_error_t hlw811x_disable_b_channel_comparator(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_b_channel_comparator(dev);
+}
+
+hlw811x_error_t hlw811x_enable_temperature_sensor(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_temperature_sensor(dev);
+}
+
+hlw811x_error_t hlw811x_disable_temperature_sensor(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_temperature_sensor(dev);
+}
+
+hlw811x_error_t hlw811x_enable_peak_detection(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_peak_detection(dev);
+}
+
+hlw811x_error_t hlw811x_disable_peak_detection(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_peak_detection(dev);
+}
+
+hlw811x_error_t hlw811x_enable_overload_detection(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_overload_detection(dev);
+}
+
+hlw811x_error_t hlw811x_disable_overload_detection(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_overload_detection(dev);
+}
+
+hlw811x_error_t hlw811x_enable_voltage_drop_detection(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_voltage_drop_detection(dev);
+}
+
+hlw811x_error_t hlw811x_disable_voltage_drop_detection(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_voltage_drop_detection(dev);
+}
+
+hlw811x_error_t hlw811x_set_threshold(hlw811x_threshold_t type,
+		int32_t milliunit)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_threshold(dev, type, milliunit);
+}
+
+hlw811x_error_t hlw811x_set_sag_period(uint16_t half_cycles)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_sag_period(dev, half_cycles);
+}
+
+hlw811x_error_t hlw811x_start_event_capture(hlw811x_intr_t ints,
+		hlw811x_clock_t clock, void *ctx)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_start_event_capture(dev, ints, clock, ctx);
+}
+
+hlw811x_error_t hlw811x_stop_event_capture(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_stop_event_capture(dev);
+}
+
+hlw811x_error_t hlw811x_capture_events(hlw811x_intr_t ints)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_capture_events(dev, ints);
+}
+
+size_t hlw811x_drain_events(struct hlw811x_event *events, size_t n)
+{
+	RETURN_IF_NO_DEV(0);
+	return hlw811x_dev_drain_events(dev, events, n);
+}
+
+uint32_t hlw811x_get_dropped_events(void)
+{
+	RETURN_IF_NO_DEV(0);
+	return hlw811x_dev_get_dropped_events(dev);
+}
+
+hlw811x_error_t hlw811x_enable_interrupt(hlw811x_intr_t ints)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_enable_interrupt(dev, ints);
+}
+
+hlw811x_error_t hlw811x_disable_interrupt(hlw811x_intr_t ints)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_disable_interrupt(dev, ints);
+}
+
+hlw811x_error_t hlw811x_set_interrupt_mode(hlw811x_intr_t int1,
+		hlw811x_intr_t int2)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_interrupt_mode(dev, int1, int2);
+}
+
+hlw811x_error_t hlw811x_get_interrupt(hlw811x_intr_t *ints)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_interrupt(dev, ints);
+}
+
+hlw811x_error_t hlw811x_get_interrupt_ext(hlw811x_intr_t *ints)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_interrupt_ext(dev, ints);
+}
+
+hlw811x_error_t hlw811x_register_irq_handler(hlw811x_intr_t ints,
+		hlw811x_irq_handler_t handler, void *ctx)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_register_irq_handler(dev, ints, handler, ctx);
+}
+
+hlw811x_error_t hlw811x_handle_irq(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_handle_irq(dev);
+}
+
+hlw811x_error_t hlw811x_start_zc_tracker(hlw811x_clock_t clock, void *ctx)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_start_zc_tracker(dev, clock, ctx);
+}
+
+hlw811x_error_t hlw811x_stop_zc_tracker(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_stop_zc_tracker(dev);
+}
+
+hlw811x_error_t hlw811x_feed_zerocrossing(hlw811x_intr_t flag,
+		uint32_t timestamp_us)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_feed_zerocrossing(dev, flag, timestamp_us);
+}
+
+hlw811x_error_t hlw811x_get_tracked_frequency(int32_t *centihertz)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_tracked_frequency(dev, centihertz);
+}
+
+hlw811x_error_t hlw811x_get_tracked_phase(int32_t *centidegree)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_tracked_phase(dev, centidegree);
+}
+
+hlw811x_error_t hlw811x_get_line_freq(hlw811x_line_freq_t *freq)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_line_freq(dev, freq);
+}
+
+hlw811x_error_t hlw811x_get_next_zerocrossing(uint32_t *timestamp_us)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_next_zerocrossing(dev, timestamp_us);
+}
+
+hlw811x_error_t hlw811x_select_channel(hlw811x_channel_t channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_select_channel(dev, channel);
+}
+
+hlw811x_error_t hlw811x_read_current_channel(hlw811x_channel_t *channel)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_read_current_channel(dev, channel);
+}
+
+hlw811x_error_t hlw811x_start_channel_mux(hlw811x_clock_t clock, void *ctx,
+		uint16_t settle_ms)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_start_channel_mux(dev, clock, ctx, settle_ms);
+}
+
+hlw811x_error_t hlw811x_stop_channel_mux(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_stop_channel_mux(dev);
+}
+
+hlw811x_error_t hlw811x_read_channel_group(hlw811x_channel_t channel,
+		struct hlw811x_channel_group *group)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_read_channel_group(dev, channel, group);
+}
+
+hlw811x_error_t hlw811x_get_channel_mux_stats(
+		struct hlw811x_channel_mux_stats *stats)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_channel_mux_stats(dev, stats);
+}
+
+hlw811x_error_t hlw811x_read_coeff(struct hlw811x_coeff *coeff)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_read_coeff(dev, coeff);
+}
+
+hlw811x_error_t hlw811x_export_calib(uint8_t *buf, size_t bufsize,
+		size_t *len)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_export_calib(dev, buf, bufsize, len);
+}
+
+hlw811x_error_t hlw811x_import_calib(const uint8_t *blob, size_t bloblen,
+		bool *refreshed)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_import_calib(dev, blob, bloblen, refreshed);
+}
+
+hlw811x_error_t hlw811x_calib_begin(hlw811x_channel_t channel,
+		uint8_t samples)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_calib_begin(dev, channel, samples);
+}
+
+hlw811x_error_t hlw811x_calib_feed(hlw811x_calib_step_t step,
+		int32_t ref_milliwatt)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_calib_feed(dev, step, ref_milliwatt);
+}
+
+hlw811x_error_t hlw811x_calib_commit(struct hlw811x_calib_regs *regs)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_calib_commit(dev, regs);
+}
+
+hlw811x_error_t hlw811x_calib_apply(const struct hlw811x_calib_regs *regs)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_calib_apply(dev, regs);
+}
+
+void hlw811x_set_resistor_ratio(const struct hlw811x_resistor_ratio *ratio)
+{
+	RETURN_IF_NO_DEV();
+	hlw811x_dev_set_resistor_ratio(dev, ratio);
+}
+
+void hlw811x_get_resistor_ratio(struct hlw811x_resistor_ratio *ratio)
+{
+	RETURN_IF_NO_DEV();
+	hlw811x_dev_get_resistor_ratio(dev, ratio);
+}
+
+hlw811x_error_t hlw811x_set_pga(const struct hlw811x_pga *pga)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_pga(dev, pga);
+}
+
+hlw811x_error_t hlw811x_get_pga(struct hlw811x_pga *pga)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_pga(dev, pga);
+}
+
+hlw811x_error_t hlw811x_set_active_power_calc_mode(hlw811x_active_power_mode_t
+		mode)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_active_power_calc_mode(dev, mode);
+}
+
+hlw811x_error_t hlw811x_get_active_power_calc_mode(hlw811x_active_power_mode_t
+		*mode)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_active_power_calc_mode(dev, mode);
+}
+
+hlw811x_error_t hlw811x_set_rms_calc_mode(hlw811x_rms_mode_t mode)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_rms_calc_mode(dev, mode);
+}
+
+hlw811x_error_t hlw811x_get_rms_calc_mode(hlw811x_rms_mode_t *mode)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_rms_calc_mode(dev, mode);
+}
+
+hlw811x_error_t hlw811x_set_data_update_frequency(hlw811x_data_update_freq_t
+		freq)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_data_update_frequency(dev, freq);
+}
+
+hlw811x_error_t hlw811x_get_data_update_frequency(hlw811x_data_update_freq_t
+		*freq)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_data_update_frequency(dev, freq);
+}
+
+hlw811x_error_t hlw811x_set_channel_b_mode(hlw811x_channel_b_mode_t mode)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_channel_b_mode(dev, mode);
+}
+
+hlw811x_error_t hlw811x_get_channel_b_mode(hlw811x_channel_b_mode_t *mode)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_channel_b_mode(dev, mode);
+}
+
+hlw811x_error_t hlw811x_set_zerocrossing_mode(hlw811x_zerocrossing_mode_t mode)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_set_zerocrossing_mode(dev, mode);
+}
+
+hlw811x_error_t hlw811x_get_zerocrossing_mode(hlw811x_zerocrossing_mode_t
+		*mode)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_zerocrossing_mode(dev, mode);
+}
+
+hlw811x_error_t hlw811x_get_rms(hlw811x_channel_t channel, int32_t *milliunit)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_rms(dev, channel, milliunit);
+}
+
+hlw811x_error_t hlw811x_get_power(hlw811x_channel_t channel, int32_t *milliwatt)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_power(dev, channel, milliwatt);
+}
+
+hlw811x_error_t hlw811x_get_energy(hlw811x_channel_t channel, int32_t *Wh)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_energy(dev, channel, Wh);
+}
+
+hlw811x_error_t hlw811x_convert_rms_batch(hlw811x_channel_t channel,
+		const int32_t *raw, int32_t *milliunit, size_t n)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_convert_rms_batch(dev, channel, raw, milliunit, n);
+}
+
+hlw811x_error_t hlw811x_convert_power_batch(hlw811x_channel_t channel,
+		hlw811x_channel_t current_channel,
+		const int32_t *raw, int32_t *milliwatt, size_t n)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_convert_power_batch(dev, channel, current_channel,
+			raw, milliwatt, n);
+}
+
+hlw811x_error_t hlw811x_convert_energy_batch(hlw811x_channel_t channel,
+		const int32_t *raw, int32_t *Wh, size_t n)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_convert_energy_batch(dev, channel, raw, Wh, n);
+}
+
+hlw811x_error_t hlw811x_update_energy(hlw811x_intr_t ints)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_update_energy(dev, ints);
+}
+
+hlw811x_error_t hlw811x_get_energy_total(hlw811x_channel_t channel,
+		uint64_t *Wh)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_energy_total(dev, channel, Wh);
+}
+
+hlw811x_error_t hlw811x_energy_delta(hlw811x_channel_t channel, int32_t *Wh)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_energy_delta(dev, channel, Wh);
+}
+
+hlw811x_error_t hlw811x_get_frequency(int32_t *centihertz)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_frequency(dev, centihertz);
+}
+
+hlw811x_error_t hlw811x_get_power_factor(int32_t *centiunit)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_power_factor(dev, centiunit);
+}
+
+hlw811x_error_t hlw811x_get_phase_angle(int32_t *centidegree,
+		hlw811x_line_freq_t freq)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_phase_angle(dev, centidegree, freq);
+}
+
+hlw811x_error_t hlw811x_get_temperature(int32_t *centidegree)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_temperature(dev, centidegree);
+}
+
+hlw811x_error_t hlw811x_read_snapshot(struct hlw811x_snapshot *snapshot)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_read_snapshot(dev, snapshot);
+}
+
+hlw811x_error_t hlw811x_add_poll(hlw811x_quantity_t qty,
+		uint16_t interval_ms, uint8_t priority)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_add_poll(dev, qty, interval_ms, priority);
+}
+
+hlw811x_error_t hlw811x_remove_poll(hlw811x_quantity_t qty)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_remove_poll(dev, qty);
+}
+
+hlw811x_error_t hlw811x_start_poll_scheduler(hlw811x_clock_t clock,
+		void *clock_ctx, uint8_t budget, hlw811x_poll_cb_t cb,
+		void *cb_ctx)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_start_poll_scheduler(dev, clock, clock_ctx,
+			budget, cb, cb_ctx);
+}
+
+hlw811x_error_t hlw811x_stop_poll_scheduler(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_stop_poll_scheduler(dev);
+}
+
+hlw811x_error_t hlw811x_sync_poll_scheduler(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_sync_poll_scheduler(dev);
+}
+
+hlw811x_error_t hlw811x_run_poll_scheduler(void)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_run_poll_scheduler(dev);
+}
+
+hlw811x_error_t hlw811x_get_poll_stats(struct hlw811x_poll_stats *stats)
+{
+	RETURN_IF_NO_DEV(HLW811X_INVALID_PARAM);
+	return hlw811x_dev_get_poll_stats(dev, stats);
+}
@@ -87,6 +87,136 @@ typedef enum {
 	HLW811X_REG_COMMAND				= 0x6Au,
 } hlw811x_reg_addr_t;
 
+/* Size of the largest register in bytes */
+#define HLW811X_REG_WIDTH_MAX				4
+
+/* Register width in bytes by name. The addresses not listed here are not
+ * defined by the chip. HLW811X_REG_COMMAND is write-only and left out. */
+#define HLW811X_REG_WIDTHS(X) \
+	X(SYS_CTRL, 2) \
+	X(METER_CTRL, 2) \
+	X(PULSE_FREQ, 2) \
+	X(PASTART, 2) \
+	X(PBSTART, 2) \
+	X(POWER_GAIN_A, 2) \
+	X(POWER_GAIN_B, 2) \
+	X(PHASE_A, 1) \
+	X(PHASE_B, 1) \
+	X(ACTIVE_POWER_OFFSET_A, 2) \
+	X(ACTIVE_POWER_OFFSET_B, 2) \
+	X(RMS_OFFSET_IA, 2) \
+	X(RMS_OFFSET_IB, 2) \
+	X(GAIN_IB, 2) \
+	X(APPARENT_POWER_GAIN, 2) \
+	X(VISUAL_POWER_OFFSET, 2) \
+	X(METER_CTRL_2, 2) \
+	X(DC_OFFSET_IA, 2) \
+	X(DC_OFFSET_IB, 2) \
+	X(DC_OFFSET_IC, 2) \
+	X(PERIOD_VOL_SAG, 2) \
+	X(THRESHOLD_VOL_SAG, 2) \
+	X(THRESHOLD_VOL, 2) \
+	X(THRESHOLD_IA, 2) \
+	X(THRESHOLD_IB, 2) \
+	X(THRESHOLD_ACTIVE_POWER_OVERLOAD, 2) \
+	X(INT, 2) \
+	X(PFCNTPA, 2) \
+	X(PFCNTPB, 2) \
+	X(ANGLE, 2) \
+	X(FREQUENCY_L_LINE, 2) \
+	X(RMS_IA, 3) \
+	X(RMS_IB, 3) \
+	X(RMS_U, 3) \
+	X(POWER_FACTOR, 3) \
+	X(ENERGY_PA, 3) \
+	X(ENERGY_PB, 3) \
+	X(POWER_PA, 4) \
+	X(POWER_PB, 4) \
+	X(POWER_S, 4) \
+	X(METER_STATUS, 3) \
+	X(PEAK_IA, 3) \
+	X(PEAK_IB, 3) \
+	X(PEAK_U, 3) \
+	X(INSTAN_IA, 3) \
+	X(INSTAN_IB, 3) \
+	X(INSTAN_U, 3) \
+	X(WAVE_IA, 3) \
+	X(WAVE_IB, 3) \
+	X(WAVE_U, 3) \
+	X(INSTAN_P, 4) \
+	X(INSTAN_S, 4) \
+	X(IE, 2) \
+	X(IF, 2) \
+	X(RIF, 2) \
+	X(SYS_STATUS, 1) \
+	X(SPI_LATEST_DATA_R, 4) \
+	X(SPI_LATEST_DATA_W, 2) \
+	X(COEFF_CHKSUM, 2) \
+	X(RMS_IA_COEFF, 2) \
+	X(RMS_IB_COEFF, 2) \
+	X(RMS_U_COEFF, 2) \
+	X(POWER_A_COEFF, 2) \
+	X(POWER_B_COEFF, 2) \
+	X(POWER_S_COEFF, 2) \
+	X(ENERGY_A_COEFF, 2) \
+	X(ENERGY_B_COEFF, 2)
+
+#define HLW811X_REG_WIDTH_ENUM(name, bytes)	\
+	HLW811X_REG_##name##_WIDTH = (bytes),
+
+typedef enum {
+	HLW811X_REG_WIDTHS(HLW811X_REG_WIDTH_ENUM)
+} hlw811x_reg_width_t;
+
+/* A field descriptor packs the register address, the position of the least
+ * significant bit and the length in bits. */
+#define HLW811X_FIELD(reg, lsb, len)		\
+	((HLW811X_REG_##reg << 16) | ((lsb) << 8) | (len))
+#define HLW811X_FIELD_REG(field)		((field) >> 16)
+#define HLW811X_FIELD_LSB(field)		(((field) >> 8) & 0xFFu)
+#define HLW811X_FIELD_LEN(field)		((field) & 0xFFu)
+#define HLW811X_FIELD_MASK(field)		\
+	(((1u << HLW811X_FIELD_LEN(field)) - 1) << HLW811X_FIELD_LSB(field))
+
+/* Named bitfields as (register, field, lsb, length in bits) */
+#define HLW811X_FIELDS(X) \
+	X(SYS_CTRL, PGAIA, 0, 3) \
+	X(SYS_CTRL, PGAU, 3, 3) \
+	X(SYS_CTRL, PGAIB, 6, 3) \
+	X(SYS_CTRL, ADC1ON, 9, 1) \
+	X(SYS_CTRL, ADC2ON, 10, 1) \
+	X(SYS_CTRL, ADC3ON, 11, 1) \
+	X(METER_CTRL, PARUN, 0, 1) \
+	X(METER_CTRL, PBRUN, 1, 1) \
+	X(METER_CTRL, HPFUOFF, 4, 1) \
+	X(METER_CTRL, HPFAOFF, 5, 1) \
+	X(METER_CTRL, HPFBOFF, 6, 1) \
+	X(METER_CTRL, ZXD, 7, 2) \
+	X(METER_CTRL, DC_MODE, 9, 1) \
+	X(METER_CTRL, PMODE, 10, 2) \
+	X(METER_CTRL, COMP_OFF, 12, 1) \
+	X(METER_CTRL, TENSOR_EN, 13, 1) \
+	X(METER_CTRL_2, PEAK_EN, 1, 1) \
+	X(METER_CTRL_2, ZX_EN, 2, 1) \
+	X(METER_CTRL_2, OVER_EN, 3, 1) \
+	X(METER_CTRL_2, SAG_EN, 4, 1) \
+	X(METER_CTRL_2, WAVE_EN, 5, 1) \
+	X(METER_CTRL_2, PFACTOR_EN, 6, 1) \
+	X(METER_CTRL_2, CHS_IB, 7, 1) \
+	X(METER_CTRL_2, DUP, 8, 2) \
+	X(METER_CTRL_2, EPA_CA, 10, 1) \
+	X(METER_CTRL_2, EPA_CB, 11, 1) \
+	X(INT, P1SEL, 0, 4) \
+	X(INT, P2SEL, 4, 4) \
+	X(METER_STATUS, CHA_SEL, 21, 1)
+
+#define HLW811X_FIELD_ENUM(reg, name, lsb, len)	\
+	HLW811X_##reg##_##name = HLW811X_FIELD(reg, lsb, len),
+
+typedef enum {
+	HLW811X_FIELDS(HLW811X_FIELD_ENUM)
+} hlw811x_field_t;
+
 #if defined(__cplusplus)
 }
 #endif
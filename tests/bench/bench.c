@@ -0,0 +1,232 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE		199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES
+#endif
+
+#include "hlw811x.h"
+#include "sim.h"
+
+#define ITERATIONS_DEFAULT	1000
+
+typedef hlw811x_error_t (*scenario_fn)(struct hlw811x *dev);
+
+struct scenario {
+	const char *name;
+	scenario_fn run;
+	bool init; /* re-create the instance and reset the chip per run */
+};
+
+static struct hlw811x_wave_sample wave_buf[64];
+static struct hlw811x_wave_ring wave_ring;
+
+static const struct hlw811x_config config = {
+	.pga = {
+		.A = HLW811X_PGA_GAIN_16,
+		.B = HLW811X_PGA_GAIN_1,
+		.U = HLW811X_PGA_GAIN_1,
+	},
+	.channels = HLW811X_CHANNEL_ALL,
+	.pulse = HLW811X_CHANNEL_A | HLW811X_CHANNEL_B,
+	.hpf = HLW811X_CHANNEL_ALL,
+	.data_update_freq = HLW811X_DATA_UPDATE_FREQ_HZ_6_8,
+	.zerocrossing = true,
+	.power_factor = true,
+	.interrupts = HLW811X_INTR_AVERAGE_UPDATED,
+	.int1 = HLW811X_INTR_AVERAGE_UPDATED,
+	.int2 = HLW811X_INTR_PULSE_OUT_A,
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#if defined(HAVE_CYCLES)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static hlw811x_error_t run_init(struct hlw811x *dev)
+{
+	struct hlw811x_coeff coeff;
+	hlw811x_error_t err;
+
+	if ((err = hlw811x_dev_read_coeff(dev, &coeff))
+			!= HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	return hlw811x_dev_apply_config(dev, &config);
+}
+
+/* the ten quantities of a measurement update, one getter at a time */
+static hlw811x_error_t run_poll(struct hlw811x *dev)
+{
+	int32_t val;
+	hlw811x_error_t err = HLW811X_ERROR_NONE;
+
+	err |= hlw811x_dev_get_rms(dev, HLW811X_CHANNEL_A, &val);
+	err |= hlw811x_dev_get_rms(dev, HLW811X_CHANNEL_B, &val);
+	err |= hlw811x_dev_get_rms(dev, HLW811X_CHANNEL_U, &val);
+	err |= hlw811x_dev_get_power(dev, HLW811X_CHANNEL_A, &val);
+	err |= hlw811x_dev_get_power(dev, HLW811X_CHANNEL_B, &val);
+	err |= hlw811x_dev_get_power(dev, HLW811X_CHANNEL_U, &val);
+	err |= hlw811x_dev_get_energy(dev, HLW811X_CHANNEL_A, &val);
+	err |= hlw811x_dev_get_energy(dev, HLW811X_CHANNEL_B, &val);
+	err |= hlw811x_dev_get_power_factor(dev, &val);
+	err |= hlw811x_dev_get_frequency(dev, &val);
+
+	return err;
+}
+
+static hlw811x_error_t run_snapshot(struct hlw811x *dev)
+{
+	struct hlw811x_snapshot snap;
+	return hlw811x_dev_read_snapshot(dev, &snap);
+}
+
+static hlw811x_error_t run_waveform(struct hlw811x *dev)
+{
+	struct hlw811x_wave_sample sample;
+	hlw811x_error_t err;
+
+	if ((err = hlw811x_dev_sample_waveform(dev)) != HLW811X_ERROR_NONE) {
+		return err;
+	}
+
+	while (hlw811x_wave_ring_pop(&wave_ring, &sample)) {
+		/* drain */
+	}
+
+	return HLW811X_ERROR_NONE;
+}
+
+static const struct scenario scenarios[] = {
+	{ "init",	run_init,	true },
+	{ "poll10",	run_poll,	false },
+	{ "snapshot",	run_snapshot,	false },
+	{ "waveform",	run_waveform,	false },
+};
+
+static struct hlw811x *create(const struct sim_config *cfg)
+{
+	const struct hlw811x_io io = {
+		.ll_write = sim_ll_write,
+		.ll_read = sim_ll_read,
+	};
+	return hlw811x_create(cfg->iface, &io);
+}
+
+static int bench(const struct sim_config *cfg, const struct scenario *sc,
+		unsigned int iterations)
+{
+	struct hlw811x *dev = create(cfg);
+	struct sim_stats stats;
+	uint64_t cpu_ns = 0;
+	uint64_t cycles = 0;
+
+	if (dev == NULL) {
+		return -1;
+	}
+
+	if (sc->run == run_waveform) {
+		hlw811x_wave_ring_init(&wave_ring, wave_buf,
+				sizeof(wave_buf) / sizeof(wave_buf[0]));
+		hlw811x_dev_start_waveform_stream(dev, HLW811X_CHANNEL_ALL,
+				&wave_ring);
+	}
+
+	sim_clear_stats();
+
+	for (unsigned int i = 0; i < iterations; i++) {
+		if (sc->init) {
+			hlw811x_destroy(dev);
+			sim_reset();
+			dev = create(cfg);
+		}
+
+		const uint64_t t0 = now_ns();
+		const uint64_t c0 = now_cycles();
+		const hlw811x_error_t err = (*sc->run)(dev);
+		cycles += now_cycles() - c0;
+		cpu_ns += now_ns() - t0;
+
+		if (err != HLW811X_ERROR_NONE) {
+			fprintf(stderr, "%s failed: %d\n", sc->name, err);
+			hlw811x_destroy(dev);
+			return -1;
+		}
+	}
+
+	sim_get_stats(&stats);
+	hlw811x_destroy(dev);
+
+	printf("%-5s %-9s %7.1f %8.1f %8.1f %10.1f %9.0f",
+			cfg->iface == HLW811X_UART ? "uart" : "spi", sc->name,
+			(double)stats.frames / iterations,
+			(double)stats.tx_bytes / iterations,
+			(double)stats.rx_bytes / iterations,
+			(double)stats.bus_ns / iterations / 1000.0,
+			(double)cpu_ns / iterations);
+#if defined(HAVE_CYCLES)
+	printf(" %9.0f", (double)cycles / iterations);
+#endif
+	printf("%s\n", stats.errors ? "  (chip reported errors)" : "");
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const unsigned int iterations = argc > 1 ?
+		(unsigned int)strtoul(argv[1], NULL, 10) : ITERATIONS_DEFAULT;
+	const struct sim_config cfgs[] = {
+		{ .iface = HLW811X_UART, .bitrate = 9600,
+			.latency_ns = 100000 },
+		{ .iface = HLW811X_SPI, .bitrate = 1000000,
+			.latency_ns = 2000 },
+	};
+	int rc = 0;
+
+	if (iterations == 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-5s %-9s %7s %8s %8s %10s %9s", "bus", "scenario",
+			"frames", "tx B", "rx B", "bus us", "cpu ns");
+#if defined(HAVE_CYCLES)
+	printf(" %9s", "cycles");
+#endif
+	printf("\n");
+
+	for (size_t i = 0; i < sizeof(cfgs) / sizeof(cfgs[0]); i++) {
+		sim_init(&cfgs[i]);
+
+		for (size_t j = 0; j < sizeof(scenarios) / sizeof(scenarios[0]);
+				j++) {
+			rc |= bench(&cfgs[i], &scenarios[j], iterations);
+		}
+	}
+
+	return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,289 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "sim.h"
+#include <string.h>
+
+#define REG_MAX			0x80u
+#define REG_COMMAND		0xEAu
+#define UART_HEADER		0xA5u
+#define UART_BITS_PER_BYTE	10u /* start, 8 data and stop bits */
+#define SPI_BITS_PER_BYTE	8u
+
+#define CMD_ENABLE_WRITE	0xE5u
+#define CMD_DISABLE_WRITE	0xDCu
+#define CMD_SET_CHANNEL_A	0x5Au
+#define CMD_SET_CHANNEL_B	0xA5u
+#define CMD_RESET_CHIP		0x96u
+
+#define CHA_SEL_BIT		21
+
+#define REG_WIDTH_ENTRY(name, bytes)	[HLW811X_REG_##name] = (bytes),
+
+static const uint8_t reg_width[REG_MAX] = {
+	HLW811X_REG_WIDTHS(REG_WIDTH_ENTRY)
+};
+
+static const struct {
+	hlw811x_reg_addr_t addr;
+	uint32_t val;
+} defaults[] = {
+	{ HLW811X_REG_SYS_CTRL,		0x0A04 },
+	{ HLW811X_REG_METER_CTRL,	0x0001 },
+	{ HLW811X_REG_PULSE_FREQ,	0x1000 },
+	{ HLW811X_REG_METER_CTRL_2,	0x0001 },
+	{ HLW811X_REG_INT,		0x3210 },
+	{ HLW811X_REG_RMS_IA_COEFF,	0xC8A2 },
+	{ HLW811X_REG_RMS_IB_COEFF,	0xC8A2 },
+	{ HLW811X_REG_RMS_U_COEFF,	0x6C8E },
+	{ HLW811X_REG_POWER_A_COEFF,	0x4A82 },
+	{ HLW811X_REG_POWER_B_COEFF,	0x4A82 },
+	{ HLW811X_REG_POWER_S_COEFF,	0x4A82 },
+	{ HLW811X_REG_ENERGY_A_COEFF,	0x4A82 },
+	{ HLW811X_REG_ENERGY_B_COEFF,	0x4A82 },
+	/* a 230V/50Hz line with some load */
+	{ HLW811X_REG_RMS_IA,		0x0F0000 },
+	{ HLW811X_REG_RMS_IB,		0x010000 },
+	{ HLW811X_REG_RMS_U,		0x3A0000 },
+	{ HLW811X_REG_POWER_FACTOR,	0x7A0000 },
+	{ HLW811X_REG_ENERGY_PA,	0x000120 },
+	{ HLW811X_REG_ENERGY_PB,	0x000010 },
+	{ HLW811X_REG_POWER_PA,		0x00F00000 },
+	{ HLW811X_REG_POWER_PB,		0x00100000 },
+	{ HLW811X_REG_POWER_S,		0x01000000 },
+	{ HLW811X_REG_FREQUENCY_L_LINE,	0x22F3 },
+	{ HLW811X_REG_ANGLE,		0x0010 },
+	{ HLW811X_REG_WAVE_IA,		0x012345 },
+	{ HLW811X_REG_WAVE_IB,		0x001234 },
+	{ HLW811X_REG_WAVE_U,		0x234567 },
+};
+
+static struct {
+	struct sim_config cfg;
+	struct sim_stats stats;
+	uint32_t regs[REG_MAX];
+	bool write_enabled;
+	uint8_t rx[8];
+	size_t rx_len;
+	size_t rx_pos;
+} sim;
+
+static uint64_t bytes_to_ns(size_t n)
+{
+	const uint32_t bits = sim.cfg.iface == HLW811X_UART ?
+		UART_BITS_PER_BYTE : SPI_BITS_PER_BYTE;
+	return (uint64_t)n * bits * 1000000000ull / sim.cfg.bitrate;
+}
+
+static uint16_t calc_coeff_chksum(void)
+{
+	uint32_t sum = 0xFFFFu;
+
+	for (uint8_t addr = HLW811X_REG_RMS_IA_COEFF;
+			addr <= HLW811X_REG_ENERGY_B_COEFF; addr++) {
+		sum += sim.regs[addr];
+	}
+
+	return (uint16_t)~sum;
+}
+
+static void respond(uint8_t addr)
+{
+	const uint8_t width = reg_width[addr];
+	uint8_t chksum = (uint8_t)(UART_HEADER + addr);
+
+	sim.rx_len = 0;
+	sim.rx_pos = 0;
+
+	for (uint8_t i = 0; i < width; i++) {
+		const uint8_t b = (uint8_t)
+			(sim.regs[addr] >> ((width - 1 - i) * 8));
+		sim.rx[sim.rx_len++] = b;
+		chksum = (uint8_t)(chksum + b);
+	}
+
+	if (sim.cfg.iface == HLW811X_UART) {
+		sim.rx[sim.rx_len++] = (uint8_t)~chksum;
+	}
+
+	sim.stats.bus_ns += sim.cfg.latency_ns;
+}
+
+static void run_command(uint8_t cmd)
+{
+	switch (cmd) {
+	case CMD_ENABLE_WRITE:
+		sim.write_enabled = true;
+		break;
+	case CMD_DISABLE_WRITE:
+		sim.write_enabled = false;
+		break;
+	case CMD_SET_CHANNEL_A:
+		sim.regs[HLW811X_REG_METER_STATUS] &= ~(1u << CHA_SEL_BIT);
+		break;
+	case CMD_SET_CHANNEL_B:
+		sim.regs[HLW811X_REG_METER_STATUS] |= 1u << CHA_SEL_BIT;
+		break;
+	case CMD_RESET_CHIP:
+		sim_reset();
+		break;
+	default:
+		sim.stats.errors++;
+		break;
+	}
+}
+
+static void write_reg(uint8_t addr, const uint8_t *data, size_t datalen)
+{
+	uint32_t val = 0;
+
+	if (addr == REG_COMMAND) {
+		if (datalen == 1) {
+			run_command(data[0]);
+		} else {
+			sim.stats.errors++;
+		}
+		return;
+	}
+
+	addr &= 0x7Fu;
+
+	if (datalen != reg_width[addr] || !sim.write_enabled) {
+		sim.stats.errors++;
+		return;
+	}
+
+	for (size_t i = 0; i < datalen; i++) {
+		val = (val << 8) | data[i];
+	}
+
+	sim.regs[addr] = val;
+
+	if (addr >= HLW811X_REG_RMS_IA_COEFF &&
+			addr <= HLW811X_REG_ENERGY_B_COEFF) {
+		sim.regs[HLW811X_REG_COEFF_CHKSUM] = calc_coeff_chksum();
+	}
+}
+
+static void receive_uart(const uint8_t *data, size_t datalen)
+{
+	uint8_t chksum = 0;
+
+	if (datalen < 2 || data[0] != UART_HEADER) {
+		sim.stats.errors++;
+		return;
+	}
+
+	if (datalen == 2) {
+		if (data[1] & 0x80u) {
+			sim.stats.errors++;
+		} else {
+			respond(data[1]);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < datalen - 1; i++) {
+		chksum = (uint8_t)(chksum + data[i]);
+	}
+
+	chksum = (uint8_t)~chksum;
+
+	if (chksum != data[datalen - 1]) {
+		sim.stats.errors++;
+		return;
+	}
+
+	write_reg(data[1], &data[2], datalen - 3);
+}
+
+static void receive_spi(const uint8_t *data, size_t datalen)
+{
+	if (datalen == 1 && !(data[0] & 0x80u)) {
+		respond(data[0]);
+	} else if (datalen > 1 && (data[0] & 0x80u)) {
+		write_reg(data[0], &data[1], datalen - 1);
+	} else {
+		sim.stats.errors++;
+	}
+}
+
+int sim_ll_write(const uint8_t *data, size_t datalen, void *ctx)
+{
+	(void)ctx;
+
+	sim.stats.frames++;
+	sim.stats.tx_bytes += (uint32_t)datalen;
+	sim.stats.bus_ns += bytes_to_ns(datalen);
+
+	if (sim.cfg.iface == HLW811X_UART) {
+		receive_uart(data, datalen);
+	} else {
+		receive_spi(data, datalen);
+	}
+
+	return (int)datalen;
+}
+
+int sim_ll_read(uint8_t *buf, size_t bufsize, void *ctx)
+{
+	size_t n = sim.rx_len - sim.rx_pos;
+
+	(void)ctx;
+
+	if (n > bufsize) {
+		n = bufsize;
+	}
+
+	memcpy(buf, &sim.rx[sim.rx_pos], n);
+	sim.rx_pos += n;
+
+	sim.stats.rx_bytes += (uint32_t)n;
+	sim.stats.bus_ns += bytes_to_ns(n);
+
+	return (int)n;
+}
+
+void sim_set_reg(hlw811x_reg_addr_t addr, uint32_t val)
+{
+	sim.regs[addr & 0x7Fu] = val;
+}
+
+uint32_t sim_get_reg(hlw811x_reg_addr_t addr)
+{
+	return sim.regs[addr & 0x7Fu];
+}
+
+void sim_get_stats(struct sim_stats *stats)
+{
+	*stats = sim.stats;
+}
+
+void sim_clear_stats(void)
+{
+	memset(&sim.stats, 0, sizeof(sim.stats));
+}
+
+void sim_reset(void)
+{
+	memset(sim.regs, 0, sizeof(sim.regs));
+
+	for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+		sim.regs[defaults[i].addr] = defaults[i].val;
+	}
+
+	sim.regs[HLW811X_REG_COEFF_CHKSUM] = calc_coeff_chksum();
+	sim.write_enabled = false;
+	sim.rx_len = 0;
+	sim.rx_pos = 0;
+}
+
+void sim_init(const struct sim_config *cfg)
+{
+	memset(&sim, 0, sizeof(sim));
+	sim.cfg = *cfg;
+	sim_reset();
+}
@@ -0,0 +1,56 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef HLW811X_SIM_H
+#define HLW811X_SIM_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hlw811x.h"
+
+struct sim_config {
+	hlw811x_interface_t iface;
+	/* UART baud rate, or SPI clock in Hz */
+	uint32_t bitrate;
+	/* Time from the end of a request to the first byte of the response */
+	uint32_t latency_ns;
+};
+
+struct sim_stats {
+	uint32_t frames; /* ll_write() calls */
+	uint32_t tx_bytes; /* bytes sent by the host */
+	uint32_t rx_bytes; /* bytes sent by the chip */
+	uint32_t errors; /* malformed frames or bad checksums */
+	uint64_t bus_ns; /* modelled time on the wire */
+};
+
+/* Simulated chip with a register file, the write protection and the frame
+ * checksums. A single chip is simulated at a time. */
+void sim_init(const struct sim_config *cfg);
+/* Restore the register file to its defaults, keeping the statistics. */
+void sim_reset(void);
+
+void sim_set_reg(hlw811x_reg_addr_t addr, uint32_t val);
+uint32_t sim_get_reg(hlw811x_reg_addr_t addr);
+
+void sim_get_stats(struct sim_stats *stats);
+void sim_clear_stats(void);
+
+/* Low level I/O to be given to hlw811x_create() */
+int sim_ll_write(const uint8_t *data, size_t datalen, void *ctx);
+int sim_ll_read(uint8_t *buf, size_t bufsize, void *ctx);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* HLW811X_SIM_H */
@@ -3,14 +3,21 @@
 COMPONENT_NAME = hlw811x
 
 SRC_FILES = \
-	../hlw811x.c
+	../hlw811x.c \
+	../hlw811x_default.c \
 
 TEST_SRC_FILES = \
 	src/hlw811x_test.cpp \
+	src/hlw811x_hpp_test.cpp \
 	src/test_all.cpp \
 
 INCLUDE_DIRS = $(CPPUTEST_HOME)/include ../
 MOCKS_SRC_DIRS =
-CPPUTEST_CPPFLAGS = -Wno-error=unused-macros
+CPPUTEST_CPPFLAGS = -Wno-error=unused-macros \
+	-DHLW811X_MAX_INSTANCES=3 \
+	-DHLW811X_STATS=1 \
+	-DHLW811X_TEMP_REF_RAW=0x400000 \
+	-DHLW811X_TEMP_REF_CENTIDEGREE=2500 \
+	-DHLW811X_TEMP_COUNTS_PER_DEGREE=4096
 
 include runners/MakefileRunner
@@ -0,0 +1,182 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/TestHarness_c.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include <type_traits>
+
+#include "hlw811x.hpp"
+
+namespace {
+
+struct Transport {
+	static constexpr hlw811x_interface_t interface = HLW811X_UART;
+
+	int write(const uint8_t *data, size_t datalen) {
+		return mock().actualCall("Transport::write")
+			.withMemoryBufferParameter("data", data, datalen)
+			.returnIntValueOrDefault(0);
+	}
+	int read(uint8_t *buf, size_t bufsize) {
+		return mock().actualCall("Transport::read")
+			.withOutputParameter("buf", buf)
+			.returnIntValueOrDefault(0);
+	}
+};
+
+using Config = hlw::Config<HLW811X_PGA_GAIN_2, HLW811X_PGA_GAIN_2,
+	HLW811X_PGA_GAIN_2>;
+using Meter = hlw::Hlw811x<Transport, Config>;
+/* ratios that do not survive K / 100.f truncated back to centi */
+using RatioConfig = hlw::Config<HLW811X_PGA_GAIN_2, HLW811X_PGA_GAIN_2,
+	HLW811X_PGA_GAIN_2, 53, 59, 105>;
+using RatioMeter = hlw::Hlw811x<Transport, RatioConfig>;
+
+static_assert(!std::is_convertible<hlw::MilliAmps,
+		hlw::MilliVolts>::value, "units must not mix");
+static_assert(hlw::detail::Channel<Config, HLW811X_CHANNEL_A>::rms_num
+		== 1000 * 8, "PGA gain folds at compile time");
+
+} /* namespace */
+
+TEST_GROUP(Hlw811xCpp) {
+	Transport transport;
+	Meter *meter;
+
+	void setup(void) {
+		meter = new Meter(transport);
+	}
+	void teardown(void) {
+		delete meter;
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	void expect_write(const char *buf, size_t len) {
+		mock().expectOneCall("Transport::write")
+			.withMemoryBufferParameter("data",
+				(const uint8_t *)buf, len)
+			.andReturnValue((int)len);
+	}
+
+	void expect_read(const char addr[2], const char *buf, size_t len) {
+		expect_write(addr, 2);
+		mock().expectOneCall("Transport::read")
+			.withOutputParameterReturning("buf",
+				(const uint8_t *)buf, len)
+			.andReturnValue((int)len);
+	}
+
+	void expect_begin(void) {
+		expect_read("\xA5\x02", "\xFF\xFF\x5A", 3);
+		expect_read("\xA5\x70", "\xFF\xFF\xEC", 3);
+		expect_read("\xA5\x71", "\xFF\xFF\xEB", 3);
+		expect_read("\xA5\x72", "\xFF\xFF\xEA", 3);
+		expect_read("\xA5\x73", "\xFF\xFF\xE9", 3);
+		expect_read("\xA5\x74", "\xFF\xFF\xE8", 3);
+		expect_read("\xA5\x75", "\xFF\xFF\xE7", 3);
+		expect_read("\xA5\x76", "\xFF\xFF\xE6", 3);
+		expect_read("\xA5\x77", "\xFF\xFF\xE5", 3);
+		expect_read("\xA5\x6F", "\x00\x08\xE3", 3);
+		expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
+		expect_write("\xA5\xEA\xE5\x8B", 4);
+		expect_write("\xA5\x80\x0A\x49\x87", 5);
+		expect_write("\xA5\xEA\xDC\x94", 4);
+	}
+
+	void begin(void) {
+		expect_begin();
+		LONGS_EQUAL(HLW811X_ERROR_NONE, meter->begin());
+	}
+};
+
+TEST(Hlw811xCpp, read_ShouldReturnTypedValues_WhenConfigIsFixedAtCompileTime) {
+	hlw::MilliAmps current;
+	hlw::MilliVolts voltage;
+	hlw::MilliWatts power;
+
+	begin();
+
+	expect_read("\xA5\x24", "\x02\x71\x00\xC3", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			meter->read_current<HLW811X_CHANNEL_A>(current));
+	LONGS_EQUAL(9999, current.value());
+
+	expect_read("\xA5\x26", "\x3F\x7A\x00\x7B", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, meter->read_voltage(voltage));
+	LONGS_EQUAL(324995, voltage.value());
+
+	expect_read("\xA5\x2C", "\x00\xFA\x00\x00\x34", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			meter->read_power<HLW811X_CHANNEL_A>(power));
+	LONGS_EQUAL(1999969, power.value());
+}
+
+TEST(Hlw811xCpp, to_quantity_ShouldMatchConversionOfCApi) {
+	const int32_t raw[] = { 0, 1, 0x1234, 0x027100, 0x3F7A00, 0x7FFFFF };
+	int32_t expected;
+
+	begin();
+
+	for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++) {
+		hlw811x_dev_convert_rms_batch(meter->handle(),
+				HLW811X_CHANNEL_B, &raw[i], &expected, 1);
+		LONGS_EQUAL(expected, meter->to_current<HLW811X_CHANNEL_B>(
+				raw[i]).value());
+		hlw811x_dev_convert_rms_batch(meter->handle(),
+				HLW811X_CHANNEL_U, &raw[i], &expected, 1);
+		LONGS_EQUAL(expected, meter->to_voltage(raw[i]).value());
+		hlw811x_dev_convert_power_batch(meter->handle(),
+				HLW811X_CHANNEL_B, HLW811X_CHANNEL_A,
+				&raw[i], &expected, 1);
+		LONGS_EQUAL(expected, meter->to_power<HLW811X_CHANNEL_B>(
+				raw[i]).value());
+	}
+}
+
+TEST(Hlw811xCpp, read_current_ShouldReturnInvalidData_WhenSignBitIsSet) {
+	hlw::MilliAmps current(1);
+
+	begin();
+
+	expect_read("\xA5\x24", "\x80\x00\x00\xB6", 4);
+	LONGS_EQUAL(HLW811X_INVALID_DATA,
+			meter->read_current<HLW811X_CHANNEL_A>(current));
+	CHECK(current == hlw::MilliAmps(0));
+}
+
+TEST(Hlw811xCpp, to_quantity_ShouldMatchConversionOfCApi_WhenRatiosAreNotDefault) {
+	const int32_t raw[] = { 1, 0x1234, 0x027100, 0x3F7A00, 0x7FFFFF };
+	int32_t expected;
+
+	delete meter;
+	meter = nullptr;
+	RatioMeter ratio_meter(transport);
+
+	expect_begin();
+	LONGS_EQUAL(HLW811X_ERROR_NONE, ratio_meter.begin());
+
+	for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++) {
+		hlw811x_dev_convert_rms_batch(ratio_meter.handle(),
+				HLW811X_CHANNEL_A, &raw[i], &expected, 1);
+		LONGS_EQUAL(expected, ratio_meter.to_current<HLW811X_CHANNEL_A>(
+				raw[i]).value());
+		hlw811x_dev_convert_rms_batch(ratio_meter.handle(),
+				HLW811X_CHANNEL_B, &raw[i], &expected, 1);
+		LONGS_EQUAL(expected, ratio_meter.to_current<HLW811X_CHANNEL_B>(
+				raw[i]).value());
+		hlw811x_dev_convert_rms_batch(ratio_meter.handle(),
+				HLW811X_CHANNEL_U, &raw[i], &expected, 1);
+		LONGS_EQUAL(expected, ratio_meter.to_voltage(raw[i]).value());
+		hlw811x_dev_convert_power_batch(ratio_meter.handle(),
+				HLW811X_CHANNEL_A, HLW811X_CHANNEL_A,
+				&raw[i], &expected, 1);
+		LONGS_EQUAL(expected, ratio_meter.to_power<HLW811X_CHANNEL_A>(
+				raw[i]).value());
+	}
+}
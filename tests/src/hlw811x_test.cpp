@@ -53,8 +53,21 @@ TEST_GROUP(HLW811x) {
 			.andReturnValue(4);
 	}
 
-	void expect_coeff_read(struct hlw811x_coeff *buf) {
-		struct hlw811x_coeff coeff;
+	void expect_write_window(const char **frames, size_t n) {
+		mock().expectOneCall("hlw811x_ll_write")
+			.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\xEA\xE5\x8B", 4)
+			.andReturnValue(4);
+		for (size_t i = 0; i < n; i++) {
+			mock().expectOneCall("hlw811x_ll_write")
+				.withMemoryBufferParameter("data", (const uint8_t *)frames[i], 5)
+				.andReturnValue(5);
+		}
+		mock().expectOneCall("hlw811x_ll_write")
+			.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\xEA\xDC\x94", 4)
+			.andReturnValue(4);
+	}
+
+	void expect_coeff_regs(void) {
 		//expect_read("\xA5\x02", "\x10\x00\x48", 3);
 		expect_read("\xA5\x02", "\xFF\xFF\x5A", 3);
 		expect_read("\xA5\x70", "\xFF\xFF\xEC", 3);
@@ -66,12 +79,26 @@ TEST_GROUP(HLW811x) {
 		expect_read("\xA5\x76", "\xFF\xFF\xE6", 3);
 		expect_read("\xA5\x77", "\xFF\xFF\xE5", 3);
 		expect_read("\xA5\x6F", "\x00\x08\xE3", 3);
+	}
+
+	void expect_coeff_read(struct hlw811x_coeff *buf) {
+		struct hlw811x_coeff coeff;
+		expect_coeff_regs();
 		LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_coeff(&coeff));
 		if (buf) {
 			memcpy(buf, &coeff, sizeof(coeff));
 		}
 	}
 
+	void expect_shadow_load(void) {
+		expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
+		expect_read("\xA5\x01", "\x0C\x04\x49", 3);
+		expect_read("\xA5\x13", "\x00\x00\x47", 3);
+		expect_read("\xA5\x1D", "\x32\x10\xFB", 3);
+		expect_read("\xA5\x40", "\x00\x00\x1A", 3);
+		LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_enable_shadow());
+	}
+
 	void set_default_param(float K1_A = 1) {
 		const struct hlw811x_resistor_ratio ratio = {
 		    .K1_A = K1_A,
@@ -130,6 +157,26 @@ TEST(HLW811x, read_reg_ShouldReadDataFromSpecifiedRegister) {
 	MEMCMP_EQUAL("\x0A\x04", buf, sizeof(buf));
 }
 
+TEST(HLW811x, read_current_channel_ShouldReadBit21_WhenMeterStatusIs24Bits) {
+	hlw811x_channel_t channel;
+	expect_read("\xA5\x2F", "\x20\x00\x00\x0B", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_current_channel(&channel));
+	LONGS_EQUAL(HLW811X_CHANNEL_B, channel);
+}
+
+TEST(HLW811x, set_rms_calc_mode_ShouldKeepPmode_WhenDcModeIsSet) {
+	expect_read("\xA5\x01", "\x0C\x04\x49", 3);
+	expect_write("\xA5\x81\x0E\x04\xC7", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_set_rms_calc_mode(HLW811X_RMS_MODE_DC));
+}
+
+TEST(HLW811x, read_reg_ShouldReturnInvalidParam_WhenLengthExceedsWidestRegister) {
+	uint8_t buf[5];
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_read_reg(HLW811X_REG_SYS_CTRL, buf, sizeof(buf)));
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_read_reg(HLW811X_REG_SYS_CTRL, buf, 0));
+}
+
 TEST(HLW811x, enable_channel_ShouldSendEnableCommand_WhenAllChannelsAreGiven) {
 	expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
 	expect_write("\xA5\x80\x0E\x04\xC8", 5);
@@ -166,6 +213,198 @@ TEST(HLW811x, set_pga_ShouldSetPgaValues) {
 	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_set_pga(&pga));
 }
 
+TEST(HLW811x, enable_shadow_ShouldWriteOnly_WhenSetterIsCalled) {
+	expect_shadow_load();
+	expect_write("\xA5\x80\x0E\x04\xC8", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_enable_channel(HLW811X_CHANNEL_ALL));
+}
+
+TEST(HLW811x, enable_shadow_ShouldNotTouchBus_WhenGetterIsCalled) {
+	struct hlw811x_pga pga;
+	expect_shadow_load();
+	expect_write("\xA5\x80\x0E\x04\xC8", 5);
+	hlw811x_enable_channel(HLW811X_CHANNEL_ALL);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_pga(&pga));
+	LONGS_EQUAL(HLW811X_PGA_GAIN_16, pga.A);
+	LONGS_EQUAL(HLW811X_PGA_GAIN_1, pga.B);
+	LONGS_EQUAL(HLW811X_PGA_GAIN_1, pga.U);
+}
+
+TEST(HLW811x, verify_shadow_ShouldReturnInvalidData_WhenChipDiffers) {
+	expect_shadow_load();
+	expect_read("\xA5\x00", "\x0A\x00\x50", 3);
+	expect_read("\xA5\x01", "\x0C\x04\x49", 3);
+	expect_read("\xA5\x13", "\x00\x00\x47", 3);
+	expect_read("\xA5\x1D", "\x32\x10\xFB", 3);
+	expect_read("\xA5\x40", "\x00\x00\x1A", 3);
+	LONGS_EQUAL(HLW811X_INVALID_DATA, hlw811x_verify_shadow());
+
+	struct hlw811x_pga pga;
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_pga(&pga));
+	LONGS_EQUAL(HLW811X_PGA_GAIN_1, pga.A);
+}
+
+TEST(HLW811x, verify_shadow_ShouldReturnInvalidParam_WhenShadowIsDisabled) {
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_verify_shadow());
+}
+
+TEST(HLW811x, commit_config_ShouldSendStagedWritesInSingleWindow) {
+	const char *frames[] = {
+		"\xA5\x80\x0E\x98\x34",
+		"\xA5\x93\x00\x20\xA7",
+		"\xA5\x81\x0C\x05\xC8",
+	};
+	const struct hlw811x_pga pga = {
+		.A = HLW811X_PGA_GAIN_1,
+		.B = HLW811X_PGA_GAIN_4,
+		.U = HLW811X_PGA_GAIN_8,
+	};
+	expect_shadow_load();
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_begin_config());
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_enable_channel(HLW811X_CHANNEL_ALL));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_set_pga(&pga));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_enable_waveform());
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_enable_pulse(HLW811X_CHANNEL_A));
+
+	expect_write_window(frames, 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_commit_config());
+}
+
+TEST(HLW811x, commit_config_ShouldReadOnlyOnce_WhenShadowIsDisabled) {
+	const char *frames[] = { "\xA5\x80\x0E\x04\xC8", };
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_begin_config());
+	expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_enable_channel(HLW811X_CHANNEL_A));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_enable_channel(HLW811X_CHANNEL_B
+				| HLW811X_CHANNEL_U));
+
+	expect_write_window(frames, 1);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_commit_config());
+}
+
+TEST(HLW811x, commit_config_ShouldReturnInvalidParam_WhenNotBegun) {
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_commit_config());
+}
+
+TEST(HLW811x, begin_config_ShouldReturnInvalidParam_WhenAlreadyBegun) {
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_begin_config());
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_begin_config());
+	hlw811x_abort_config();
+}
+
+TEST(HLW811x, abort_config_ShouldDropStagedWrites) {
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_begin_config());
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_write_reg(HLW811X_REG_SYS_CTRL,
+				(const uint8_t *)"\x0A\x04", 2));
+	hlw811x_abort_config();
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_commit_config());
+}
+
+static struct hlw811x_config default_config(void) {
+	struct hlw811x_config cfg = {};
+	cfg.pga.A = HLW811X_PGA_GAIN_4;
+	cfg.pga.B = HLW811X_PGA_GAIN_4;
+	cfg.pga.U = HLW811X_PGA_GAIN_4;
+	cfg.channels = HLW811X_CHANNEL_ALL;
+	cfg.pulse = HLW811X_CHANNEL_A | HLW811X_CHANNEL_B;
+	cfg.hpf = HLW811X_CHANNEL_ALL;
+	cfg.b_mode = HLW811X_B_MODE_NORMAL;
+	cfg.waveform = true;
+	cfg.zerocrossing = true;
+	cfg.power_factor = true;
+	cfg.interrupts = (hlw811x_intr_t)(HLW811X_INTR_PULSE_OUT_A
+			| HLW811X_INTR_B_LEAKAGE);
+	cfg.int1 = HLW811X_INTR_PULSE_OUT_A;
+	cfg.int2 = HLW811X_INTR_B_LEAKAGE;
+	return cfg;
+}
+
+TEST(HLW811x, apply_config_ShouldWriteAllRegisters_WhenAllDiffer) {
+	const char *frames[] = {
+		"\xA5\x80\x0E\x92\x3A",
+		"\xA5\x81\x10\x07\xC2",
+		"\xA5\x93\x0C\xE4\xD7",
+		"\xA5\x9D\x32\x20\x6B",
+		"\xA5\xC0\x80\x02\x18",
+	};
+	const struct hlw811x_config cfg = default_config();
+	expect_shadow_load();
+	expect_write_window(frames, 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_apply_config(&cfg));
+}
+
+TEST(HLW811x, apply_config_ShouldWriteOnlyChangedRegisters) {
+	const char *frames[] = {
+		"\xA5\x80\x0E\x92\x3A",
+		"\xA5\x81\x10\x07\xC2",
+		"\xA5\x93\x0C\xE4\xD7",
+		"\xA5\x9D\x32\x20\x6B",
+		"\xA5\xC0\x80\x02\x18",
+	};
+	const char *ie[] = { "\xA5\xC0\x80\x03\x17", };
+	struct hlw811x_config cfg = default_config();
+	expect_shadow_load();
+	expect_write_window(frames, 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_apply_config(&cfg));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_apply_config(&cfg));
+
+	cfg.interrupts = (hlw811x_intr_t)(cfg.interrupts
+			| HLW811X_INTR_AVERAGE_UPDATED);
+	expect_write_window(ie, 1);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_apply_config(&cfg));
+}
+
+TEST(HLW811x, apply_config_ShouldReadRegisters_WhenShadowIsDisabled) {
+	const char *frames[] = {
+		"\xA5\x80\x0E\x92\x3A",
+		"\xA5\x81\x10\x07\xC2",
+		"\xA5\x93\x0C\xE4\xD7",
+		"\xA5\x9D\x32\x20\x6B",
+		"\xA5\xC0\x80\x02\x18",
+	};
+	const struct hlw811x_config cfg = default_config();
+	expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
+	expect_read("\xA5\x01", "\x0C\x04\x49", 3);
+	expect_read("\xA5\x13", "\x00\x00\x47", 3);
+	expect_read("\xA5\x1D", "\x32\x10\xFB", 3);
+	expect_read("\xA5\x40", "\x00\x00\x1A", 3);
+	expect_write_window(frames, 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_apply_config(&cfg));
+}
+
+TEST(HLW811x, apply_config_ShouldReturnInvalidParam_WhenMultipleIntsPerPin) {
+	struct hlw811x_config cfg = default_config();
+	cfg.int1 = (hlw811x_intr_t)(HLW811X_INTR_PULSE_OUT_A
+			| HLW811X_INTR_PULSE_OUT_B);
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_apply_config(&cfg));
+}
+
+TEST(HLW811x, apply_config_ShouldReturnInvalidParam_WhenIntCannotBeRouted) {
+	struct hlw811x_config cfg = default_config();
+	cfg.int1 = HLW811X_INTR_RESERVED;
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_apply_config(&cfg));
+	cfg.int1 = HLW811X_INTR_PULSE_OUT_A;
+	cfg.int2 = HLW811X_INTR_RESERVED;
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_apply_config(&cfg));
+}
+
+TEST(HLW811x, reset_ShouldDisableShadow) {
+	struct hlw811x_pga pga;
+	expect_shadow_load();
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\xEA\x96\xDA", 4)
+		.andReturnValue(4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_reset());
+	expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_pga(&pga));
+}
+
 TEST(HLW811x, energy_ShouldReturnEnergyValue_WhenMaxValueIsGiven) {
 	expect_coeff_read(NULL);
 	set_default_param();
@@ -229,6 +468,15 @@ TEST(HLW811x, get_current_rms_ShouldReturnCurrentRmsValue_WhenBoundaryValuesAreG
 	LONGS_EQUAL(524279, mA);
 }
 
+TEST(HLW811x, get_rms_ShouldReturnZero_WhenResistorRatioIsNotSet) {
+	expect_coeff_read(NULL);
+
+	int32_t mA;
+	expect_read("\xA5\x24", "\x7F\xFF\xFF\xB9", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_rms(HLW811X_CHANNEL_A, &mA));
+	LONGS_EQUAL(0, mA);
+}
+
 TEST(HLW811x, get_voltage_rms_ShouldReturnVoltageRmsValue_WhenBoundaryValuesAreGiven) {
 	expect_coeff_read(NULL);
 	set_default_param();
@@ -266,3 +514,1492 @@ TEST(HLW811x, energy_ShouldReturn1Wh_When1WhIsGiven) {
 	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_energy(HLW811X_CHANNEL_A, &Wh));
 	LONGS_EQUAL(16777235, Wh); /* It should be 16777215. 0.0001192% error. */
 }
+
+TEST(HLW811x, read_regs_ShouldPackValuesInRegisterWidth_WhenRangeHasGaps) {
+	uint8_t buf[13];
+	size_t len;
+	expect_read("\xA5\x36", "\x01\x02\x03\x1E", 4);
+	expect_read("\xA5\x37", "\x04\x05\x06\x14", 4);
+	expect_read("\xA5\x38", "\x07\x08\x09\x0A", 4);
+	expect_read("\xA5\x3C", "\x0A\x0B\x0C\x0D\xF0", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_regs(HLW811X_REG_WAVE_IA,
+			HLW811X_REG_INSTAN_P, buf, sizeof(buf), &len));
+	LONGS_EQUAL(13, len);
+	MEMCMP_EQUAL("\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B\x0C\x0D",
+			buf, sizeof(buf));
+}
+
+TEST(HLW811x, read_regs_ShouldReturnBufferTooSmall_WhenRangeDoesNotFit) {
+	uint8_t buf[34];
+	LONGS_EQUAL(HLW811X_BUFFER_TOO_SMALL, hlw811x_read_regs(
+			HLW811X_REG_PEAK_IA, HLW811X_REG_INSTAN_S,
+			buf, sizeof(buf), NULL));
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_read_regs(
+			HLW811X_REG_INSTAN_S, HLW811X_REG_PEAK_IA,
+			buf, sizeof(buf), NULL));
+}
+
+TEST(HLW811x, read_snapshot_ShouldReadEachRegisterOnce) {
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	struct hlw811x_snapshot snap;
+	expect_read("\xA5\x22", "\x00\x64\xD4", 3);
+	expect_read("\xA5\x23", "\x22\xF4\x21", 3);
+	expect_read("\xA5\x24", "\x00\x01\x00\x35", 4);
+	expect_read("\xA5\x25", "\x00\x01\x00\x34", 4);
+	expect_read("\xA5\x26", "\x7F\xFF\xFF\xB7", 4);
+	expect_read("\xA5\x27", "\x7F\xFF\xFF\xB6", 4);
+	expect_read("\xA5\x28", "\x00\x00\x30\x02", 4);
+	expect_read("\xA5\x29", "\x00\x00\x30\x01", 4);
+	expect_read("\xA5\x2C", "\x00\x0B\xDB\xBC\x8C", 5);
+	expect_read("\xA5\x2D", "\x00\x0B\xDB\xBC\x8B", 5);
+	expect_read("\xA5\x2E", "\x00\x0B\xDB\xBC\x8A", 5);
+	expect_read("\xA5\x2F", "\x00\x00\x00\x2B", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_snapshot(&snap));
+
+	LONGS_EQUAL(15, snap.rms.A);
+	LONGS_EQUAL(15, snap.rms.B);
+	LONGS_EQUAL(655349, snap.rms.U);
+	LONGS_EQUAL(94865, snap.power.A);
+	LONGS_EQUAL(94865, snap.power.B);
+	LONGS_EQUAL(94865, snap.power.S);
+	LONGS_EQUAL(374, snap.energy.A);
+	LONGS_EQUAL(374, snap.energy.B);
+	LONGS_EQUAL(100, snap.power_factor);
+	LONGS_EQUAL(5000, snap.frequency);
+	LONGS_EQUAL(805, snap.phase_angle);
+	LONGS_EQUAL(HLW811X_CHANNEL_A, snap.channel);
+	LONGS_EQUAL(HLW811X_TEMPERATURE_NONE, snap.temperature);
+}
+
+TEST(HLW811x, read_snapshot_ShouldStop_WhenReadFails) {
+	struct hlw811x_snapshot snap;
+	expect_read("\xA5\x22", "\x00\x64\xD4", 3);
+	expect_read("\xA5\x23", "\x22\xF4\x00", 3);
+	LONGS_EQUAL(HLW811X_CHECKSUM_MISMATCH, hlw811x_read_snapshot(&snap));
+}
+
+TEST(HLW811x, sample_waveform_ShouldPushSignFixedSamples_WhenStreaming) {
+	struct hlw811x_wave_sample buf[2];
+	struct hlw811x_wave_sample sample;
+	struct hlw811x_wave_ring ring;
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_wave_ring_init(&ring, buf, 2));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_waveform_stream(
+			HLW811X_CHANNEL_A | HLW811X_CHANNEL_U, &ring));
+
+	expect_read("\xA5\x36", "\x00\x01\x00\x23", 4);
+	expect_read("\xA5\x38", "\x80\x00\x01\xA1", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_sample_waveform());
+	expect_read("\xA5\x36", "\x7F\xFF\xFF\xA7", 4);
+	expect_read("\xA5\x38", "\x00\x00\x02\x20", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_sample_waveform());
+	expect_read("\xA5\x36", "\x7F\xFF\xFF\xA7", 4);
+	expect_read("\xA5\x38", "\x00\x00\x02\x20", 4);
+	LONGS_EQUAL(HLW811X_BUFFER_TOO_SMALL, hlw811x_sample_waveform());
+	LONGS_EQUAL(1, ring.dropped);
+
+	CHECK(hlw811x_wave_ring_pop(&ring, &sample));
+	LONGS_EQUAL(0x100, sample.IA);
+	LONGS_EQUAL(0, sample.IB);
+	LONGS_EQUAL(-1, sample.U);
+	CHECK(hlw811x_wave_ring_pop(&ring, &sample));
+	LONGS_EQUAL(0x7FFFFF, sample.IA);
+	LONGS_EQUAL(2, sample.U);
+	CHECK(!hlw811x_wave_ring_pop(&ring, &sample));
+}
+
+TEST(HLW811x, wave_ring_init_ShouldReturnInvalidParam_WhenCapacityIsNotPowerOfTwo) {
+	struct hlw811x_wave_sample buf[3];
+	struct hlw811x_wave_ring ring;
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_wave_ring_init(&ring, buf, 3));
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_wave_ring_init(&ring, buf, 0));
+}
+
+TEST(HLW811x, sample_waveform_ShouldReturnInvalidParam_WhenNotStreaming) {
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_sample_waveform());
+}
+
+static void delay_ms(uint32_t ms, void *ctx) {
+	mock().actualCall(__func__).withParameter("ms", ms);
+}
+
+TEST(HLW811x, read_reg_ShouldRetryAfterResync_WhenChecksumMismatches) {
+	const struct hlw811x_transport_policy policy = {
+		.retries = 2,
+		.backoff_ms = 5,
+		.delay_ms = delay_ms,
+	};
+	struct hlw811x_transport_stats stats;
+	uint8_t buf[2];
+
+	hlw811x_set_transport_policy(&policy);
+	expect_read("\xA5\x00", "\x0A\x04\x00", 3);
+	mock().expectOneCall("hlw811x_ll_read")
+		.withOutputParameterReturning("buf", (const uint8_t *)"\x4C", 1)
+		.andReturnValue(1);
+	mock().expectOneCall("hlw811x_ll_read")
+		.withOutputParameterReturning("buf", (const uint8_t *)"\x00", 1)
+		.andReturnValue(0);
+	mock().expectOneCall("delay_ms").withParameter("ms", 5);
+	expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_reg(HLW811X_REG_SYS_CTRL, buf, sizeof(buf)));
+	MEMCMP_EQUAL("\x0A\x04", buf, sizeof(buf));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_transport_stats(&stats));
+	LONGS_EQUAL(1, stats.retries);
+	LONGS_EQUAL(1, stats.checksum_errors);
+	LONGS_EQUAL(0, stats.timeouts);
+	LONGS_EQUAL(1, stats.resyncs);
+	LONGS_EQUAL(0, stats.failures);
+}
+
+TEST(HLW811x, read_reg_ShouldGiveUp_WhenRetriesAreExhausted) {
+	const struct hlw811x_transport_policy policy = {
+		.retries = 1,
+	};
+	struct hlw811x_transport_stats stats;
+	uint8_t buf[2];
+
+	hlw811x_set_transport_policy(&policy);
+	for (int i = 0; i < 2; i++) {
+		mock().expectOneCall("hlw811x_ll_write")
+			.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x00", 2)
+			.andReturnValue(2);
+		mock().expectOneCall("hlw811x_ll_read")
+			.withOutputParameterReturning("buf", (const uint8_t *)"\x00", 1)
+			.andReturnValue(0);
+	}
+	mock().expectOneCall("hlw811x_ll_read") /* resync in between */
+		.withOutputParameterReturning("buf", (const uint8_t *)"\x00", 1)
+		.andReturnValue(0);
+
+	LONGS_EQUAL(HLW811X_NO_RESPONSE, hlw811x_read_reg(HLW811X_REG_SYS_CTRL, buf, sizeof(buf)));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_transport_stats(&stats));
+	LONGS_EQUAL(1, stats.retries);
+	LONGS_EQUAL(2, stats.timeouts);
+	LONGS_EQUAL(1, stats.failures);
+}
+
+TEST(HLW811x, read_reg_ShouldRetry_WhenResponseIsShort) {
+	const struct hlw811x_transport_policy policy = {
+		.retries = 1,
+	};
+	struct hlw811x_transport_stats stats;
+	uint8_t buf[2];
+
+	hlw811x_set_transport_policy(&policy);
+	expect_read("\xA5\x00", "\x0A", 1);
+	mock().expectOneCall("hlw811x_ll_read") /* resync */
+		.withOutputParameterReturning("buf", (const uint8_t *)"\x00", 1)
+		.andReturnValue(0);
+	expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_reg(HLW811X_REG_SYS_CTRL, buf, sizeof(buf)));
+	MEMCMP_EQUAL("\x0A\x04", buf, sizeof(buf));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_transport_stats(&stats));
+	LONGS_EQUAL(1, stats.retries);
+	LONGS_EQUAL(1, stats.short_reads);
+	LONGS_EQUAL(0, stats.failures);
+}
+
+static uint32_t step_clock(void *ctx) {
+	return (*(uint32_t *)ctx += 1000);
+}
+
+TEST(HLW811x, get_stats_ShouldCountTransfersByOperationAndRegister) {
+	struct hlw811x_stats stats;
+	uint32_t now = 0;
+	uint8_t buf[2];
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_clear_stats());
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_set_stats_clock(step_clock, &now));
+	expect_read("\xA5\x00", "\x0A\x04\x4C", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_reg(HLW811X_REG_SYS_CTRL, buf, sizeof(buf)));
+	expect_read("\xA5\x00", "\x0A\x04\x00", 3);
+	LONGS_EQUAL(HLW811X_CHECKSUM_MISMATCH, hlw811x_read_reg(HLW811X_REG_SYS_CTRL, buf, sizeof(buf)));
+	expect_write("\xA5\x80\x0A\x04\xCC", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_write_reg(HLW811X_REG_SYS_CTRL, (const uint8_t *)"\x0A\x04", 2));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_stats(&stats));
+	const struct hlw811x_op_stats *rd = &stats.ops[HLW811X_OP_READ];
+	LONGS_EQUAL(2, rd->calls);
+	LONGS_EQUAL(1, rd->errors);
+	LONGS_EQUAL(10, rd->bytes);
+	LONGS_EQUAL(1000, rd->min_us);
+	LONGS_EQUAL(1000, rd->max_us);
+	LONGS_EQUAL(2000, rd->total_us);
+	LONGS_EQUAL(2, rd->histogram[3]); /* 1000us in [1000, 2000) */
+	LONGS_EQUAL(1, stats.ops[HLW811X_OP_WRITE].calls);
+	LONGS_EQUAL(5, stats.ops[HLW811X_OP_WRITE].bytes);
+	LONGS_EQUAL(2, stats.ops[HLW811X_OP_COMMAND].calls);
+	LONGS_EQUAL(8, stats.ops[HLW811X_OP_COMMAND].bytes);
+	LONGS_EQUAL(3, stats.regs[HLW811X_REG_SYS_CTRL].calls);
+	LONGS_EQUAL(1, stats.regs[HLW811X_REG_SYS_CTRL].errors);
+	LONGS_EQUAL(15, stats.regs[HLW811X_REG_SYS_CTRL].bytes);
+	LONGS_EQUAL(2, stats.regs[HLW811X_REG_COMMAND].calls);
+}
+
+static void read_cb(hlw811x_error_t err, hlw811x_reg_addr_t addr,
+		const uint8_t *data, size_t datalen, void *ctx) {
+	mock().actualCall(__func__)
+		.withParameter("err", err)
+		.withParameter("addr", addr)
+		.withMemoryBufferParameter("data", data, datalen)
+		.withPointerParameter("ctx", ctx);
+}
+
+TEST(HLW811x, submit_read_ShouldCompleteThroughOnRx_WhenResponseArrivesInChunks) {
+	int ctx;
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x23", 2)
+		.andReturnValue(2);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_submit_read(
+			HLW811X_REG_FREQUENCY_L_LINE, 2, read_cb, &ctx));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_on_rx((const uint8_t *)"\x22", 1));
+	mock().expectOneCall("read_cb")
+		.withParameter("err", HLW811X_ERROR_NONE)
+		.withParameter("addr", HLW811X_REG_FREQUENCY_L_LINE)
+		.withMemoryBufferParameter("data", (const uint8_t *)"\x22\xF4", 2)
+		.withPointerParameter("ctx", &ctx);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_on_rx((const uint8_t *)"\xF4\x21", 2));
+}
+
+TEST(HLW811x, on_rx_ShouldReportChecksumMismatch_WhenResponseIsCorrupted) {
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x23", 2)
+		.andReturnValue(2);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_submit_read(
+			HLW811X_REG_FREQUENCY_L_LINE, 2, read_cb, NULL));
+	mock().expectOneCall("read_cb")
+		.withParameter("err", HLW811X_CHECKSUM_MISMATCH)
+		.withParameter("addr", HLW811X_REG_FREQUENCY_L_LINE)
+		.withMemoryBufferParameter("data", (const uint8_t *)"\x22\xF4", 2)
+		.withPointerParameter("ctx", NULL);
+	LONGS_EQUAL(HLW811X_INCORRECT_RESPONSE,
+			hlw811x_on_rx((const uint8_t *)"\x22\xF4\x00\x00", 4));
+	LONGS_EQUAL(HLW811X_INCORRECT_RESPONSE,
+			hlw811x_on_rx((const uint8_t *)"\x00", 1));
+}
+
+TEST(HLW811x, cancel_reads_ShouldCompleteQueuedReads_WhenNoResponseComes) {
+	struct hlw811x_transport_stats stats;
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x23", 2)
+		.andReturnValue(2);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_submit_read(
+			HLW811X_REG_FREQUENCY_L_LINE, 2, read_cb, NULL));
+	mock().expectOneCall("read_cb")
+		.withParameter("err", HLW811X_NO_RESPONSE)
+		.withParameter("addr", HLW811X_REG_FREQUENCY_L_LINE)
+		.withMemoryBufferParameter("data", (const uint8_t *)"\x00\x00", 2)
+		.withPointerParameter("ctx", NULL);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_cancel_reads());
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_transport_stats(&stats));
+	LONGS_EQUAL(1, stats.timeouts);
+	LONGS_EQUAL(HLW811X_INCORRECT_RESPONSE,
+			hlw811x_on_rx((const uint8_t *)"\x22", 1));
+}
+
+TEST(HLW811x, submit_read_ShouldPipelineHeaders_WhenMultipleReadsAreQueued) {
+	struct hlw811x_queue_stats stats;
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x23", 2)
+		.andReturnValue(2);
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x22", 2)
+		.andReturnValue(2);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_submit_read(
+			HLW811X_REG_FREQUENCY_L_LINE, 2, read_cb, NULL));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_submit_read(
+			HLW811X_REG_ANGLE, 2, read_cb, NULL));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_submit_read(
+			HLW811X_REG_RMS_IA, 3, read_cb, NULL));
+	mock().checkExpectations();
+
+	/* the first response completes and the third header goes out */
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x24", 2)
+		.andReturnValue(2);
+	mock().expectOneCall("read_cb")
+		.withParameter("err", HLW811X_ERROR_NONE)
+		.withParameter("addr", HLW811X_REG_FREQUENCY_L_LINE)
+		.withMemoryBufferParameter("data", (const uint8_t *)"\x22\xF4", 2)
+		.withPointerParameter("ctx", NULL);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_on_rx((const uint8_t *)"\x22\xF4\x21\x00", 4));
+	mock().checkExpectations();
+
+	mock().expectOneCall("read_cb")
+		.withParameter("err", HLW811X_ERROR_NONE)
+		.withParameter("addr", HLW811X_REG_ANGLE)
+		.withMemoryBufferParameter("data", (const uint8_t *)"\x00\x64", 2)
+		.withPointerParameter("ctx", NULL);
+	mock().expectOneCall("read_cb")
+		.withParameter("err", HLW811X_ERROR_NONE)
+		.withParameter("addr", HLW811X_REG_RMS_IA)
+		.withMemoryBufferParameter("data", (const uint8_t *)"\x00\x01\x00", 3)
+		.withPointerParameter("ctx", NULL);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_on_rx(
+			(const uint8_t *)"\x64\xD4\x00\x01\x00\x35", 6));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_queue_stats(&stats));
+	LONGS_EQUAL(3, stats.submitted);
+	LONGS_EQUAL(3, stats.completed);
+	LONGS_EQUAL(1, stats.deferred);
+	LONGS_EQUAL(0, stats.stalls);
+	LONGS_EQUAL(0, stats.depth);
+	LONGS_EQUAL(3, stats.max_depth);
+}
+
+TEST(HLW811x, submit_read_ShouldReturnBusy_WhenQueueIsFull) {
+	struct hlw811x_queue_stats stats;
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x23", 2)
+		.andReturnValue(2);
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\x23", 2)
+		.andReturnValue(2);
+	for (int i = 0; i < 4; i++) {
+		LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_submit_read(
+				HLW811X_REG_FREQUENCY_L_LINE, 2, read_cb, NULL));
+	}
+	LONGS_EQUAL(HLW811X_BUSY, hlw811x_submit_read(
+			HLW811X_REG_FREQUENCY_L_LINE, 2, read_cb, NULL));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_queue_stats(&stats));
+	LONGS_EQUAL(4, stats.submitted);
+	LONGS_EQUAL(1, stats.stalls);
+	LONGS_EQUAL(4, stats.depth);
+}
+
+TEST(HLW811x, submit_read_ShouldReturnInvalidParam_WhenLenIsOutOfRange) {
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_submit_read(
+			HLW811X_REG_FREQUENCY_L_LINE, 5, read_cb, NULL));
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_submit_read(
+			HLW811X_REG_FREQUENCY_L_LINE, 2, NULL, NULL));
+}
+
+TEST(HLW811x, energy_delta_ShouldCarryFraction_WhenRegisterWraps) {
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	uint64_t total;
+	int32_t Wh;
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\xFF\xFF\xF0\x44", 4);
+	expect_read("\xA5\x29", "\x00\x00\x00\x31", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_update_energy((hlw811x_intr_t)0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+	LONGS_EQUAL(0, Wh);
+
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x10\x22", 4);
+	expect_read("\xA5\x29", "\x00\x00\x30\x01", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_update_energy((hlw811x_intr_t)0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+	LONGS_EQUAL(249, Wh); /* 32 counts of 7.81Wh */
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_get_energy_total(HLW811X_CHANNEL_B, &total));
+	LONGS_EQUAL(374, total);
+
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x11\x21", 4);
+	expect_read("\xA5\x29", "\x00\x00\x30\x01", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_update_energy((hlw811x_intr_t)0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+	LONGS_EQUAL(8, Wh); /* 7.81Wh plus the fraction carried over */
+}
+
+TEST(HLW811x, update_energy_ShouldAddRegisterRange_WhenOverflowIsPending) {
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	uint64_t total;
+	expect_read("\xA5\x13", "\x00\x00\x47", 3);
+	expect_read("\xA5\x28", "\x00\x00\x30\x02", 4);
+	expect_read("\xA5\x29", "\x00\x00\x30\x01", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_update_energy(HLW811X_INTR_ACTIVE_POWER_OVERFLOW_B));
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_get_energy_total(HLW811X_CHANNEL_A, &total));
+	LONGS_EQUAL(374, total);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_get_energy_total(HLW811X_CHANNEL_B, &total));
+	LONGS_EQUAL(131068374, total); /* 48 + 2^24 counts */
+	LONGS_EQUAL(HLW811X_INVALID_PARAM,
+			hlw811x_get_energy_total(HLW811X_CHANNEL_U, &total));
+}
+
+TEST(HLW811x, update_energy_ShouldCountOverflowOnce_WhenFlagIsHeld) {
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	int32_t Wh;
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x10\x22", 4);
+	expect_read("\xA5\x29", "\x00\x00\x30\x01", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_update_energy((hlw811x_intr_t)0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x20\x12", 4);
+	expect_read("\xA5\x29", "\x00\x00\x30\x01", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_update_energy(HLW811X_INTR_ACTIVE_POWER_OVERFLOW_A));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+	LONGS_EQUAL(131068124, Wh); /* 2^24 + 16 counts */
+
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x30\x02", 4);
+	expect_read("\xA5\x29", "\x00\x00\x30\x01", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_update_energy(HLW811X_INTR_ACTIVE_POWER_OVERFLOW_A));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+	LONGS_EQUAL(125, Wh); /* 16 counts, the wrap already counted */
+}
+
+TEST(HLW811x, update_energy_ShouldNotCountWrapTwice_WhenFlagComesAfterWrap) {
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	int32_t Wh;
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\xFF\xFF\xF0\x44", 4);
+	expect_read("\xA5\x29", "\x00\x00\x00\x31", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_update_energy((hlw811x_intr_t)0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+
+	/* wrapped after the flags were read */
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x10\x22", 4);
+	expect_read("\xA5\x29", "\x00\x00\x00\x31", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_update_energy((hlw811x_intr_t)0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+	LONGS_EQUAL(249, Wh); /* 32 counts */
+
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x11\x21", 4);
+	expect_read("\xA5\x29", "\x00\x00\x00\x31", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_update_energy(HLW811X_INTR_ACTIVE_POWER_OVERFLOW_A));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_energy_delta(HLW811X_CHANNEL_A, &Wh));
+	LONGS_EQUAL(8, Wh); /* 1 count, the flag being of the counted wrap */
+}
+
+TEST(HLW811x, update_energy_ShouldStartOver_WhenChipIsReset) {
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	uint64_t total;
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x10\x22", 4);
+	expect_read("\xA5\x29", "\x00\x00\x00\x31", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_update_energy((hlw811x_intr_t)0));
+
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\xEA\x96\xDA", 4)
+		.andReturnValue(4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_reset());
+
+	/* the register started over from zero below the last value */
+	expect_read("\xA5\x13", "\x0C\x00\x3B", 3);
+	expect_read("\xA5\x28", "\x00\x00\x01\x31", 4);
+	expect_read("\xA5\x29", "\x00\x00\x00\x31", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_update_energy((hlw811x_intr_t)0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_get_energy_total(HLW811X_CHANNEL_A, &total));
+	LONGS_EQUAL(0, total);
+}
+
+static void irq_handler(hlw811x_intr_t flag, void *ctx) {
+	mock().actualCall(__func__)
+		.withParameter("flag", flag)
+		.withPointerParameter("ctx", ctx);
+}
+
+TEST(HLW811x, handle_irq_ShouldCallRegisteredHandlers_WhenFlagsArePending) {
+	int avg_ctx;
+	int alarm_ctx;
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_register_irq_handler(
+			HLW811X_INTR_AVERAGE_UPDATED, irq_handler, &avg_ctx));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_register_irq_handler(
+			(hlw811x_intr_t)(HLW811X_INTR_UNDER_VOLTAGE
+				| HLW811X_INTR_ZERO_CROSSING_VOLTAGE),
+			irq_handler, &alarm_ctx));
+
+	expect_read("\xA5\x42", "\x48\x03\xCD", 3);
+	mock().expectOneCall("irq_handler")
+		.withParameter("flag", HLW811X_INTR_AVERAGE_UPDATED)
+		.withPointerParameter("ctx", &avg_ctx);
+	mock().expectOneCall("irq_handler")
+		.withParameter("flag", HLW811X_INTR_UNDER_VOLTAGE)
+		.withPointerParameter("ctx", &alarm_ctx);
+	mock().expectOneCall("irq_handler")
+		.withParameter("flag", HLW811X_INTR_ZERO_CROSSING_VOLTAGE)
+		.withPointerParameter("ctx", &alarm_ctx);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_handle_irq());
+}
+
+TEST(HLW811x, handle_irq_ShouldNotCallHandler_WhenUnregistered) {
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_register_irq_handler(
+			HLW811X_INTR_AVERAGE_UPDATED, irq_handler, NULL));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_register_irq_handler(
+			HLW811X_INTR_AVERAGE_UPDATED, NULL, NULL));
+	expect_read("\xA5\x42", "\x48\x03\xCD", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_handle_irq());
+}
+
+TEST(HLW811x, zc_tracker_ShouldTrackFrequencyAndPhase_WhenCrossingsAreFed) {
+	int32_t centihertz;
+	int32_t centidegree;
+	uint32_t next;
+	hlw811x_line_freq_t freq;
+
+	expect_read("\xA5\x01", "\x0C\x04\x49", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_zc_tracker(NULL, NULL));
+	LONGS_EQUAL(HLW811X_INVALID_DATA,
+			hlw811x_get_tracked_frequency(&centihertz));
+
+	hlw811x_feed_zerocrossing(HLW811X_INTR_ZERO_CROSSING_VOLTAGE, 100);
+	hlw811x_feed_zerocrossing(HLW811X_INTR_ZERO_CROSSING_VOLTAGE, 20100);
+	hlw811x_feed_zerocrossing(HLW811X_INTR_ZERO_CROSSING_VOLTAGE, 60100);
+	hlw811x_feed_zerocrossing(HLW811X_INTR_ZERO_CROSSING_CURRENT_A, 62100);
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_get_tracked_frequency(&centihertz));
+	LONGS_EQUAL(5000, centihertz); /* the missed crossing is ignored */
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_tracked_phase(&centidegree));
+	LONGS_EQUAL(3600, centidegree);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_next_zerocrossing(&next));
+	LONGS_EQUAL(80100, next);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_line_freq(&freq));
+	LONGS_EQUAL(HLW811X_LINE_FREQ_50HZ, freq);
+
+	for (uint32_t t = 60100; t < 60100 + 16667 * 50; t += 16667) {
+		hlw811x_feed_zerocrossing(HLW811X_INTR_ZERO_CROSSING_VOLTAGE, t);
+	}
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_line_freq(&freq));
+	LONGS_EQUAL(HLW811X_LINE_FREQ_60HZ, freq);
+}
+
+static uint32_t fake_clock(void *ctx) {
+	return (*(uint32_t *)ctx += 20000);
+}
+
+static uint32_t read_clock(void *ctx) {
+	return *(uint32_t *)ctx;
+}
+
+TEST(HLW811x, handle_irq_ShouldTimestampZeroCrossings_WhenClockIsGiven) {
+	uint32_t now = 0;
+	int32_t centihertz;
+
+	expect_read("\xA5\x01", "\x0C\x04\x49", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_start_zc_tracker(fake_clock, &now));
+	expect_read("\xA5\x42", "\x50\x00\xC8", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_handle_irq());
+	expect_read("\xA5\x42", "\x50\x00\xC8", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_handle_irq());
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_get_tracked_frequency(&centihertz));
+	LONGS_EQUAL(5000, centihertz);
+}
+
+TEST(HLW811x, handle_irq_ShouldSkipPhase_WhenBothCrossingsComeInOneRead) {
+	uint32_t now = 0;
+	int32_t centidegree;
+
+	expect_read("\xA5\x01", "\x0C\x04\x49", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_start_zc_tracker(fake_clock, &now));
+	expect_read("\xA5\x42", "\x40\x00\xD8", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_handle_irq());
+	expect_read("\xA5\x42", "\x50\x00\xC8", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_handle_irq());
+
+	LONGS_EQUAL(HLW811X_INVALID_DATA,
+			hlw811x_get_tracked_phase(&centidegree));
+
+	hlw811x_feed_zerocrossing(HLW811X_INTR_ZERO_CROSSING_CURRENT_A,
+			now + 2000);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_get_tracked_phase(&centidegree));
+	LONGS_EQUAL(3600, centidegree);
+}
+
+static int dev_ll_write(const uint8_t *data, size_t datalen, void *ctx) {
+	return mock().actualCall(__func__)
+		.withPointerParameter("ctx", ctx)
+		.withMemoryBufferParameter("data", data, datalen)
+		.returnIntValueOrDefault(0);
+}
+
+static int dev_ll_read(uint8_t *buf, size_t bufsize, void *ctx) {
+	return mock().actualCall(__func__)
+		.withPointerParameter("ctx", ctx)
+		.withOutputParameter("buf", buf)
+		.returnIntValueOrDefault(0);
+}
+
+static void dev_ll_select(bool selected, void *ctx) {
+	mock().actualCall(__func__)
+		.withPointerParameter("ctx", ctx)
+		.withParameter("selected", selected);
+}
+
+TEST_GROUP(HLW811x_Instance) {
+	int ctx1;
+	int ctx2;
+	struct hlw811x *dev1;
+	struct hlw811x *dev2;
+
+	void setup(void) {
+		const struct hlw811x_io io1 = {
+			.ll_write = dev_ll_write,
+			.ll_read = dev_ll_read,
+			.ctx = &ctx1,
+		};
+		const struct hlw811x_io io2 = {
+			.ll_write = dev_ll_write,
+			.ll_read = dev_ll_read,
+			.ctx = &ctx2,
+		};
+
+		hlw811x_init(HLW811X_UART);
+		dev1 = hlw811x_create(HLW811X_UART, &io1);
+		dev2 = hlw811x_create(HLW811X_UART, &io2);
+	}
+	void teardown(void) {
+		hlw811x_destroy(dev1);
+		hlw811x_destroy(dev2);
+
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	void expect_read(void *ctx, const char addr[2],
+			const char *buf, size_t bufsize) {
+		mock().expectOneCall("dev_ll_write")
+			.withPointerParameter("ctx", ctx)
+			.withMemoryBufferParameter("data", (const uint8_t *)addr, 2)
+			.andReturnValue(2);
+		mock().expectOneCall("dev_ll_read")
+			.withPointerParameter("ctx", ctx)
+			.withOutputParameterReturning("buf", (const uint8_t *)buf, bufsize)
+			.andReturnValue((int)bufsize);
+	}
+
+	void expect_header(void *ctx, const char header[2]) {
+		mock().expectOneCall("dev_ll_write")
+			.withPointerParameter("ctx", ctx)
+			.withMemoryBufferParameter("data", (const uint8_t *)header, 2)
+			.andReturnValue(2);
+	}
+
+	/* a snapshot of a chip reading zero everywhere */
+	void expect_zero_snapshot(void *ctx) {
+		const struct { uint8_t addr; uint8_t width; } regs[] = {
+			{ 0x22, 2 }, { 0x23, 2 }, { 0x24, 3 }, { 0x25, 3 },
+			{ 0x26, 3 }, { 0x27, 3 }, { 0x28, 3 }, { 0x29, 3 },
+			{ 0x2C, 4 }, { 0x2D, 4 }, { 0x2E, 4 }, { 0x2F, 3 },
+		};
+		static char frames[12][2 + 5];
+
+		for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+			char *frame = frames[i];
+			memset(frame, 0, sizeof(frames[i]));
+			frame[0] = '\xA5';
+			frame[1] = (char)regs[i].addr;
+			frame[2 + regs[i].width] = (char)~(0xA5 + regs[i].addr);
+			expect_read(ctx, frame, &frame[2], regs[i].width + 1u);
+		}
+	}
+};
+
+TEST(HLW811x_Instance, create_ShouldReturnNull_WhenNoFreeInstanceLeft) {
+	const struct hlw811x_io io = {
+		.ll_write = dev_ll_write,
+		.ll_read = dev_ll_read,
+	};
+	CHECK(dev1 != NULL);
+	CHECK(dev2 != NULL);
+	POINTERS_EQUAL(NULL, hlw811x_create(HLW811X_UART, &io));
+}
+
+TEST(HLW811x_Instance, create_ShouldReturnNull_WhenInvalidIoIsGiven) {
+	const struct hlw811x_io io = { .ll_write = dev_ll_write, };
+	hlw811x_destroy(dev2);
+	dev2 = NULL;
+	POINTERS_EQUAL(NULL, hlw811x_create(HLW811X_UART, NULL));
+	POINTERS_EQUAL(NULL, hlw811x_create(HLW811X_UART, &io));
+}
+
+TEST(HLW811x_Instance, reset_ShouldUseOwnIo_WhenMultipleInstancesExist) {
+	mock().expectOneCall("dev_ll_write")
+		.withPointerParameter("ctx", &ctx2)
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\xEA\x96\xDA", 4)
+		.andReturnValue(4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_dev_reset(dev2));
+}
+
+TEST(HLW811x_Instance, get_pga_ShouldKeepStatePerInstance) {
+	struct hlw811x_pga pga;
+	expect_read(&ctx1, "\xA5\x00", "\x0A\x04\x4C", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_dev_get_pga(dev1, &pga));
+	LONGS_EQUAL(HLW811X_PGA_GAIN_16, pga.A);
+	expect_read(&ctx2, "\xA5\x00", "\x0A\x00\x50", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_dev_get_pga(dev2, &pga));
+	LONGS_EQUAL(HLW811X_PGA_GAIN_1, pga.A);
+}
+
+TEST(HLW811x_Instance, agg_step_ShouldPublishRound_WhenEveryChipIsRead) {
+	/* the registers of a snapshot, METER_STATUS last */
+	static const char *const headers[] = {
+		"\xA5\x22", "\xA5\x23", "\xA5\x24", "\xA5\x25",
+		"\xA5\x26", "\xA5\x27", "\xA5\x28", "\xA5\x29",
+		"\xA5\x2C", "\xA5\x2D", "\xA5\x2E", "\xA5\x2F",
+	};
+	static const uint8_t widths[] = { 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 3 };
+	const size_t n = sizeof(widths);
+	struct hlw811x *const devs[] = { dev1, dev2 };
+	struct hlw811x_agg_chip chips[2];
+	struct hlw811x_agg_sample sample;
+	struct hlw811x_agg agg;
+	uint32_t now = 0;
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_agg_init(&agg, chips, devs, 2, read_clock, &now));
+
+	/* both buses get their first headers in the same step */
+	expect_header(&ctx1, headers[0]);
+	expect_header(&ctx1, headers[1]);
+	expect_header(&ctx2, headers[0]);
+	expect_header(&ctx2, headers[1]);
+	LONGS_EQUAL(HLW811X_BUSY, hlw811x_agg_step(&agg));
+	LONGS_EQUAL(HLW811X_BUSY, hlw811x_agg_get(&agg, 0, &sample));
+	mock().checkExpectations();
+
+	for (size_t i = 0; i < n; i++) {
+		uint8_t resp[5] = { 0, };
+		resp[widths[i]] = (uint8_t)~(0xA5 + (uint8_t)headers[i][1]);
+		if (i + 2 < n) {
+			expect_header(&ctx1, headers[i + 2]);
+		}
+		LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_dev_on_rx(dev1,
+				resp, widths[i] + 1u));
+	}
+
+	/* the second chip never answers, HLW811X_AGG_TIMEOUT_MS by default */
+	now = 250000 - 1;
+	LONGS_EQUAL(HLW811X_BUSY, hlw811x_agg_step(&agg));
+	now += 1;
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_agg_step(&agg));
+
+	LONGS_EQUAL(0, agg.timestamp);
+	LONGS_EQUAL(0, agg.skew);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_agg_get(&agg, 0, &sample));
+	LONGS_EQUAL(HLW811X_CHIP_OK, sample.health);
+	LONGS_EQUAL(0, sample.snapshot.rms.U);
+	LONGS_EQUAL(HLW811X_CHANNEL_A, sample.snapshot.channel);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_agg_get(&agg, 1, &sample));
+	LONGS_EQUAL(HLW811X_CHIP_FAILED, sample.health);
+	LONGS_EQUAL(HLW811X_NO_RESPONSE, sample.err);
+	LONGS_EQUAL(2, sample.errors.timeouts);
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_agg_get(&agg, 2, &sample));
+}
+
+TEST(HLW811x_Instance, agg_read_chip_ShouldReportOffline_WhenFailingRoundsInARow) {
+	struct hlw811x *const devs[] = { dev1, dev2 };
+	struct hlw811x_agg_chip chips[2];
+	struct hlw811x_agg_sample sample;
+	struct hlw811x_agg agg;
+	uint32_t now = 0;
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_agg_init(&agg, chips, devs, 2, fake_clock, &now));
+
+	for (int i = 0; i < 3; i++) {
+		/* a worker per bus, the second one finishing first */
+		expect_read(&ctx2, "\xA5\x22", "\x00\x64\x00", 3);
+		LONGS_EQUAL(HLW811X_CHECKSUM_MISMATCH,
+				hlw811x_agg_read_chip(&agg, 1));
+		LONGS_EQUAL(HLW811X_BUSY, hlw811x_agg_read_chip(&agg, 1));
+		LONGS_EQUAL(HLW811X_BUSY, hlw811x_agg_publish(&agg));
+		expect_zero_snapshot(&ctx1);
+		LONGS_EQUAL(HLW811X_ERROR_NONE,
+				hlw811x_agg_read_chip(&agg, 0));
+		LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_agg_publish(&agg));
+	}
+
+	/* the failed chip read earlier does not count */
+	LONGS_EQUAL(120000, agg.timestamp);
+	LONGS_EQUAL(0, agg.skew);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_agg_get(&agg, 1, &sample));
+	LONGS_EQUAL(HLW811X_CHIP_OFFLINE, sample.health);
+	LONGS_EQUAL(3, sample.failures);
+}
+
+TEST_GROUP(HLW811x_Spi) {
+	int ctx;
+	struct hlw811x *dev;
+
+	void setup(void) {
+		const struct hlw811x_io io = {
+			.ll_write = dev_ll_write,
+			.ll_read = dev_ll_read,
+			.ll_select = dev_ll_select,
+			.ctx = &ctx,
+		};
+
+		hlw811x_init(HLW811X_UART);
+		dev = hlw811x_create(HLW811X_SPI, &io);
+	}
+	void teardown(void) {
+		hlw811x_destroy(dev);
+
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	void expect_select(bool selected) {
+		mock().expectOneCall("dev_ll_select")
+			.withPointerParameter("ctx", &ctx)
+			.withParameter("selected", selected);
+	}
+	void expect_read(const char *addr, const char *buf, size_t bufsize) {
+		expect_select(true);
+		mock().expectOneCall("dev_ll_write")
+			.withPointerParameter("ctx", &ctx)
+			.withMemoryBufferParameter("data", (const uint8_t *)addr, 1)
+			.andReturnValue(1);
+		mock().expectOneCall("dev_ll_read")
+			.withPointerParameter("ctx", &ctx)
+			.withOutputParameterReturning("buf", (const uint8_t *)buf, bufsize)
+			.andReturnValue((int)bufsize);
+		expect_select(false);
+	}
+	void expect_write(const char *buf, size_t bufsize) {
+		expect_select(true);
+		mock().expectOneCall("dev_ll_write")
+			.withPointerParameter("ctx", &ctx)
+			.withMemoryBufferParameter("data", (const uint8_t *)buf, bufsize)
+			.andReturnValue((int)bufsize);
+		expect_select(false);
+	}
+};
+
+TEST(HLW811x_Spi, read_ShouldSendAddressOnly_WhenRegisterIsRead) {
+	int32_t centihertz;
+	expect_read("\x23", "\x22\xF4", 2);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_dev_get_frequency(dev, &centihertz));
+	LONGS_EQUAL(5000, centihertz);
+}
+
+TEST(HLW811x_Spi, write_ShouldSendFrameWithoutHeaderAndChecksum) {
+	expect_write("\xEA\xE5", 2);
+	expect_write("\x80\x0A\x04", 3);
+	expect_write("\xEA\xDC", 2);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_dev_write_reg(dev, HLW811X_REG_SYS_CTRL,
+					(const uint8_t *)"\x0A\x04", 2));
+}
+
+TEST(HLW811x_Spi, read_ShouldReleaseChipSelect_WhenNoResponse) {
+	uint8_t buf[2];
+	expect_select(true);
+	mock().expectOneCall("dev_ll_write")
+		.withPointerParameter("ctx", &ctx)
+		.withMemoryBufferParameter("data", (const uint8_t *)"\x23", 1)
+		.andReturnValue(1);
+	mock().expectOneCall("dev_ll_read")
+		.withPointerParameter("ctx", &ctx)
+		.withOutputParameterReturning("buf", (const uint8_t *)"", 0)
+		.andReturnValue(0);
+	expect_select(false);
+	LONGS_EQUAL(HLW811X_NO_RESPONSE, hlw811x_dev_read_reg(dev,
+			HLW811X_REG_FREQUENCY_L_LINE, buf, sizeof(buf)));
+}
+
+TEST(HLW811x, import_calib_ShouldReadChecksumOnly_WhenBlobMatchesChip) {
+	uint8_t blob[HLW811X_CALIB_BLOB_SIZE];
+	size_t len;
+	bool refreshed = true;
+	int32_t Wh;
+
+	expect_coeff_read(NULL);
+	set_default_param();
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_export_calib(blob, sizeof(blob), &len));
+	LONGS_EQUAL(HLW811X_CALIB_BLOB_SIZE, len);
+
+	hlw811x_init(HLW811X_UART);
+	expect_read("\xA5\x6F", "\x00\x08\xE3", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_import_calib(blob, len, &refreshed));
+	CHECK_FALSE(refreshed);
+
+	expect_read("\xA5\x28", "\x00\x00\x01\x31", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_energy(HLW811X_CHANNEL_A, &Wh));
+	LONGS_EQUAL(7, Wh);
+}
+
+TEST(HLW811x, import_calib_ShouldReadCoeffAgain_WhenChipChecksumDiffers) {
+	uint8_t blob[HLW811X_CALIB_BLOB_SIZE];
+	bool refreshed = false;
+
+	expect_coeff_read(NULL);
+	set_default_param();
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_export_calib(blob, sizeof(blob), NULL));
+
+	expect_read("\xA5\x6F", "\x00\x09\xE2", 3);
+	expect_coeff_regs();
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_import_calib(blob, sizeof(blob), &refreshed));
+	CHECK_TRUE(refreshed);
+}
+
+TEST(HLW811x, import_calib_ShouldReturnInvalidData_WhenBlobIsCorrupted) {
+	uint8_t blob[HLW811X_CALIB_BLOB_SIZE];
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_export_calib(blob, sizeof(blob), NULL));
+	blob[5] ^= 1;
+	LONGS_EQUAL(HLW811X_INVALID_DATA,
+			hlw811x_import_calib(blob, sizeof(blob), NULL));
+	LONGS_EQUAL(HLW811X_INVALID_DATA,
+			hlw811x_import_calib(blob, sizeof(blob) - 1, NULL));
+}
+
+TEST(HLW811x, export_calib_ShouldReturnBufferTooSmall_WhenBufferIsShort) {
+	uint8_t blob[HLW811X_CALIB_BLOB_SIZE - 1];
+	LONGS_EQUAL(HLW811X_BUFFER_TOO_SMALL,
+			hlw811x_export_calib(blob, sizeof(blob), NULL));
+}
+
+TEST(HLW811x, convert_batch_ShouldMatchGetters_WithoutBusAccess) {
+	const int32_t rms[] = { 0x000001, 0x000100, 0x7FFFFF };
+	const int32_t power[] = { (int32_t)0x80000000, 0x000BDBBC, 0x7FFFFFFF };
+	const int32_t energy[] = { 0x000000, 0x000001, 0x000030, 0xFFFFFF };
+	int32_t out[4];
+
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_convert_rms_batch(
+			HLW811X_CHANNEL_A, rms, out, 3));
+	LONGS_EQUAL(0, out[0]);
+	LONGS_EQUAL(15, out[1]);
+	LONGS_EQUAL(524279, out[2]);
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_convert_power_batch(
+			HLW811X_CHANNEL_A, HLW811X_CHANNEL_A, power, out, 3));
+	LONGS_EQUAL(-262140000, out[0]);
+	LONGS_EQUAL(94865, out[1]);
+	LONGS_EQUAL(262139999, out[2]);
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_convert_energy_batch(
+			HLW811X_CHANNEL_A, energy, out, 4));
+	LONGS_EQUAL(0, out[0]);
+	LONGS_EQUAL(7, out[1]);
+	LONGS_EQUAL(374, out[2]);
+	LONGS_EQUAL(131067992, out[3]);
+}
+
+TEST(HLW811x, convert_rms_batch_ShouldZeroNegativeSamples_WhenSignBitIsSet) {
+	const int32_t rms[] = { 0x000100, 0x800000, 0x000100 };
+	int32_t out[3];
+
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	LONGS_EQUAL(HLW811X_INVALID_DATA, hlw811x_convert_rms_batch(
+			HLW811X_CHANNEL_A, rms, out, 3));
+	LONGS_EQUAL(15, out[0]);
+	LONGS_EQUAL(0, out[1]);
+	LONGS_EQUAL(15, out[2]);
+}
+
+TEST(HLW811x, set_interrupt_mode_ShouldSelectIrqOutput_WhenIrqIsGiven) {
+	expect_read("\xA5\x1D", "\x32\x10\xFB", 3);
+	expect_write("\xA5\x9D\x32\x83\x08", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_set_interrupt_mode(
+			HLW811X_INTR_IRQ, HLW811X_INTR_AVERAGE_UPDATED));
+}
+
+TEST(HLW811x, set_interrupt_mode_ShouldReturnInvalidParam_WhenFlagHasNoSelector) {
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_set_interrupt_mode(
+			HLW811X_INTR_RESERVED, HLW811X_INTR_PULSE_OUT_A));
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_set_interrupt_mode(
+			HLW811X_INTR_PULSE_OUT_A, (hlw811x_intr_t)
+			(HLW811X_INTR_PULSE_OUT_A | HLW811X_INTR_PULSE_OUT_B)));
+}
+
+TEST(HLW811x, for_each_pending_ShouldVisitSetFlagsOnly_InBitOrder) {
+	int ctx;
+	mock().expectOneCall("irq_handler")
+		.withParameter("flag", HLW811X_INTR_AVERAGE_UPDATED)
+		.withPointerParameter("ctx", &ctx);
+	mock().expectOneCall("irq_handler")
+		.withParameter("flag", HLW811X_INTR_UNDER_VOLTAGE)
+		.withPointerParameter("ctx", &ctx);
+	mock().expectOneCall("irq_handler")
+		.withParameter("flag", HLW811X_INTR_B_LEAKAGE)
+		.withPointerParameter("ctx", &ctx);
+	hlw811x_for_each_pending((hlw811x_intr_t)(HLW811X_INTR_B_LEAKAGE
+			| HLW811X_INTR_UNDER_VOLTAGE
+			| HLW811X_INTR_AVERAGE_UPDATED), irq_handler, &ctx);
+	hlw811x_for_each_pending((hlw811x_intr_t)0, irq_handler, &ctx);
+}
+
+static void poll_cb(hlw811x_quantity_t qty, int32_t value, void *ctx) {
+	mock().actualCall(__func__)
+		.withParameter("qty", qty)
+		.withParameter("value", value)
+		.withPointerParameter("ctx", ctx);
+}
+
+static void expect_poll(hlw811x_quantity_t qty, int32_t value, void *ctx) {
+	mock().expectOneCall("poll_cb")
+		.withParameter("qty", qty)
+		.withParameter("value", value)
+		.withPointerParameter("ctx", ctx);
+}
+
+TEST(HLW811x, poll_scheduler_ShouldReadOncePerPeriodAndShed_WhenBudgetRunsOut) {
+	const uint32_t period = 292935; /* 3.4Hz */
+	struct hlw811x_poll_stats stats;
+	uint32_t now = 0;
+	int ctx;
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_add_poll(HLW811X_QTY_RMS_A, 290, 2));
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_add_poll(HLW811X_QTY_FREQUENCY, 600, 1));
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_add_poll(HLW811X_QTY_PHASE_ANGLE, 600, 0));
+	expect_read("\xA5\x13", "\x00\x00\x47", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_poll_scheduler(
+			read_clock, &now, 2, poll_cb, &ctx));
+
+	expect_read("\xA5\x24", "\x00\x00\x01\x35", 4);
+	expect_poll(HLW811X_QTY_RMS_A, 0, &ctx);
+	expect_read("\xA5\x23", "\x22\xF3\x22", 3);
+	expect_poll(HLW811X_QTY_FREQUENCY, 5001, &ctx);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+	now = period - 1;
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+
+	now = period;
+	expect_read("\xA5\x24", "\x00\x00\x01\x35", 4);
+	expect_poll(HLW811X_QTY_RMS_A, 0, &ctx);
+	expect_read("\xA5\x22", "\x00\x10\x28", 3);
+	expect_poll(HLW811X_QTY_PHASE_ANGLE, 128, &ctx);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+
+	now = period * 3 + 10;
+	expect_read("\xA5\x24", "\x00\x00\x01\x35", 4);
+	expect_poll(HLW811X_QTY_RMS_A, 0, &ctx);
+	expect_read("\xA5\x23", "\x22\xF3\x22", 3);
+	expect_poll(HLW811X_QTY_FREQUENCY, 5001, &ctx);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_poll_stats(&stats));
+	LONGS_EQUAL(3, stats.periods);
+	LONGS_EQUAL(1, stats.missed);
+	LONGS_EQUAL(6, stats.reads);
+	LONGS_EQUAL(2, stats.shed);
+}
+
+TEST(HLW811x, poll_scheduler_ShouldStartPeriodOnSync) {
+	uint32_t now = 0;
+
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_run_poll_scheduler());
+	LONGS_EQUAL(HLW811X_INVALID_PARAM,
+			hlw811x_add_poll(HLW811X_QTY_MAX, 100, 0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_add_poll(HLW811X_QTY_RMS_A, 100, 0));
+	expect_read("\xA5\x13", "\x00\x00\x47", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_poll_scheduler(
+			read_clock, &now, 0, poll_cb, NULL));
+
+	expect_read("\xA5\x24", "\x00\x00\x01\x35", 4);
+	expect_poll(HLW811X_QTY_RMS_A, 0, NULL);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+
+	now = 1000;
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_sync_poll_scheduler());
+	expect_read("\xA5\x24", "\x00\x00\x01\x35", 4);
+	expect_poll(HLW811X_QTY_RMS_A, 0, NULL);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_stop_poll_scheduler());
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_sync_poll_scheduler());
+}
+
+TEST(HLW811x, channel_mux_ShouldSkipChannelReadsAndRedundantSelects) {
+	struct hlw811x_channel_mux_stats stats;
+	hlw811x_channel_t ch;
+	uint32_t now = 0;
+	int32_t mVA;
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_start_channel_mux(read_clock, &now, 0));
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\xEA\x5A\x16", 4)
+		.andReturnValue(4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_select_channel(HLW811X_CHANNEL_A));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_select_channel(HLW811X_CHANNEL_A));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_current_channel(&ch));
+	LONGS_EQUAL(HLW811X_CHANNEL_A, ch);
+
+	expect_read("\xA5\x2E", "\x00\x00\x00\x00\x2C", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_power(HLW811X_CHANNEL_U, &mVA));
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_channel_mux_stats(&stats));
+	LONGS_EQUAL(1, stats.switches);
+	LONGS_EQUAL(1, stats.skipped);
+
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\xEA\x96\xDA", 4)
+		.andReturnValue(4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_reset());
+	expect_read("\xA5\x2F", "\x20\x00\x00\x0B", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_current_channel(&ch));
+	LONGS_EQUAL(HLW811X_CHANNEL_B, ch);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_read_current_channel(&ch));
+	LONGS_EQUAL(HLW811X_CHANNEL_B, ch);
+}
+
+TEST(HLW811x, read_channel_group_ShouldReturnBusy_UntilChannelSettles) {
+	struct hlw811x_channel_group group;
+	uint32_t now = 0;
+
+	LONGS_EQUAL(HLW811X_INVALID_PARAM,
+			hlw811x_read_channel_group(HLW811X_CHANNEL_B, &group));
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_start_channel_mux(read_clock, &now, 100));
+
+	mock().expectOneCall("hlw811x_ll_write")
+		.withMemoryBufferParameter("data", (const uint8_t *)"\xA5\xEA\xA5\xCB", 4)
+		.andReturnValue(4);
+	LONGS_EQUAL(HLW811X_BUSY,
+			hlw811x_read_channel_group(HLW811X_CHANNEL_B, &group));
+	now = 99999;
+	LONGS_EQUAL(HLW811X_BUSY,
+			hlw811x_read_channel_group(HLW811X_CHANNEL_B, &group));
+
+	now = 100000;
+	expect_read("\xA5\x2E", "\x00\x00\x00\x00\x2C", 5);
+	expect_read("\xA5\x27", "\x00\x00\x00\x33", 4);
+	expect_read("\xA5\x2D", "\x00\x00\x00\x00\x2D", 5);
+	expect_read("\xA5\x25", "\x00\x00\x00\x35", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_read_channel_group(HLW811X_CHANNEL_B, &group));
+	LONGS_EQUAL(HLW811X_CHANNEL_B, group.channel);
+}
+
+TEST(HLW811x, set_threshold_ShouldConvertEngineeringUnitsToCounts) {
+	LONGS_EQUAL(HLW811X_INVALID_DATA, hlw811x_set_threshold(
+			HLW811X_THRESHOLD_OVER_CURRENT_A, 10000));
+
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	expect_write("\xA5\x9A\x02\x71\x4D", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_set_threshold(
+			HLW811X_THRESHOLD_OVER_CURRENT_A, 10000));
+	expect_write("\xA5\x99\x3F\x7A\x08", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_set_threshold(
+			HLW811X_THRESHOLD_OVER_VOLTAGE, 325000));
+	expect_write("\xA5\x9C\x00\xFA\xC4", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_set_threshold(
+			HLW811X_THRESHOLD_OVERLOAD, 2000000));
+	expect_write("\xA5\x98\xFF\xFF\xC4", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_set_threshold(
+			HLW811X_THRESHOLD_UNDER_VOLTAGE, INT32_MAX));
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_set_threshold(
+			HLW811X_THRESHOLD_UNDER_VOLTAGE, -1));
+}
+
+TEST(HLW811x, handle_irq_ShouldLogEventsWithPeaks_WhenCaptureIsStarted) {
+	struct hlw811x_event events[4];
+	uint32_t now = 1234;
+
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_start_event_capture(
+			HLW811X_INTR_AVERAGE_UPDATED, read_clock, &now));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_event_capture(
+			(hlw811x_intr_t)(HLW811X_INTR_OVER_CURRENT_A
+				| HLW811X_INTR_UNDER_VOLTAGE), read_clock, &now));
+
+	expect_read("\xA5\x42", "\x08\x80\x90", 3);
+	expect_read("\xA5\x30", "\x02\x71\x00\xB7", 4);
+	expect_read("\xA5\x32", "\x3F\x7A\x00\x6F", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_handle_irq());
+
+	LONGS_EQUAL(2, hlw811x_drain_events(events, 4));
+	LONGS_EQUAL(HLW811X_INTR_OVER_CURRENT_A, events[0].type);
+	LONGS_EQUAL(9999, events[0].value);
+	LONGS_EQUAL(1234, events[0].timestamp);
+	LONGS_EQUAL(HLW811X_INTR_UNDER_VOLTAGE, events[1].type);
+	LONGS_EQUAL(324995, events[1].value);
+	LONGS_EQUAL(0, hlw811x_drain_events(events, 4));
+}
+
+TEST(HLW811x, capture_events_ShouldLogEventWithError_WhenPeakReadFails) {
+	struct hlw811x_event events[4];
+	uint32_t now = 0;
+
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_event_capture(
+			(hlw811x_intr_t)(HLW811X_INTR_OVER_CURRENT_A
+				| HLW811X_INTR_UNDER_VOLTAGE), read_clock, &now));
+
+	expect_read("\xA5\x30", "\x82\x71\x00\x37", 4);
+	expect_read("\xA5\x32", "\x3F\x7A\x00\x00", 4);
+	LONGS_EQUAL(HLW811X_CHECKSUM_MISMATCH, hlw811x_capture_events(
+			(hlw811x_intr_t)(HLW811X_INTR_OVER_CURRENT_A
+				| HLW811X_INTR_UNDER_VOLTAGE)));
+
+	LONGS_EQUAL(2, hlw811x_drain_events(events, 4));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, events[0].err);
+	LONGS_EQUAL(-9999, events[0].value); /* a negative peak */
+	LONGS_EQUAL(HLW811X_INTR_UNDER_VOLTAGE, events[1].type);
+	LONGS_EQUAL(HLW811X_CHECKSUM_MISMATCH, events[1].err);
+	LONGS_EQUAL(0, events[1].value);
+}
+
+TEST(HLW811x, capture_events_ShouldDropNewEvents_WhenLogIsFull) {
+	struct hlw811x_event events[8];
+	uint32_t now = 0;
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_event_capture(
+			HLW811X_INTR_OVER_CURRENT_A, read_clock, &now));
+
+	for (int i = 0; i < 10; i++) {
+		now = (uint32_t)i;
+		if (i < 8) { /* no read once the log is full */
+			expect_read("\xA5\x30", "\x02\x71\x00\xB7", 4);
+		}
+		LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_capture_events(
+				(hlw811x_intr_t)(HLW811X_INTR_OVER_CURRENT_A
+					| HLW811X_INTR_AVERAGE_UPDATED)));
+	}
+
+	LONGS_EQUAL(2, hlw811x_get_dropped_events());
+	LONGS_EQUAL(3, hlw811x_drain_events(events, 3));
+	LONGS_EQUAL(0, events[0].timestamp);
+	LONGS_EQUAL(5, hlw811x_drain_events(events, 8));
+	LONGS_EQUAL(7, events[4].timestamp);
+}
+
+static void expect_calib_window(const char *gain, const char *phase,
+		const char *offset) {
+	const struct { const char *frame; size_t len; } frames[] = {
+		{ "\xA5\xEA\xE5\x8B", 4 },
+		{ gain, 5 }, { phase, 4 }, { offset, 5 },
+		{ "\xA5\xEA\xDC\x94", 4 },
+	};
+	for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+		mock().expectOneCall("hlw811x_ll_write")
+			.withMemoryBufferParameter("data",
+				(const uint8_t *)frames[i].frame, frames[i].len)
+			.andReturnValue((int)frames[i].len);
+	}
+}
+
+TEST(HLW811x, calib_ShouldSolvePowerGain_WhenReferenceIsFed) {
+	struct hlw811x_calib_regs regs;
+
+	LONGS_EQUAL(HLW811X_INVALID_PARAM,
+			hlw811x_calib_feed(HLW811X_CALIB_GAIN, 2200000));
+
+	expect_coeff_read(NULL);
+	set_default_param();
+
+	expect_calib_window("\xA5\x85\x00\x00\xD5", "\xA5\x87\x00\xD3",
+			"\xA5\x8A\x00\x00\xD0");
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_calib_begin(HLW811X_CHANNEL_A, 2));
+
+	expect_read("\xA5\x2C", "\x00\xFA\x00\x00\x34", 5);
+	LONGS_EQUAL(HLW811X_BUSY,
+			hlw811x_calib_feed(HLW811X_CALIB_GAIN, 2200000));
+	expect_read("\xA5\x2C", "\x00\xFA\x00\x00\x34", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_calib_feed(HLW811X_CALIB_GAIN, 2200000));
+
+	expect_calib_window("\xA5\x85\x0C\xCD\xFC", "\xA5\x87\x00\xD3",
+			"\xA5\x8A\x00\x00\xD0");
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_calib_commit(&regs));
+	LONGS_EQUAL(HLW811X_CHANNEL_A, regs.channel);
+	LONGS_EQUAL(0x0CCD, regs.power_gain);
+	LONGS_EQUAL(0, regs.phase);
+	LONGS_EQUAL(0, regs.power_offset);
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_calib_commit(NULL));
+}
+
+TEST(HLW811x, calib_apply_ShouldStageIntoTransaction_WhenOneIsInProgress) {
+	const struct hlw811x_calib_regs regs = {
+		.channel = HLW811X_CHANNEL_A,
+		.power_gain = 0x0CCC,
+		.power_offset = 0,
+		.phase = 0,
+	};
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_begin_config());
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_calib_apply(&regs));
+	mock().checkExpectations();
+
+	expect_calib_window("\xA5\x85\x0C\xCC\xFD", "\xA5\x87\x00\xD3",
+			"\xA5\x8A\x00\x00\xD0");
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_commit_config());
+}
+
+TEST(HLW811x, import_calib_regs_ShouldRestoreExportedRegisters) {
+	const struct hlw811x_calib_regs regs = {
+		.channel = HLW811X_CHANNEL_B,
+		.power_gain = 0xFF38,
+		.power_offset = -300,
+		.phase = -5,
+	};
+	struct hlw811x_calib_regs restored = { 0, 0, 0, 0 };
+	uint8_t blob[HLW811X_CALIB_REGS_BLOB_SIZE];
+	size_t len;
+
+	LONGS_EQUAL(HLW811X_BUFFER_TOO_SMALL, hlw811x_export_calib_regs(&regs,
+			blob, sizeof(blob) - 1, &len));
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_export_calib_regs(&regs,
+			blob, sizeof(blob), &len));
+	LONGS_EQUAL(HLW811X_CALIB_REGS_BLOB_SIZE, len);
+	MEMCMP_EQUAL("\x48\x47\x01\x02\xFF\x38\xFE\xD4\xFB", blob, 9);
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_import_calib_regs(blob, len, &restored));
+	LONGS_EQUAL(HLW811X_CHANNEL_B, restored.channel);
+	LONGS_EQUAL(0xFF38, restored.power_gain);
+	LONGS_EQUAL(-300, restored.power_offset);
+	LONGS_EQUAL(-5, restored.phase);
+
+	blob[4] ^= 1;
+	LONGS_EQUAL(HLW811X_INVALID_DATA,
+			hlw811x_import_calib_regs(blob, len, &restored));
+	LONGS_EQUAL(HLW811X_INVALID_DATA,
+			hlw811x_import_calib_regs(blob, len - 1, &restored));
+	LONGS_EQUAL(0xFF38, restored.power_gain);
+}
+
+TEST(HLW811x, get_temperature_ShouldReadModeOnce_WhenChannelBMeasuresTemperature) {
+	int32_t temp;
+
+	expect_read("\xA5\x13", "\x00\x00\x47", 3);
+	expect_read("\xA5\x25", "\x40\xA0\x00\x55", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_temperature(&temp));
+	LONGS_EQUAL(3500, temp);
+
+	expect_read("\xA5\x25", "\x40\xA0\x00\x55", 4);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_temperature(&temp));
+
+	expect_read("\xA5\x13", "\x00\x00\x47", 3);
+	expect_write("\xA5\x93\x00\x80\x47", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_set_channel_b_mode(HLW811X_B_MODE_NORMAL));
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_get_temperature(&temp));
+}
+
+TEST(HLW811x, poll_scheduler_ShouldInterleaveTemperature_WhenChannelBMeasuresCurrent) {
+	const uint32_t period = 292935; /* 3.4Hz */
+	struct hlw811x_poll_stats stats;
+	uint32_t now = 0;
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_add_poll(HLW811X_QTY_RMS_B, 100, 0));
+	LONGS_EQUAL(HLW811X_ERROR_NONE,
+			hlw811x_add_poll(HLW811X_QTY_TEMPERATURE, 1000, 0));
+	expect_read("\xA5\x13", "\x00\x80\xC7", 3);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_poll_scheduler(
+			read_clock, &now, 0, poll_cb, NULL));
+
+	/* channel B switched to the temperature after its current */
+	expect_read("\xA5\x25", "\x00\x00\x01\x34", 4);
+	expect_poll(HLW811X_QTY_RMS_B, 0, NULL);
+	expect_read("\xA5\x13", "\x00\x80\xC7", 3);
+	expect_write("\xA5\x93\x00\x00\xC7", 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+	mock().checkExpectations();
+
+	/* settling, with the current held */
+	now += period;
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+	mock().checkExpectations();
+
+	/* read and switched back */
+	now += period;
+	expect_read("\xA5\x25", "\x40\xA0\x00\x55", 4);
+	expect_read("\xA5\x13", "\x00\x00\x47", 3);
+	expect_write("\xA5\x93\x00\x80\x47", 5);
+	expect_poll(HLW811X_QTY_TEMPERATURE, 3500, NULL);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+	mock().checkExpectations();
+
+	now += period;
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+	now += period;
+	expect_read("\xA5\x25", "\x00\x00\x01\x34", 4);
+	expect_poll(HLW811X_QTY_RMS_B, 0, NULL);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_run_poll_scheduler());
+
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_get_poll_stats(&stats));
+	LONGS_EQUAL(7, stats.reads);
+}
+
+TEST(HLW811x, power_save_ShouldGateInOneWindow_AndWaitForSettling) {
+	const char *on[] = { "\xA5\x80\x0A\x04\xCC", "\xA5\x81\x0C\x05\xC8" };
+	const char *off[] = { "\xA5\x80\x00\x04\xD6", "\xA5\x81\x0C\x04\xC9" };
+	uint32_t now = 100;
+
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_open_window());
+
+	expect_shadow_load();
+	/* the pulse of channel A is off already */
+	expect_write(off[0], 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_start_power_save(
+			HLW811X_CHANNEL_A | HLW811X_CHANNEL_U,
+			HLW811X_CHANNEL_A, read_clock, &now));
+
+	expect_write_window(on, 2);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_open_window());
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_open_window());
+
+	now += 2 * 292935 - 1;
+	LONGS_EQUAL(HLW811X_BUSY, hlw811x_is_window_ready());
+	now++;
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_is_window_ready());
+
+	expect_write_window(off, 2);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_close_window());
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_is_window_ready());
+
+	/* the pulse of channel A stays off as before the start */
+	expect_write(on[0], 5);
+	LONGS_EQUAL(HLW811X_ERROR_NONE, hlw811x_stop_power_save());
+	LONGS_EQUAL(HLW811X_INVALID_PARAM, hlw811x_stop_power_save());
+}